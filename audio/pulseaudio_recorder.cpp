@@ -8,8 +8,10 @@
 #if defined(ENABLE_REC_SOUND) && !defined(WIN32)
 
 #include "core/capture_library.hpp"
+#include "core/encoder_registry.hpp"
 #include "core/recorder_private.hpp"
-#include "audio/vorbis_encoder.hpp"
+#include "core/trace_recorder.hpp"
+#include "core/worker_pool.hpp"
 
 #include <pulse/pulseaudio.h>
 #include <string>
@@ -469,9 +471,10 @@ namespace Recorder
         }   // ~PulseAudioData
     };
     // ========================================================================
-    void audioRecorder(CaptureLibrary* cl)
+    /** Connect to the server the first time, the connection is kept by the
+     *  CaptureLibrary for later recordings. NULL if it failed. */
+    static PulseAudioData* loadAudioData(CaptureLibrary* cl)
     {
-        setThreadName("audioRecorder");
         PulseAudioData* pa_data =
             dynamic_cast<PulseAudioData*>(cl->getAudioData());
         if (pa_data == NULL)
@@ -484,7 +487,20 @@ namespace Recorder
                     " data.\n");
             }
         }
-        if (!pa_data->m_loaded)
+        return pa_data->m_loaded ? pa_data : NULL;
+    }   // loadAudioData
+    // ------------------------------------------------------------------------
+    void warmupAudio(CaptureLibrary* cl)
+    {
+        loadAudioData(cl);
+    }   // warmupAudio
+    // ------------------------------------------------------------------------
+    void audioRecorder(CaptureLibrary* cl)
+    {
+        setThreadName("audioRecorder");
+        applyThreadConfig(OGR_TS_AUDIO_RECORDER);
+        PulseAudioData* pa_data = loadAudioData(cl);
+        if (pa_data == NULL)
         {
             return;
         }
@@ -503,7 +519,7 @@ namespace Recorder
         std::list<int8_t*> pcm_data;
         std::mutex pcm_mutex;
         std::condition_variable pcm_cv;
-        std::thread audio_enc_thread;
+        std::future<void> audio_enc_task;
 
         AudioEncoderData aed;
         pa_data->configAudioType(&aed);
@@ -514,23 +530,32 @@ namespace Recorder
         const unsigned frag_size = 1024 * pa_data->m_sample_spec.channels *
             sizeof(int16_t);
 
-        switch (cl->getRecorderConfig().m_audio_format)
+        const AudioEncoderInfo* info = getAudioEncoderInfo(
+            cl->getRecorderConfig().m_audio_format);
+        if (info != NULL)
         {
-        case OGR_AF_VORBIS:
-            audio_enc_thread = std::thread(vorbisEncoder, &aed);
-            break;
-        default:
-            break;
+            audio_enc_task = cl->getWorkerPool()->submit(
+                std::bind(info->m_encoder, &aed));
         }
 
         int8_t* each_pcm_buf = new int8_t[frag_size]();
         unsigned readed = 0;
+        uint64_t fragments = 0;
         while (true)
         {
             if (cl->getSoundStop())
             {
                 std::lock_guard<std::mutex> lock(pcm_mutex);
-                pcm_data.push_back(each_pcm_buf);
+                if (cl->isCancelled())
+                {
+                    // Drop what the encoder has not taken yet
+                    for (int8_t* buf : pcm_data)
+                        delete[] buf;
+                    pcm_data.clear();
+                    delete[] each_pcm_buf;
+                }
+                else
+                    pcm_data.push_back(each_pcm_buf);
                 pcm_data.push_back(NULL);
                 pcm_cv.notify_one();
                 break;
@@ -548,6 +573,10 @@ namespace Recorder
                     pa_data->dropStream();
                 continue;
             }
+            // Each fragment is traced with its index since the recording
+            // start
+            OGR_TRACE("audioCapture", fragments);
+            fragments++;
             unsigned copy_bytes = (unsigned)bytes;
             bool buf_full = readed + copy_bytes > frag_size;
             if (buf_full)
@@ -586,7 +615,8 @@ namespace Recorder
             }
             pa_data->dropStream();
         }
-        audio_enc_thread.join();
+        if (audio_enc_task.valid())
+            audio_enc_task.wait();
         pa_data->removeRecordStream();
     }   // audioRecorder
 }
@@ -15,8 +15,10 @@ namespace Recorder
 {
 #ifdef ENABLE_REC_SOUND
     void audioRecorder(CaptureLibrary* cl);
+    void warmupAudio(CaptureLibrary* cl);
 #else
     inline void audioRecorder(CaptureLibrary* cl) {}
+    inline void warmupAudio(CaptureLibrary* cl) {}
 #endif
 };
 
@@ -7,8 +7,11 @@
 
 #ifdef ENABLE_REC_SOUND
 
+#include "audio/vorbis_encoder.hpp"
 #include "core/capture_library.hpp"
+#include "core/encoder_registry.hpp"
 #include "core/recorder_private.hpp"
+#include "core/trace_recorder.hpp"
 
 #include <ogg/ogg.h>
 #include <vorbis/vorbisenc.h>
@@ -21,6 +24,7 @@ namespace Recorder
         if (aed == NULL)
             return 1;
         setThreadName("vorbisEncoder");
+        applyThreadConfig(OGR_TS_AUDIO_ENCODER);
         vorbis_info vi;
         vorbis_dsp_state vd;
         vorbis_block vb;
@@ -75,6 +79,7 @@ namespace Recorder
             int8_t* audio_buf = aed->m_buf_list->front();
             aed->m_buf_list->pop_front();
             ul.unlock();
+            OGR_TRACE("vorbisEncode", TraceRecorder::NO_FRAME);
             if (audio_buf == NULL)
             {
                 vorbis_analysis_wrote(&vd, 0);
@@ -137,6 +142,13 @@ namespace Recorder
         fclose(vb_data);
         return 1;
     }   // vorbisEncoder
+    // ------------------------------------------------------------------------
+    void registerVorbisEncoder()
+    {
+        AudioEncoderInfo vorbis = { OGR_AF_VORBIS, "A_VORBIS",
+            vorbisEncoder };
+        registerAudioEncoder(vorbis);
+    }   // registerVorbisEncoder
 }
 
 #endif
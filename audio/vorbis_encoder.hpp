@@ -8,13 +8,12 @@
 #ifndef HEADER_VORBIS_ENCODE_HPP
 #define HEADER_VORBIS_ENCODE_HPP
 
-struct AudioEncoderData;
 namespace Recorder
 {
 #ifdef ENABLE_REC_SOUND
-    int vorbisEncoder(AudioEncoderData* aed);
+    void registerVorbisEncoder();
 #else
-    inline int vorbisEncoder(AudioEncoderData* aed) { return 0; }
+    inline void registerVorbisEncoder()                                     {}
 #endif
 };
 
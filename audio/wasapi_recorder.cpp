@@ -8,8 +8,10 @@
 #if defined(ENABLE_REC_SOUND) && defined(WIN32)
 
 #include "core/capture_library.hpp"
+#include "core/encoder_registry.hpp"
 #include "core/recorder_private.hpp"
-#include "audio/vorbis_encoder.hpp"
+#include "core/trace_recorder.hpp"
+#include "core/worker_pool.hpp"
 
 #include <audioclient.h>
 #include <mmsystem.h>
@@ -158,9 +160,10 @@ namespace Recorder
         }   // ~WasapiData
     };
     // ========================================================================
-    void audioRecorder(CaptureLibrary* cl)
+    /** Open the audio client the first time, it is kept by the
+     *  CaptureLibrary for later recordings. NULL if it failed. */
+    static WasapiData* loadAudioData(CaptureLibrary* cl)
     {
-        setThreadName("audioRecorder");
         WasapiData* wasapi_data =
             dynamic_cast<WasapiData*>(cl->getAudioData());
         if (wasapi_data == NULL)
@@ -173,7 +176,20 @@ namespace Recorder
                     " data.\n");
             }
         }
-        if (!wasapi_data->m_loaded)
+        return wasapi_data->m_loaded ? wasapi_data : NULL;
+    }   // loadAudioData
+    // ------------------------------------------------------------------------
+    void warmupAudio(CaptureLibrary* cl)
+    {
+        loadAudioData(cl);
+    }   // warmupAudio
+    // ------------------------------------------------------------------------
+    void audioRecorder(CaptureLibrary* cl)
+    {
+        setThreadName("audioRecorder");
+        applyThreadConfig(OGR_TS_AUDIO_RECORDER);
+        WasapiData* wasapi_data = loadAudioData(cl);
+        if (wasapi_data == NULL)
         {
             return;
         }
@@ -257,31 +273,40 @@ namespace Recorder
         std::list<int8_t*> audio_data;
         std::mutex audio_mutex;
         std::condition_variable audio_cv;
-        std::thread audio_enc_thread;
+        std::future<void> audio_enc_task;
         aed.m_buf_list = &audio_data;
         aed.m_mutex = &audio_mutex;
         aed.m_cv = &audio_cv;
         aed.m_audio_bitrate = cl->getRecorderConfig().m_audio_bitrate;
 
-        switch (cl->getRecorderConfig().m_audio_format)
+        const AudioEncoderInfo* info = getAudioEncoderInfo(
+            cl->getRecorderConfig().m_audio_format);
+        if (info != NULL)
         {
-        case OGR_AF_VORBIS:
-            audio_enc_thread = std::thread(vorbisEncoder, &aed);
-            break;
-        default:
-            break;
+            audio_enc_task = cl->getWorkerPool()->submit(
+                std::bind(info->m_encoder, &aed));
         }
 
         const unsigned frag_size = 1024 * aed.m_channels *
             (wasapi_data->m_wav_format->wBitsPerSample / 8);
         int8_t* each_audio_buf = new int8_t[frag_size]();
         unsigned readed = 0;
+        uint64_t packets = 0;
         while (true)
         {
             if (cl->getSoundStop())
             {
                 std::lock_guard<std::mutex> lock(audio_mutex);
-                audio_data.push_back(each_audio_buf);
+                if (cl->isCancelled())
+                {
+                    // Drop what the encoder has not taken yet
+                    for (int8_t* buf : audio_data)
+                        delete[] buf;
+                    audio_data.clear();
+                    delete[] each_audio_buf;
+                }
+                else
+                    audio_data.push_back(each_audio_buf);
                 audio_data.push_back(NULL);
                 audio_cv.notify_one();
                 break;
@@ -300,6 +325,9 @@ namespace Recorder
                 Sleep((uint32_t)sleep_time);
                 continue;
             }
+            // Each packet is traced with its index since the recording start
+            OGR_TRACE("audioCapture", packets);
+            packets++;
             BYTE* data;
             DWORD flags;
             hr = wasapi_data->m_capture_client->GetBuffer(&data,
@@ -369,7 +397,8 @@ namespace Recorder
             runCallback(OGR_CBT_ERROR_RECORDING, "Failed to stop audio"
                 " recorder.\n");
         }
-        audio_enc_thread.join();
+        if (audio_enc_task.valid())
+            audio_enc_task.wait();
     }   // audioRecorder
 }
 #endif
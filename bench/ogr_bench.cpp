@@ -0,0 +1,1835 @@
+/* Copyright (c) 2017, libopenglrecorder contributors
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+
+/* Benchmark of libopenglrecorder without an OpenGL context: the read back
+ * and pixel buffer object functions are served from a frame buffer in
+ * memory, which is drawn with synthetic content before each ogrCapture.
+ * Every available video format is recorded at several resolutions and frame
+ * rates, and the results are written as JSON. Each format is also recorded
+ * with a small damaged part of a static frame, passed as regions to
+ * ogrCaptureRegions and as the whole frame to ogrCapture, to compare the
+ * read back and conversion costs. The lossless codec is also measured on
+ * its own, with every frame decoded again and compared to the rendered one.
+ *
+ * With --check-gl, it checks the opengl calls made by libopenglrecorder
+ * instead: the mock also tracks frame buffer objects, shaders, textures and
+ * the other states they touch, so the scaling and the YUV conversion on the
+ * GPU before read back can be verified. It also checks in the saved video
+ * that ogrCaptureUnchanged extends the frame which was on screen.
+ */
+
+#include "openglrecorder.h"
+#include "core/gl_constants.hpp"
+#include "core/lossless_codec.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum Content
+{
+    CT_STATIC,
+    CT_SCROLLING,
+    CT_NOISE,
+    CT_GAME,
+    CT_COUNT
+};
+
+const char* const g_content_names[CT_COUNT] =
+{
+    "static", "scrolling", "noise", "game"
+};
+
+const char* const g_format_names[OGR_VF_COUNT] =
+{
+    "vp8", "vp9", "mjpeg", "h264", "lossless"
+};
+
+struct Resolution
+{
+    unsigned m_width, m_height;
+};
+
+const Resolution g_resolutions[] =
+{
+    { 640, 360 },
+    { 1280, 720 },
+    { 1920, 1080 }
+};
+
+const unsigned g_frame_rates[] = { 30, 60 };
+
+// Percent of the frame changed each frame for the damage benchmark
+const unsigned g_damage_ratios[] = { 1, 5, 25 };
+
+// RecorderConfig::m_cpu_budget of every run
+unsigned g_cpu_budget = 0;
+
+// RecorderConfig::m_parallel_gop of every run
+unsigned g_parallel_gop = 0;
+
+// RecorderConfig::m_conversion_threads of every run, the thread sweep goes
+// from 1 to the number of hardware threads instead
+unsigned g_conversion_threads = 0;
+
+// Output size and scale filter of every run, 0 for the capture size, larger
+// resolutions are scaled down on the CPU and smaller ones are skipped
+unsigned g_output_width = 0, g_output_height = 0;
+ScaleFilter g_scale_filter = OGR_SF_BILINEAR;
+const char* const g_filter_names[OGR_SF_COUNT] = { "bilinear", "area" };
+
+// Mock OpenGL state, bottom-up RGBA like the default frame buffer
+std::vector<uint8_t> g_frame_buffer, g_background;
+unsigned g_fb_width, g_fb_height;
+std::map<unsigned, std::vector<uint8_t> > g_buffers;
+unsigned g_bound_buffer = 0, g_next_buffer = 1;
+uint64_t g_readback_bytes = 0;
+
+// Frame buffer objects for --check-gl, with the render buffer attached to
+// each one and the size of each render buffer
+bool g_check_gl = false;
+std::map<unsigned, unsigned> g_framebuffers;
+std::map<unsigned, Resolution> g_renderbuffers;
+unsigned g_read_framebuffer = 0, g_draw_framebuffer = 0;
+unsigned g_bound_renderbuffer = 0, g_next_object = 1;
+int g_check_failures = 0;
+
+struct ReadPixelsCall
+{
+    int m_x, m_y, m_width, m_height;
+    unsigned m_framebuffer;
+};
+
+struct BlitCall
+{
+    int m_src[4], m_dst[4];
+    unsigned m_mask, m_filter, m_read_framebuffer, m_draw_framebuffer;
+};
+
+struct MockProgram
+{
+    std::vector<unsigned> m_shaders;
+    bool m_linked;
+    int m_frame_unit;
+    float m_size[4];
+};
+
+struct CopyTexCall
+{
+    int m_x, m_y, m_width, m_height;
+    unsigned m_texture, m_read_framebuffer;
+};
+
+struct DrawCall
+{
+    unsigned m_mode;
+    int m_first, m_count;
+    unsigned m_draw_framebuffer;
+    Resolution m_target;
+    unsigned m_program;
+    MockProgram m_program_state;
+    unsigned m_texture, m_vertex_array;
+    int m_viewport[4];
+    bool m_caps_enabled;
+};
+
+std::vector<ReadPixelsCall> g_read_pixels_calls;
+std::vector<BlitCall> g_blit_calls;
+std::vector<size_t> g_buffer_sizes;
+
+// Objects and states of the shader and draw functions
+std::map<unsigned, unsigned> g_shaders;
+std::map<unsigned, MockProgram> g_programs;
+std::map<unsigned, Resolution> g_textures;
+std::set<unsigned> g_vertex_arrays;
+std::map<unsigned, bool> g_caps;
+unsigned g_current_program = 0, g_bound_texture = 0;
+unsigned g_bound_vertex_array = 0;
+int g_viewport[4] = { 0, 0, 0, 0 };
+int g_active_texture = E_GL_TEXTURE0;
+std::string g_shader_version;
+std::vector<CopyTexCall> g_copy_tex_calls;
+std::vector<DrawCall> g_draw_calls;
+uint64_t g_random = 0x9E3779B97F4A7C15ull;
+
+std::atomic<bool> g_saved(false);
+std::string g_saved_file;
+
+// ----------------------------------------------------------------------------
+void checkGL(bool ok, const char* what)
+{
+    if (ok)
+        return;
+    if (g_check_failures++ < 20)
+        fprintf(stderr, "ogr_bench: check failed: %s\n", what);
+}   // checkGL
+
+// ----------------------------------------------------------------------------
+void mockReadPixels(int x, int y, int width, int height, unsigned int format,
+                    unsigned int type, void* data)
+{
+    if (g_check_gl)
+    {
+        ReadPixelsCall call = { x, y, width, height, g_read_framebuffer };
+        g_read_pixels_calls.push_back(call);
+        if (g_read_framebuffer != 0)
+        {
+            // Only the size of render buffers is tracked, read the frame
+            // buffer instead
+            const Resolution& rb =
+                g_renderbuffers[g_framebuffers[g_read_framebuffer]];
+            const bool inside = x >= 0 && y >= 0 &&
+                x + width <= (int)rb.m_width &&
+                y + height <= (int)rb.m_height;
+            checkGL(inside, "glReadPixels outside of the render buffer");
+            if (!inside)
+                return;
+        }
+    }
+    // RGBA rows are always 4 bytes aligned
+    uint8_t* dst = (uint8_t*)data;
+    if (g_bound_buffer != 0)
+        dst = g_buffers[g_bound_buffer].data() + (size_t)data;
+    const size_t row = (size_t)width * 4;
+    g_readback_bytes += row * height;
+    for (int j = 0; j < height; j++)
+    {
+        memcpy(dst + j * row, g_frame_buffer.data() +
+            ((size_t)(y + j) * g_fb_width + x) * 4, row);
+    }
+}   // mockReadPixels
+
+// ----------------------------------------------------------------------------
+void mockGenBuffers(int n, unsigned int* buffers)
+{
+    for (int i = 0; i < n; i++)
+        buffers[i] = g_next_buffer++;
+}   // mockGenBuffers
+
+// ----------------------------------------------------------------------------
+void mockBindBuffer(unsigned int target, unsigned int buffer)
+{
+    g_bound_buffer = buffer;
+}   // mockBindBuffer
+
+// ----------------------------------------------------------------------------
+void mockBufferData(unsigned int target, ptrdiff_t size, const void* data,
+                    unsigned int usage)
+{
+    g_buffers[g_bound_buffer].resize(size);
+    if (g_check_gl)
+        g_buffer_sizes.push_back(size);
+}   // mockBufferData
+
+// ----------------------------------------------------------------------------
+void mockDeleteBuffers(int n, const unsigned int* buffers)
+{
+    for (int i = 0; i < n; i++)
+        g_buffers.erase(buffers[i]);
+}   // mockDeleteBuffers
+
+// ----------------------------------------------------------------------------
+void* mockMapBuffer(unsigned int target, unsigned int access)
+{
+    return g_buffers[g_bound_buffer].data();
+}   // mockMapBuffer
+
+// ----------------------------------------------------------------------------
+unsigned char mockUnmapBuffer(unsigned int target)
+{
+    return 1;
+}   // mockUnmapBuffer
+
+// ----------------------------------------------------------------------------
+void mockGenFramebuffers(int n, unsigned int* framebuffers)
+{
+    for (int i = 0; i < n; i++)
+    {
+        framebuffers[i] = g_next_object++;
+        g_framebuffers[framebuffers[i]] = 0;
+    }
+}   // mockGenFramebuffers
+
+// ----------------------------------------------------------------------------
+void mockBindFramebuffer(unsigned int target, unsigned int framebuffer)
+{
+    checkGL(framebuffer == 0 || g_framebuffers.count(framebuffer) != 0,
+        "glBindFramebuffer of an unknown frame buffer");
+    if (target == E_GL_FRAMEBUFFER || target == E_GL_READ_FRAMEBUFFER)
+        g_read_framebuffer = framebuffer;
+    if (target == E_GL_FRAMEBUFFER || target == E_GL_DRAW_FRAMEBUFFER)
+        g_draw_framebuffer = framebuffer;
+}   // mockBindFramebuffer
+
+// ----------------------------------------------------------------------------
+void mockDeleteFramebuffers(int n, const unsigned int* framebuffers)
+{
+    for (int i = 0; i < n; i++)
+    {
+        checkGL(g_framebuffers.erase(framebuffers[i]) == 1,
+            "glDeleteFramebuffers of an unknown frame buffer");
+    }
+}   // mockDeleteFramebuffers
+
+// ----------------------------------------------------------------------------
+void mockGenRenderbuffers(int n, unsigned int* renderbuffers)
+{
+    for (int i = 0; i < n; i++)
+    {
+        renderbuffers[i] = g_next_object++;
+        g_renderbuffers[renderbuffers[i]] = Resolution { 0, 0 };
+    }
+}   // mockGenRenderbuffers
+
+// ----------------------------------------------------------------------------
+void mockBindRenderbuffer(unsigned int target, unsigned int renderbuffer)
+{
+    checkGL(target == E_GL_RENDERBUFFER, "glBindRenderbuffer target");
+    g_bound_renderbuffer = renderbuffer;
+}   // mockBindRenderbuffer
+
+// ----------------------------------------------------------------------------
+void mockRenderbufferStorage(unsigned int target, unsigned int format,
+                             int width, int height)
+{
+    checkGL(g_bound_renderbuffer != 0 && format == E_GL_RGBA8,
+        "glRenderbufferStorage without a RGBA8 render buffer");
+    g_renderbuffers[g_bound_renderbuffer] =
+        Resolution { (unsigned)width, (unsigned)height };
+}   // mockRenderbufferStorage
+
+// ----------------------------------------------------------------------------
+void mockFramebufferRenderbuffer(unsigned int target, unsigned int attachment,
+                                 unsigned int rb_target,
+                                 unsigned int renderbuffer)
+{
+    checkGL(target == E_GL_DRAW_FRAMEBUFFER && g_draw_framebuffer != 0 &&
+        attachment == E_GL_COLOR_ATTACHMENT0 &&
+        g_renderbuffers.count(renderbuffer) != 0,
+        "glFramebufferRenderbuffer arguments");
+    g_framebuffers[g_draw_framebuffer] = renderbuffer;
+}   // mockFramebufferRenderbuffer
+
+// ----------------------------------------------------------------------------
+void mockDeleteRenderbuffers(int n, const unsigned int* renderbuffers)
+{
+    for (int i = 0; i < n; i++)
+    {
+        checkGL(g_renderbuffers.erase(renderbuffers[i]) == 1,
+            "glDeleteRenderbuffers of an unknown render buffer");
+    }
+}   // mockDeleteRenderbuffers
+
+// ----------------------------------------------------------------------------
+void mockBlitFramebuffer(int src_x0, int src_y0, int src_x1, int src_y1,
+                         int dst_x0, int dst_y0, int dst_x1, int dst_y1,
+                         unsigned int mask, unsigned int filter)
+{
+    BlitCall call = { { src_x0, src_y0, src_x1, src_y1 },
+        { dst_x0, dst_y0, dst_x1, dst_y1 }, mask, filter, g_read_framebuffer,
+        g_draw_framebuffer };
+    g_blit_calls.push_back(call);
+}   // mockBlitFramebuffer
+
+// ----------------------------------------------------------------------------
+unsigned int mockCreateShader(unsigned int type)
+{
+    checkGL(type == E_GL_VERTEX_SHADER || type == E_GL_FRAGMENT_SHADER,
+        "glCreateShader type");
+    const unsigned shader = g_next_object++;
+    g_shaders[shader] = type;
+    return shader;
+}   // mockCreateShader
+
+// ----------------------------------------------------------------------------
+void mockShaderSource(unsigned int shader, int count,
+                      const char* const* strings, const int* lengths)
+{
+    // The GLSL version comes first, followed by the shader itself
+    checkGL(g_shaders.count(shader) != 0 && count == 2 && lengths == NULL &&
+        strncmp(strings[0], "#version ", 9) == 0 &&
+        strstr(strings[1], "void main()") != NULL, "glShaderSource");
+    if (g_shader_version.empty())
+        g_shader_version = strings[0];
+}   // mockShaderSource
+
+// ----------------------------------------------------------------------------
+void mockCompileShader(unsigned int shader)
+{
+    checkGL(g_shaders.count(shader) != 0, "glCompileShader");
+}   // mockCompileShader
+
+// ----------------------------------------------------------------------------
+unsigned int mockCreateProgram()
+{
+    const unsigned program = g_next_object++;
+    MockProgram& p = g_programs[program];
+    p.m_linked = false;
+    p.m_frame_unit = -1;
+    memset(p.m_size, 0, sizeof(p.m_size));
+    return program;
+}   // mockCreateProgram
+
+// ----------------------------------------------------------------------------
+void mockAttachShader(unsigned int program, unsigned int shader)
+{
+    checkGL(g_programs.count(program) != 0 && g_shaders.count(shader) != 0,
+        "glAttachShader");
+    g_programs[program].m_shaders.push_back(g_shaders[shader]);
+}   // mockAttachShader
+
+// ----------------------------------------------------------------------------
+void mockLinkProgram(unsigned int program)
+{
+    checkGL(g_programs.count(program) != 0, "glLinkProgram");
+    MockProgram& p = g_programs[program];
+    p.m_linked = p.m_shaders.size() == 2 &&
+        std::count(p.m_shaders.begin(), p.m_shaders.end(),
+        E_GL_VERTEX_SHADER) == 1;
+}   // mockLinkProgram
+
+// ----------------------------------------------------------------------------
+void mockGetProgramiv(unsigned int program, unsigned int pname, int* param)
+{
+    checkGL(g_programs.count(program) != 0 && pname == E_GL_LINK_STATUS,
+        "glGetProgramiv");
+    *param = g_programs[program].m_linked ? 1 : 0;
+}   // mockGetProgramiv
+
+// ----------------------------------------------------------------------------
+void mockUseProgram(unsigned int program)
+{
+    checkGL(program == 0 || g_programs.count(program) != 0,
+        "glUseProgram of an unknown program");
+    g_current_program = program;
+}   // mockUseProgram
+
+// ----------------------------------------------------------------------------
+int mockGetUniformLocation(unsigned int program, const char* name)
+{
+    checkGL(g_programs.count(program) != 0, "glGetUniformLocation");
+    if (strcmp(name, "u_frame") == 0)
+        return 0;
+    if (strcmp(name, "u_size") == 0)
+        return 1;
+    checkGL(false, "glGetUniformLocation of an unknown uniform");
+    return -1;
+}   // mockGetUniformLocation
+
+// ----------------------------------------------------------------------------
+void mockUniform1i(int location, int value)
+{
+    checkGL(g_current_program != 0 && location == 0, "glUniform1i");
+    g_programs[g_current_program].m_frame_unit = value;
+}   // mockUniform1i
+
+// ----------------------------------------------------------------------------
+void mockUniform4f(int location, float x, float y, float z, float w)
+{
+    checkGL(g_current_program != 0 && location == 1, "glUniform4f");
+    float* size = g_programs[g_current_program].m_size;
+    size[0] = x;
+    size[1] = y;
+    size[2] = z;
+    size[3] = w;
+}   // mockUniform4f
+
+// ----------------------------------------------------------------------------
+void mockDeleteShader(unsigned int shader)
+{
+    checkGL(g_shaders.erase(shader) == 1, "glDeleteShader");
+}   // mockDeleteShader
+
+// ----------------------------------------------------------------------------
+void mockDeleteProgram(unsigned int program)
+{
+    checkGL(g_programs.erase(program) == 1, "glDeleteProgram");
+}   // mockDeleteProgram
+
+// ----------------------------------------------------------------------------
+void mockGenTextures(int n, unsigned int* textures)
+{
+    for (int i = 0; i < n; i++)
+    {
+        textures[i] = g_next_object++;
+        g_textures[textures[i]] = Resolution { 0, 0 };
+    }
+}   // mockGenTextures
+
+// ----------------------------------------------------------------------------
+void mockBindTexture(unsigned int target, unsigned int texture)
+{
+    checkGL(target == E_GL_TEXTURE_2D &&
+        (texture == 0 || g_textures.count(texture) != 0), "glBindTexture");
+    g_bound_texture = texture;
+}   // mockBindTexture
+
+// ----------------------------------------------------------------------------
+void mockTexImage2D(unsigned int target, int level, int internal_format,
+                    int width, int height, int border, unsigned int format,
+                    unsigned int type, const void* data)
+{
+    checkGL(g_bound_texture != 0 && level == 0 &&
+        internal_format == (int)E_GL_RGBA8, "glTexImage2D");
+    g_textures[g_bound_texture] =
+        Resolution { (unsigned)width, (unsigned)height };
+}   // mockTexImage2D
+
+// ----------------------------------------------------------------------------
+void mockTexParameteri(unsigned int target, unsigned int pname, int param)
+{
+    checkGL(g_bound_texture != 0, "glTexParameteri without a texture");
+}   // mockTexParameteri
+
+// ----------------------------------------------------------------------------
+void mockCopyTexSubImage2D(unsigned int target, int level, int x_offset,
+                           int y_offset, int x, int y, int width, int height)
+{
+    CopyTexCall call = { x, y, width, height, g_bound_texture,
+        g_read_framebuffer };
+    g_copy_tex_calls.push_back(call);
+    const Resolution& size = g_textures[g_bound_texture];
+    checkGL(g_bound_texture != 0 && x_offset == 0 && y_offset == 0 &&
+        width <= (int)size.m_width && height <= (int)size.m_height,
+        "glCopyTexSubImage2D outside of the texture");
+}   // mockCopyTexSubImage2D
+
+// ----------------------------------------------------------------------------
+void mockDeleteTextures(int n, const unsigned int* textures)
+{
+    for (int i = 0; i < n; i++)
+        checkGL(g_textures.erase(textures[i]) == 1, "glDeleteTextures");
+}   // mockDeleteTextures
+
+// ----------------------------------------------------------------------------
+void mockGenVertexArrays(int n, unsigned int* arrays)
+{
+    for (int i = 0; i < n; i++)
+    {
+        arrays[i] = g_next_object++;
+        g_vertex_arrays.insert(arrays[i]);
+    }
+}   // mockGenVertexArrays
+
+// ----------------------------------------------------------------------------
+void mockBindVertexArray(unsigned int array)
+{
+    checkGL(array == 0 || g_vertex_arrays.count(array) != 0,
+        "glBindVertexArray of an unknown vertex array");
+    g_bound_vertex_array = array;
+}   // mockBindVertexArray
+
+// ----------------------------------------------------------------------------
+void mockDeleteVertexArrays(int n, const unsigned int* arrays)
+{
+    for (int i = 0; i < n; i++)
+    {
+        checkGL(g_vertex_arrays.erase(arrays[i]) == 1,
+            "glDeleteVertexArrays");
+    }
+}   // mockDeleteVertexArrays
+
+// ----------------------------------------------------------------------------
+void mockViewport(int x, int y, int width, int height)
+{
+    g_viewport[0] = x;
+    g_viewport[1] = y;
+    g_viewport[2] = width;
+    g_viewport[3] = height;
+}   // mockViewport
+
+// ----------------------------------------------------------------------------
+void mockDrawArrays(unsigned int mode, int first, int count)
+{
+    // Objects are deleted by ogrDestroy, so keep what they were when drawing
+    DrawCall call;
+    call.m_mode = mode;
+    call.m_first = first;
+    call.m_count = count;
+    call.m_draw_framebuffer = g_draw_framebuffer;
+    call.m_target = g_renderbuffers[g_framebuffers[g_draw_framebuffer]];
+    call.m_program = g_current_program;
+    call.m_program_state = g_programs[g_current_program];
+    call.m_texture = g_bound_texture;
+    call.m_vertex_array = g_bound_vertex_array;
+    memcpy(call.m_viewport, g_viewport, sizeof(g_viewport));
+    call.m_caps_enabled = false;
+    for (auto& cap : g_caps)
+        call.m_caps_enabled = call.m_caps_enabled || cap.second;
+    g_draw_calls.push_back(call);
+}   // mockDrawArrays
+
+// ----------------------------------------------------------------------------
+void mockGetIntegerv(unsigned int pname, int* data)
+{
+    switch (pname)
+    {
+    case E_GL_VIEWPORT:
+        memcpy(data, g_viewport, sizeof(g_viewport));
+        break;
+    case E_GL_CURRENT_PROGRAM:
+        *data = (int)g_current_program;
+        break;
+    case E_GL_TEXTURE_BINDING_2D:
+        *data = (int)g_bound_texture;
+        break;
+    case E_GL_VERTEX_ARRAY_BINDING:
+        *data = (int)g_bound_vertex_array;
+        break;
+    case E_GL_READ_FRAMEBUFFER_BINDING:
+        *data = (int)g_read_framebuffer;
+        break;
+    case E_GL_DRAW_FRAMEBUFFER_BINDING:
+        *data = (int)g_draw_framebuffer;
+        break;
+    case E_GL_ACTIVE_TEXTURE:
+        *data = g_active_texture;
+        break;
+    default:
+        checkGL(false, "glGetIntegerv of an unknown state");
+        break;
+    }
+}   // mockGetIntegerv
+
+// ----------------------------------------------------------------------------
+unsigned char mockIsEnabled(unsigned int cap)
+{
+    return g_caps[cap] ? 1 : 0;
+}   // mockIsEnabled
+
+// ----------------------------------------------------------------------------
+void mockEnable(unsigned int cap)
+{
+    g_caps[cap] = true;
+}   // mockEnable
+
+// ----------------------------------------------------------------------------
+void mockDisable(unsigned int cap)
+{
+    g_caps[cap] = false;
+}   // mockDisable
+
+// ----------------------------------------------------------------------------
+void onSaved(const char* s, void* user_data)
+{
+    g_saved_file = s;
+    g_saved.store(true);
+}   // onSaved
+
+// ----------------------------------------------------------------------------
+void onError(const char* s, void* user_data)
+{
+    fprintf(stderr, "ogr_bench: %s", s);
+}   // onError
+
+// ----------------------------------------------------------------------------
+inline uint64_t nextRandom()
+{
+    // xorshift64
+    g_random ^= g_random << 13;
+    g_random ^= g_random >> 7;
+    g_random ^= g_random << 17;
+    return g_random;
+}   // nextRandom
+
+// ----------------------------------------------------------------------------
+void fillRect(int x, int y, int width, int height, uint32_t color)
+{
+    const int x0 = std::max(x, 0), y0 = std::max(y, 0);
+    const int x1 = std::min(x + width, (int)g_fb_width);
+    const int y1 = std::min(y + height, (int)g_fb_height);
+    for (int j = y0; j < y1; j++)
+    {
+        uint32_t* row = (uint32_t*)g_frame_buffer.data() + j * g_fb_width;
+        std::fill(row + x0, row + std::max(x1, x0), color);
+    }
+}   // fillRect
+
+// ----------------------------------------------------------------------------
+/** Smooth gradients with some detail, which compress like a rendered scene.
+ */
+void drawBackground(unsigned width, unsigned height)
+{
+    g_background.resize((size_t)width * height * 4);
+    for (unsigned j = 0; j < height; j++)
+    {
+        uint8_t* p = g_background.data() + (size_t)j * width * 4;
+        for (unsigned i = 0; i < width; i++)
+        {
+            p[0] = (uint8_t)(i * 255 / width);
+            p[1] = (uint8_t)(j * 255 / height);
+            p[2] = (uint8_t)(((i / 16 + j / 16) % 2) * 64 + 96);
+            p[3] = 255;
+            p += 4;
+        }
+    }
+}   // drawBackground
+
+// ----------------------------------------------------------------------------
+void renderFrame(Content content, unsigned frame)
+{
+    const size_t pitch = (size_t)g_fb_width * 4;
+    switch (content)
+    {
+    case CT_STATIC:
+        if (frame == 0)
+            g_frame_buffer = g_background;
+        break;
+    case CT_SCROLLING:
+    {
+        // Pan the background horizontally by 8 pixels each frame
+        const size_t shift = (frame * 8 % g_fb_width) * 4;
+        for (unsigned j = 0; j < g_fb_height; j++)
+        {
+            const uint8_t* src = g_background.data() + j * pitch;
+            uint8_t* dst = g_frame_buffer.data() + j * pitch;
+            memcpy(dst, src + shift, pitch - shift);
+            memcpy(dst + pitch - shift, src, shift);
+        }
+        break;
+    }
+    case CT_NOISE:
+    {
+        uint64_t* p = (uint64_t*)g_frame_buffer.data();
+        for (size_t i = 0; i < g_frame_buffer.size() / 8; i++)
+            p[i] = nextRandom();
+        break;
+    }
+    case CT_GAME:
+    {
+        // Moving objects over the scene and a noisy HUD in a corner
+        memcpy(g_frame_buffer.data(), g_background.data(),
+            g_frame_buffer.size());
+        for (unsigned k = 0; k < 12; k++)
+        {
+            const int size = (int)(g_fb_height / 8 + k * 7);
+            const int x = (int)((k * 97 + frame * (k + 2) * 3) %
+                (g_fb_width + size)) - size;
+            const int y = (int)((k * 131 + frame * (k % 4 + 1) * 2) %
+                (g_fb_height + size)) - size;
+            fillRect(x, y, size, size, 0xFF000000u | (k * 0x1F3A5B));
+        }
+        for (unsigned j = 0; j < 64 && j < g_fb_height; j++)
+        {
+            uint32_t* row = (uint32_t*)g_frame_buffer.data() +
+                j * g_fb_width;
+            for (unsigned i = 0; i < 128 && i < g_fb_width; i++)
+                row[i] = (uint32_t)nextRandom() | 0xFF000000u;
+        }
+        break;
+    }
+    default:
+        break;
+    }
+}   // renderFrame
+
+// ----------------------------------------------------------------------------
+struct BenchResult
+{
+    VideoFormat m_format;
+    Content m_content;
+    Resolution m_resolution;
+    unsigned m_fps;
+    unsigned m_conversion_threads;
+    /* Percent of a static frame changed each frame instead of m_content,
+     * captured as a region if m_regions is true. */
+    unsigned m_damage;
+    bool m_regions;
+    uint64_t m_readback_bytes;
+    unsigned m_frames_rendered;
+    double m_seconds;
+    double m_overhead_mean, m_overhead_p99, m_overhead_max;
+    double m_stop_to_saved;
+    unsigned m_queue_depth_at_stop;
+    bool m_saved;
+    RecorderStats m_stats;
+};
+
+// ----------------------------------------------------------------------------
+/** The centered rectangle of the damage benchmark, with noise drawn in it
+ *  each frame. */
+CaptureRegion getDamageRegion(unsigned damage)
+{
+    const double side = sqrt(damage / 100.0);
+    CaptureRegion r;
+    r.m_width = std::max((unsigned)(g_fb_width * side), 1u);
+    r.m_height = std::max((unsigned)(g_fb_height * side), 1u);
+    r.m_x = (g_fb_width - r.m_width) / 2;
+    r.m_y = (g_fb_height - r.m_height) / 2;
+    return r;
+}   // getDamageRegion
+
+// ----------------------------------------------------------------------------
+void renderDamage(const CaptureRegion& r, unsigned frame)
+{
+    if (frame == 0)
+        g_frame_buffer = g_background;
+    for (unsigned j = r.m_y; j < r.m_y + r.m_height; j++)
+    {
+        uint32_t* row = (uint32_t*)g_frame_buffer.data() + j * g_fb_width;
+        for (unsigned i = r.m_x; i < r.m_x + r.m_width; i++)
+            row[i] = (uint32_t)nextRandom() | 0xFF000000u;
+    }
+}   // renderDamage
+
+// ----------------------------------------------------------------------------
+/** Record the content for some seconds, rendering at the frame rate. */
+bool runBenchmark(BenchResult* result, double seconds)
+{
+    const unsigned width = result->m_resolution.m_width;
+    const unsigned height = result->m_resolution.m_height;
+    RecorderConfig cfg;
+    memset(&cfg, 0, sizeof(RecorderConfig));
+    cfg.m_triple_buffering = 1;
+    cfg.m_record_audio = 0;
+    cfg.m_width = width;
+    cfg.m_height = height;
+    cfg.m_video_format = result->m_format;
+    cfg.m_audio_format = OGR_AF_VORBIS;
+    cfg.m_video_bitrate = width * height * result->m_fps / 10;
+    cfg.m_audio_bitrate = 112000;
+    cfg.m_record_fps = result->m_fps;
+    cfg.m_record_jpg_quality = 90;
+    cfg.m_output_width = g_output_width;
+    cfg.m_output_height = g_output_height;
+    cfg.m_scale_filter = g_scale_filter;
+    cfg.m_readback_format = OGR_RF_RGBA;
+    cfg.m_cpu_budget = g_cpu_budget;
+    cfg.m_parallel_gop = g_parallel_gop;
+    cfg.m_conversion_threads = result->m_conversion_threads;
+    if (ogrInitConfig(&cfg) == 0)
+        return false;
+
+    g_fb_width = width;
+    g_fb_height = height;
+    g_frame_buffer.assign((size_t)width * height * 4, 0);
+    drawBackground(width, height);
+    g_saved.store(false);
+    g_readback_bytes = 0;
+    const CaptureRegion damage = getDamageRegion(result->m_damage);
+
+    typedef std::chrono::steady_clock Clock;
+    const Clock::duration frame_time = std::chrono::duration_cast
+        <Clock::duration>(std::chrono::duration<double>(1.0 /
+        result->m_fps));
+    std::vector<double> overhead;
+    ogrPrepareCapture();
+    const Clock::time_point start = Clock::now();
+    Clock::time_point next_frame = start;
+    unsigned frame = 0;
+    while (Clock::now() - start < std::chrono::duration<double>(seconds))
+    {
+        if (result->m_damage > 0)
+            renderDamage(damage, frame++);
+        else
+            renderFrame(result->m_content, frame++);
+        const Clock::time_point capture_start = Clock::now();
+        if (result->m_regions)
+            ogrCaptureRegions(&damage, 1);
+        else
+            ogrCapture();
+        overhead.push_back(std::chrono::duration<double, std::milli>
+            (Clock::now() - capture_start).count());
+        next_frame += frame_time;
+        // Drop the behind schedule frames instead of catching up
+        if (next_frame < Clock::now())
+            next_frame = Clock::now();
+        std::this_thread::sleep_until(next_frame);
+    }
+    result->m_seconds = std::chrono::duration<double>(Clock::now() - start)
+        .count();
+    result->m_frames_rendered = frame;
+    result->m_readback_bytes = g_readback_bytes;
+
+    RecorderStats stats;
+    ogrGetStats(&stats);
+    result->m_queue_depth_at_stop = stats.m_queue_depth;
+    const Clock::time_point stop = Clock::now();
+    ogrStopCapture();
+    // Saved or failed callbacks are run before it stops capturing
+    while (ogrCapturing() != 0)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    result->m_stop_to_saved = std::chrono::duration<double, std::milli>
+        (Clock::now() - stop).count();
+    result->m_saved = g_saved.load();
+    ogrGetStats(&result->m_stats);
+    ogrDestroy();
+    if (result->m_saved)
+        remove(g_saved_file.c_str());
+
+    std::sort(overhead.begin(), overhead.end());
+    double total = 0.0;
+    for (double t : overhead)
+        total += t;
+    result->m_overhead_mean = overhead.empty() ? 0.0 :
+        total / overhead.size();
+    result->m_overhead_p99 = overhead.empty() ? 0.0 :
+        overhead[(overhead.size() - 1) * 99 / 100];
+    result->m_overhead_max = overhead.empty() ? 0.0 : overhead.back();
+    return true;
+}   // runBenchmark
+
+// ----------------------------------------------------------------------------
+struct CodecResult
+{
+    Content m_content;
+    Resolution m_resolution;
+    unsigned m_frames;
+    double m_encode_mbps, m_decode_mbps;
+    double m_ratio;
+    unsigned m_mismatches;
+};
+
+// ----------------------------------------------------------------------------
+/** Encode and decode rendered frames with the lossless codec on the calling
+ *  thread, each decoded frame must be the same as the rendered one. */
+void runCodecBenchmark(CodecResult* result)
+{
+    const unsigned width = result->m_resolution.m_width;
+    const unsigned height = result->m_resolution.m_height;
+    // Like 4 conversion threads, but encoded one after another
+    const unsigned stripes = 4;
+    const LosslessPixelLayout rgba = { 4, 0, 1, 2 };
+    const size_t pitch = (size_t)width * 4;
+    g_fb_width = width;
+    g_fb_height = height;
+    g_frame_buffer.assign(pitch * height, 0);
+    drawBackground(width, height);
+    std::vector<uint8_t> frame(Recorder::getLosslessMaxSize(width, height,
+        stripes));
+    std::vector<uint8_t> rgb((size_t)width * height * 3);
+    size_t stripe_sizes[stripes];
+
+    typedef std::chrono::steady_clock Clock;
+    Clock::duration encode_time = Clock::duration::zero();
+    Clock::duration decode_time = Clock::duration::zero();
+    uint64_t compressed = 0;
+    for (unsigned i = 0; i < result->m_frames; i++)
+    {
+        renderFrame(result->m_content, i);
+        // The frame buffer is bottom-up, encode it from its last row
+        const uint8_t* top = g_frame_buffer.data() + (height - 1) * pitch;
+        const Clock::time_point encode_start = Clock::now();
+        for (unsigned j = 0; j < stripes; j++)
+        {
+            stripe_sizes[j] = Recorder::losslessEncodeStripe(frame.data(),
+                top, -(ptrdiff_t)pitch, width, height, stripes, j, rgba);
+        }
+        const size_t size = Recorder::losslessFinishFrame(frame.data(),
+            width, height, stripes, stripe_sizes);
+        const Clock::time_point decode_start = Clock::now();
+        const bool decoded = Recorder::losslessDecodeFrame(frame.data(),
+            size, width, height, rgb.data());
+        const Clock::time_point decode_end = Clock::now();
+        encode_time += decode_start - encode_start;
+        decode_time += decode_end - decode_start;
+        compressed += size;
+
+        bool same = decoded;
+        for (unsigned y = 0; same && y < height; y++)
+        {
+            const uint8_t* src = top - (ptrdiff_t)(y * pitch);
+            const uint8_t* dst = rgb.data() + (size_t)y * width * 3;
+            for (unsigned x = 0; x < width; x++, src += 4, dst += 3)
+            {
+                if (src[0] != dst[0] || src[1] != dst[1] || src[2] != dst[2])
+                {
+                    same = false;
+                    break;
+                }
+            }
+        }
+        if (!same)
+            result->m_mismatches++;
+    }
+    // Megabytes of RGBA frames per second
+    const double bytes = (double)pitch * height * result->m_frames;
+    result->m_encode_mbps = bytes / 1e6 /
+        std::chrono::duration<double>(encode_time).count();
+    result->m_decode_mbps = bytes / 1e6 /
+        std::chrono::duration<double>(decode_time).count();
+    result->m_ratio = compressed == 0 ? 0.0 :
+        (double)width * height * 3 * result->m_frames / compressed;
+}   // runCodecBenchmark
+
+// ----------------------------------------------------------------------------
+struct GLCheck
+{
+    const char* m_name;
+    Resolution m_capture, m_output;
+    bool m_pbo, m_gpu_yuv;
+};
+
+// ----------------------------------------------------------------------------
+/** Objects and states set by the app before each capture, which must be the
+ *  same afterwards. */
+struct AppGLState
+{
+    unsigned m_fbo, m_rbo, m_program, m_texture, m_vertex_array;
+};
+
+// ----------------------------------------------------------------------------
+AppGLState setupAppGLState(unsigned width, unsigned height)
+{
+    AppGLState app;
+    mockGenRenderbuffers(1, &app.m_rbo);
+    mockBindRenderbuffer(E_GL_RENDERBUFFER, app.m_rbo);
+    mockRenderbufferStorage(E_GL_RENDERBUFFER, E_GL_RGBA8, width, height);
+    mockBindRenderbuffer(E_GL_RENDERBUFFER, 0);
+    mockGenFramebuffers(1, &app.m_fbo);
+    mockBindFramebuffer(E_GL_FRAMEBUFFER, app.m_fbo);
+    mockFramebufferRenderbuffer(E_GL_DRAW_FRAMEBUFFER, E_GL_COLOR_ATTACHMENT0,
+        E_GL_RENDERBUFFER, app.m_rbo);
+    app.m_program = mockCreateProgram();
+    mockUseProgram(app.m_program);
+    mockGenTextures(1, &app.m_texture);
+    mockBindTexture(E_GL_TEXTURE_2D, app.m_texture);
+    mockGenVertexArrays(1, &app.m_vertex_array);
+    mockBindVertexArray(app.m_vertex_array);
+    mockViewport(0, 0, width, height);
+    g_caps.clear();
+    mockEnable(E_GL_BLEND);
+    mockEnable(E_GL_DEPTH_TEST);
+    g_active_texture = E_GL_TEXTURE0 + 2;
+    return app;
+}   // setupAppGLState
+
+// ----------------------------------------------------------------------------
+void checkAppGLState(const AppGLState& app, unsigned width, unsigned height)
+{
+    checkGL(g_read_framebuffer == app.m_fbo &&
+        g_draw_framebuffer == app.m_fbo,
+        "frame buffer bindings not restored after a capture");
+    checkGL(g_current_program == app.m_program && g_bound_texture ==
+        app.m_texture && g_bound_vertex_array == app.m_vertex_array,
+        "program, texture or vertex array not restored after a capture");
+    checkGL(g_viewport[0] == 0 && g_viewport[1] == 0 &&
+        g_viewport[2] == (int)width && g_viewport[3] == (int)height,
+        "viewport not restored after a capture");
+    checkGL(g_caps[E_GL_BLEND] && g_caps[E_GL_DEPTH_TEST] &&
+        !g_caps[E_GL_CULL_FACE] && !g_caps[E_GL_SCISSOR_TEST] &&
+        !g_caps[E_GL_STENCIL_TEST], "capabilities not restored after a "
+        "capture");
+}   // checkAppGLState
+
+// ----------------------------------------------------------------------------
+void deleteAppGLState(const AppGLState& app)
+{
+    mockBindFramebuffer(E_GL_FRAMEBUFFER, 0);
+    mockDeleteFramebuffers(1, &app.m_fbo);
+    mockDeleteRenderbuffers(1, &app.m_rbo);
+    mockUseProgram(0);
+    mockDeleteProgram(app.m_program);
+    mockBindTexture(E_GL_TEXTURE_2D, 0);
+    mockDeleteTextures(1, &app.m_texture);
+    mockBindVertexArray(0);
+    mockDeleteVertexArrays(1, &app.m_vertex_array);
+}   // deleteAppGLState
+
+// ----------------------------------------------------------------------------
+/** Check the calls made for scaling on the GPU: every read back must come
+ *  from the frame buffer object of the output size after a blit of the whole
+ *  frame buffer of the app into it. */
+void checkGPUScale(const GLCheck& check, const AppGLState& app)
+{
+    const unsigned width = check.m_capture.m_width;
+    const unsigned height = check.m_capture.m_height;
+    const unsigned output_width = check.m_output.m_width;
+    const unsigned output_height = check.m_output.m_height;
+    // Pixel buffer objects only hold the scaled frame
+    if (check.m_pbo)
+    {
+        checkGL(g_buffer_sizes.size() == 3, "3 pixel buffer objects");
+        for (size_t size : g_buffer_sizes)
+        {
+            checkGL(size == (size_t)output_width * output_height * 4,
+                "pixel buffer object of the output size");
+        }
+    }
+    checkGL(!g_blit_calls.empty(), "no glBlitFramebuffer");
+    for (const BlitCall& b : g_blit_calls)
+    {
+        checkGL(b.m_src[0] == 0 && b.m_src[1] == 0 &&
+            b.m_src[2] == (int)width && b.m_src[3] == (int)height,
+            "glBlitFramebuffer source is the whole frame buffer");
+        checkGL(b.m_dst[0] == 0 && b.m_dst[1] == 0 &&
+            b.m_dst[2] == (int)output_width &&
+            b.m_dst[3] == (int)output_height,
+            "glBlitFramebuffer destination is the output size");
+        checkGL(b.m_mask == E_GL_COLOR_BUFFER_BIT && b.m_filter == E_GL_LINEAR,
+            "glBlitFramebuffer mask and filter");
+        checkGL(b.m_read_framebuffer == app.m_fbo &&
+            b.m_draw_framebuffer != 0 && b.m_draw_framebuffer != app.m_fbo,
+            "glBlitFramebuffer from the frame buffer of the app");
+    }
+    checkGL(g_shader_version.empty() && g_draw_calls.empty() &&
+        g_copy_tex_calls.empty(), "drawing without GPU YUV conversion");
+}   // checkGPUScale
+
+// ----------------------------------------------------------------------------
+/** Check the calls made for the YUV conversion on the GPU: the shader must be
+ *  linked from a vertex and a fragment shader, the whole frame buffer of the
+ *  app copied to the texture and drawn into the frame buffer object of the
+ *  packed planes with a clean state, which is read back without blit. */
+void checkGPUYUV(const GLCheck& check, const AppGLState& app)
+{
+    const unsigned width = check.m_capture.m_width;
+    const unsigned height = check.m_capture.m_height;
+    const unsigned output_width = check.m_output.m_width;
+    const unsigned output_height = check.m_output.m_height;
+    if (check.m_pbo)
+    {
+        checkGL(g_buffer_sizes.size() == 3, "3 pixel buffer objects");
+        for (size_t size : g_buffer_sizes)
+        {
+            checkGL(size == (size_t)output_width * output_height * 3 / 2,
+                "pixel buffer object of the YUV 4:2:0 size");
+        }
+    }
+    checkGL(g_shader_version == "#version 130\n",
+        "shaders not compiled for GLSL 1.30 first");
+    checkGL(g_blit_calls.empty(), "glBlitFramebuffer with GPU YUV");
+    checkGL(!g_draw_calls.empty() &&
+        g_draw_calls.size() == g_copy_tex_calls.size(),
+        "one glCopyTexSubImage2D for each glDrawArrays");
+    for (const CopyTexCall& c : g_copy_tex_calls)
+    {
+        checkGL(c.m_x == 0 && c.m_y == 0 && c.m_width == (int)width &&
+            c.m_height == (int)height && c.m_read_framebuffer == app.m_fbo,
+            "glCopyTexSubImage2D of the whole frame buffer of the app");
+        checkGL(c.m_texture != 0 && c.m_texture != app.m_texture,
+            "glCopyTexSubImage2D into the texture of the library");
+    }
+    const int packed_width = output_width / 4;
+    const int packed_height = output_height * 3 / 2;
+    for (const DrawCall& d : g_draw_calls)
+    {
+        checkGL(d.m_mode == E_GL_TRIANGLES && d.m_first == 0 &&
+            d.m_count == 3, "glDrawArrays of one triangle");
+        checkGL(d.m_draw_framebuffer != 0 &&
+            d.m_draw_framebuffer != app.m_fbo &&
+            d.m_target.m_width == (unsigned)packed_width &&
+            d.m_target.m_height == (unsigned)packed_height,
+            "glDrawArrays into the frame buffer object of the packed size");
+        checkGL(d.m_viewport[0] == 0 && d.m_viewport[1] == 0 &&
+            d.m_viewport[2] == packed_width &&
+            d.m_viewport[3] == packed_height,
+            "glDrawArrays viewport of the packed size");
+        checkGL(d.m_program != app.m_program && d.m_program_state.m_linked,
+            "glDrawArrays with the linked program");
+        const float* size = d.m_program_state.m_size;
+        checkGL(d.m_program_state.m_frame_unit == 2,
+            "u_frame is not the active texture unit");
+        checkGL(size[0] == (float)output_width &&
+            size[1] == (float)output_height &&
+            size[2] == 1.0f / output_width &&
+            size[3] == 1.0f / output_height, "u_size of the output");
+        checkGL(d.m_texture == g_copy_tex_calls[0].m_texture &&
+            d.m_vertex_array != 0 && d.m_vertex_array != app.m_vertex_array,
+            "glDrawArrays with the texture and vertex array of the library");
+        checkGL(!d.m_caps_enabled, "glDrawArrays with capabilities enabled");
+    }
+    for (const ReadPixelsCall& r : g_read_pixels_calls)
+    {
+        checkGL(r.m_x == 0 && r.m_y == 0 && r.m_width == packed_width &&
+            r.m_height == packed_height, "glReadPixels of the packed size");
+    }
+}   // checkGPUYUV
+
+// ----------------------------------------------------------------------------
+/** Record a few frames with the frame buffer, shader and draw functions,
+ *  check the calls made for scaling or YUV conversion on the GPU, that the
+ *  states of the app are restored after each capture and that all objects
+ *  are deleted by ogrDestroy. Returns the number of failed checks. */
+int runGLCheck(FILE* out, const GLCheck& check)
+{
+    g_check_failures = 0;
+    g_read_pixels_calls.clear();
+    g_blit_calls.clear();
+    g_buffer_sizes.clear();
+    g_copy_tex_calls.clear();
+    g_draw_calls.clear();
+    g_shader_version.clear();
+    const unsigned width = check.m_capture.m_width;
+    const unsigned height = check.m_capture.m_height;
+    const unsigned output_width = check.m_output.m_width;
+    const unsigned output_height = check.m_output.m_height;
+    RecorderConfig cfg = {};
+    cfg.m_triple_buffering = check.m_pbo ? 1 : 0;
+    cfg.m_width = width;
+    cfg.m_height = height;
+    cfg.m_video_format = OGR_VF_MJPEG;
+    cfg.m_audio_format = OGR_AF_VORBIS;
+    cfg.m_video_bitrate = 1000000;
+    cfg.m_audio_bitrate = 112000;
+    cfg.m_record_fps = 30;
+    cfg.m_record_jpg_quality = 90;
+    cfg.m_output_width = output_width;
+    cfg.m_output_height = output_height;
+    cfg.m_gpu_yuv = check.m_gpu_yuv ? 1 : 0;
+    checkGL(ogrInitConfig(&cfg) == 1, "ogrInitConfig");
+
+    g_fb_width = width;
+    g_fb_height = height;
+    g_frame_buffer.assign((size_t)width * height * 4, 0);
+    drawBackground(width, height);
+    g_saved.store(false);
+    const AppGLState app = setupAppGLState(width, height);
+    ogrPrepareCapture();
+    checkAppGLState(app, width, height);
+    for (unsigned i = 0; i < 24; i++)
+    {
+        renderFrame(CT_GAME, i);
+        if (i % 4 == 3)
+        {
+            const CaptureRegion r = { width / 8, height / 8, width / 4,
+                height / 4 };
+            ogrCaptureRegions(&r, 1);
+        }
+        else
+            ogrCapture();
+        checkAppGLState(app, width, height);
+        std::this_thread::sleep_for(std::chrono::milliseconds(35));
+    }
+    ogrStopCapture();
+    while (ogrCapturing() != 0)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    ogrDestroy();
+    checkGL(g_saved.load(), "recording not saved");
+    if (g_saved.load())
+        remove(g_saved_file.c_str());
+
+    if (check.m_gpu_yuv)
+        checkGPUYUV(check, app);
+    else
+        checkGPUScale(check, app);
+    unsigned full_readbacks = 0;
+    const unsigned readback_width = check.m_gpu_yuv ? output_width / 4 :
+        output_width;
+    const unsigned readback_height = check.m_gpu_yuv ?
+        output_height * 3 / 2 : output_height;
+    for (const ReadPixelsCall& r : g_read_pixels_calls)
+    {
+        checkGL(r.m_framebuffer != 0 && r.m_framebuffer != app.m_fbo,
+            "glReadPixels from the frame buffer of the app");
+        if (r.m_x == 0 && r.m_y == 0 && r.m_width == (int)readback_width &&
+            r.m_height == (int)readback_height)
+            full_readbacks++;
+    }
+    checkGL(full_readbacks > 0, "no glReadPixels of the whole frame");
+    deleteAppGLState(app);
+    checkGL(g_framebuffers.empty() && g_renderbuffers.empty() &&
+        g_buffers.empty() && g_shaders.empty() && g_programs.empty() &&
+        g_textures.empty() && g_vertex_arrays.empty(),
+        "opengl objects left after ogrDestroy");
+
+    fprintf(out, "{\"check\":\"%s\",\"capture\":\"%ux%u\","
+        "\"output\":\"%ux%u\",\"blits\":%u,\"draws\":%u,\"read_pixels\":%u,"
+        "\"full_readbacks\":%u,\"passed\":%s}", check.m_name, width, height,
+        output_width, output_height, (unsigned)g_blit_calls.size(),
+        (unsigned)g_draw_calls.size(), (unsigned)g_read_pixels_calls.size(),
+        full_readbacks, g_check_failures == 0 ? "true" : "false");
+    return g_check_failures;
+}   // runGLCheck
+
+// ----------------------------------------------------------------------------
+/** Read an EBML number at data[*pos], element IDs keep their length marker
+ *  and sizes with all bits set are unknown, returned as UINT64_MAX. */
+bool readEBMLNumber(const std::vector<uint8_t>& data, size_t* pos, bool id,
+                    uint64_t* value)
+{
+    if (*pos >= data.size())
+        return false;
+    const uint8_t first = data[*pos];
+    unsigned length = 1;
+    while (length <= 8 && (first & (0x80 >> (length - 1))) == 0)
+        length++;
+    if (length > 8 || *pos + length > data.size())
+        return false;
+    uint64_t v = id ? first : first & (0xff >> length);
+    for (unsigned i = 1; i < length; i++)
+        v = (v << 8) | data[*pos + i];
+    if (!id && v == (1ull << (7 * length)) - 1)
+        v = UINT64_MAX;
+    *pos += length;
+    *value = v;
+    return true;
+}   // readEBMLNumber
+
+// ----------------------------------------------------------------------------
+struct MKVBlock
+{
+    /* In milliseconds, the default timecode scale. */
+    int64_t m_timestamp;
+    std::vector<uint8_t> m_data;
+};
+
+// ----------------------------------------------------------------------------
+/** Read the blocks of a saved recording, without audio it only has the
+ *  video track. */
+bool readMKVBlocks(const std::string& name, std::vector<MKVBlock>* blocks)
+{
+    FILE* fp = fopen(name.c_str(), "rb");
+    if (fp == NULL)
+        return false;
+    std::vector<uint8_t> data;
+    uint8_t buf[65536];
+    size_t readed;
+    while ((readed = fread(buf, 1, sizeof(buf), fp)) > 0)
+        data.insert(data.end(), buf, buf + readed);
+    fclose(fp);
+
+    size_t pos = 0;
+    int64_t cluster_time = 0;
+    while (pos < data.size())
+    {
+        uint64_t id, size;
+        if (!readEBMLNumber(data, &pos, true, &id) ||
+            !readEBMLNumber(data, &pos, false, &size))
+            return false;
+        // Descend into the segment, its clusters and block groups
+        if (id == 0x18538067 || id == 0x1F43B675 || id == 0xA0)
+            continue;
+        if (size == UINT64_MAX || size > data.size() - pos)
+            return false;
+        if (id == 0xE7)
+        {
+            cluster_time = 0;
+            for (uint64_t i = 0; i < size; i++)
+                cluster_time = (cluster_time << 8) | data[pos + i];
+        }
+        else if (id == 0xA3 || id == 0xA1)
+        {
+            // Track number, timestamp relative to the cluster and flags
+            size_t p = pos;
+            uint64_t track;
+            if (!readEBMLNumber(data, &p, false, &track) ||
+                p + 3 > pos + size)
+                return false;
+            MKVBlock block;
+            block.m_timestamp = cluster_time +
+                (int16_t)((data[p] << 8) | data[p + 1]);
+            block.m_data.assign(data.begin() + p + 3,
+                data.begin() + pos + size);
+            blocks->push_back(block);
+        }
+        pos += size;
+    }
+    return true;
+}   // readMKVBlocks
+
+// ----------------------------------------------------------------------------
+struct UnchangedCheck
+{
+    const char* m_name;
+    /* Distinct frames captured before and after m_unchanged calls of
+     * ogrCaptureUnchanged. */
+    unsigned m_frames, m_unchanged, m_frames_after;
+};
+
+// ----------------------------------------------------------------------------
+/** Record distinct frames with pixel buffer objects, then unchanged ones and
+ *  maybe more distinct ones, and check in the saved lossless video that the
+ *  unchanged time extends the last frame captured before them, even when
+ *  recording stops during them. Returns the number of failed checks. */
+int runUnchangedCheck(FILE* out, const UnchangedCheck& check)
+{
+    g_check_failures = 0;
+    const unsigned width = 320;
+    const unsigned height = 240;
+    const unsigned fps = 30;
+    RecorderConfig cfg = {};
+    cfg.m_triple_buffering = 1;
+    cfg.m_width = width;
+    cfg.m_height = height;
+    cfg.m_video_format = OGR_VF_LOSSLESS;
+    cfg.m_audio_format = OGR_AF_VORBIS;
+    cfg.m_video_bitrate = 1000000;
+    cfg.m_audio_bitrate = 112000;
+    cfg.m_record_fps = fps;
+    cfg.m_record_jpg_quality = 90;
+    checkGL(ogrInitConfig(&cfg) == 1, "ogrInitConfig");
+
+    g_fb_width = width;
+    g_fb_height = height;
+    g_frame_buffer.assign((size_t)width * height * 4, 0);
+    g_saved.store(false);
+    // Longer than a frame, so no capture is skipped for the frame rate
+    const std::chrono::milliseconds interval(1400 / fps);
+    ogrPrepareCapture();
+    const unsigned frames = check.m_frames + check.m_frames_after;
+    for (unsigned i = 0; i < frames; i++)
+    {
+        if (i == check.m_frames)
+        {
+            for (unsigned j = 0; j < check.m_unchanged; j++)
+            {
+                ogrCaptureUnchanged();
+                std::this_thread::sleep_for(interval);
+            }
+        }
+        // Each image is a gray level which tells its index
+        std::fill(g_frame_buffer.begin(), g_frame_buffer.end(),
+            (uint8_t)((i + 1) * 16));
+        ogrCapture();
+        std::this_thread::sleep_for(interval);
+    }
+    if (check.m_frames_after == 0)
+    {
+        for (unsigned j = 0; j < check.m_unchanged; j++)
+        {
+            ogrCaptureUnchanged();
+            std::this_thread::sleep_for(interval);
+        }
+    }
+    ogrStopCapture();
+    while (ogrCapturing() != 0)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    ogrDestroy();
+    checkGL(g_saved.load(), "recording not saved");
+
+    std::vector<MKVBlock> blocks;
+    if (g_saved.load())
+    {
+        checkGL(readMKVBlocks(g_saved_file, &blocks),
+            "invalid saved recording");
+        remove(g_saved_file.c_str());
+    }
+    // Image index and first recorded frame of each block
+    std::vector<int> images;
+    std::vector<int64_t> starts;
+    std::vector<uint8_t> rgb((size_t)width * height * 3);
+    for (const MKVBlock& block : blocks)
+    {
+        const bool decoded = Recorder::losslessDecodeFrame(
+            block.m_data.data(), block.m_data.size(), width, height,
+            rgb.data());
+        checkGL(decoded, "lossless frame not decoded");
+        images.push_back(decoded ? rgb[0] / 16 - 1 : -1);
+        starts.push_back((block.m_timestamp * fps + 500) / 1000);
+    }
+    checkGL(!images.empty(), "no frame recorded");
+    const int last_image = (int)check.m_frames - 1;
+    int64_t paused_frames = -1;
+    for (size_t i = 0; i < images.size(); i++)
+    {
+        if (i + 1 < images.size())
+        {
+            checkGL(images[i] < images[i + 1], "frames out of order");
+            const int64_t duration = starts[i + 1] - starts[i];
+            if (images[i] == last_image)
+                paused_frames = duration;
+            else
+            {
+                checkGL(duration <= 3,
+                    "unchanged frames extend an older frame");
+            }
+        }
+    }
+    if (check.m_frames_after > 0)
+    {
+        checkGL(paused_frames >= check.m_unchanged,
+            "unchanged frames do not extend the last captured frame");
+    }
+    else
+    {
+        checkGL(!images.empty() && images.back() == last_image,
+            "last captured frame not recorded when stopping");
+    }
+
+    fprintf(out, "{\"check\":\"%s\",\"frames\":%u,\"unchanged\":%u,"
+        "\"frames_after\":%u,\"blocks\":%u,\"last_image\":%d,"
+        "\"paused_frames\":%lld,\"passed\":%s}", check.m_name,
+        check.m_frames, check.m_unchanged, check.m_frames_after,
+        (unsigned)images.size(), images.empty() ? -1 : images.back(),
+        (long long)paused_frames, g_check_failures == 0 ? "true" : "false");
+    return g_check_failures;
+}   // runUnchangedCheck
+
+// ----------------------------------------------------------------------------
+/** Run the checks of --check-gl, returns the number of failed ones. */
+int runGLChecks(FILE* out)
+{
+    const GLCheck checks[] =
+    {
+        { "gpu_scale_pbo", { 1280, 720 }, { 640, 360 }, true, false },
+        { "gpu_scale_no_pbo", { 1280, 720 }, { 640, 360 }, false, false },
+        { "gpu_scale_odd", { 1920, 1080 }, { 1000, 562 }, true, false },
+        { "gpu_yuv_pbo", { 1280, 720 }, { 1280, 720 }, true, true },
+        { "gpu_yuv_no_pbo", { 1280, 720 }, { 1280, 720 }, false, true },
+        { "gpu_yuv_scale", { 1920, 1080 }, { 640, 360 }, true, true }
+    };
+    const UnchangedCheck unchanged_checks[] =
+    {
+        { "unchanged_then_capture", 8, 15, 6 },
+        { "unchanged_then_stop", 8, 15, 0 }
+    };
+    int failed = 0;
+    fprintf(out, "{\"benchmark\":\"ogr_bench\",\"unchanged_checks\":[");
+    for (const UnchangedCheck& check : unchanged_checks)
+    {
+        fprintf(stderr, "check %s...\n", check.m_name);
+        fprintf(out, &check == unchanged_checks ? "\n" : ",\n");
+        if (runUnchangedCheck(out, check) != 0)
+            failed++;
+    }
+    ogrRegFBOFunctions(mockGenFramebuffers, mockBindFramebuffer,
+        mockDeleteFramebuffers, mockGenRenderbuffers, mockBindRenderbuffer,
+        mockRenderbufferStorage, mockFramebufferRenderbuffer,
+        mockDeleteRenderbuffers, mockBlitFramebuffer);
+    ogrRegShaderFunctions(mockCreateShader, mockShaderSource,
+        mockCompileShader, mockCreateProgram, mockAttachShader,
+        mockLinkProgram, mockGetProgramiv, mockUseProgram,
+        mockGetUniformLocation, mockUniform1i, mockUniform4f,
+        mockDeleteShader, mockDeleteProgram);
+    ogrRegDrawFunctions(mockGenTextures, mockBindTexture, mockTexImage2D,
+        mockTexParameteri, mockCopyTexSubImage2D, mockDeleteTextures,
+        mockGenVertexArrays, mockBindVertexArray, mockDeleteVertexArrays,
+        mockViewport, mockDrawArrays, mockGetIntegerv, mockIsEnabled,
+        mockEnable, mockDisable);
+    g_check_gl = true;
+    fprintf(out, "\n],\"gl_checks\":[");
+    for (const GLCheck& check : checks)
+    {
+        fprintf(stderr, "check %s...\n", check.m_name);
+        fprintf(out, &check == checks ? "\n" : ",\n");
+        if (runGLCheck(out, check) != 0)
+            failed++;
+    }
+    fprintf(out, "\n]}\n");
+    g_check_gl = false;
+    return failed;
+}   // runGLChecks
+
+// ----------------------------------------------------------------------------
+void writeLatency(FILE* out, const char* name, const LatencyStats& ls)
+{
+    // Microseconds from the library to milliseconds like the rest
+    fprintf(out, "\"%s_ms\":{\"mean\":%.3f,\"p50\":%.3f,\"p99\":%.3f,"
+        "\"max\":%.3f}", name, ls.m_mean / 1000.0, ls.m_p50 / 1000.0,
+        ls.m_p99 / 1000.0, ls.m_max / 1000.0);
+}   // writeLatency
+
+// ----------------------------------------------------------------------------
+void writeResult(FILE* out, const BenchResult& r)
+{
+    const RecorderStats& s = r.m_stats;
+    const char* content = r.m_damage == 0 ? g_content_names[r.m_content] :
+        r.m_regions ? "damage_regions" : "damage_full";
+    fprintf(out, "{\"format\":\"%s\",\"content\":\"%s\",\"width\":%u,"
+        "\"height\":%u,\"fps\":%u,\"conversion_threads\":%u,"
+        "\"seconds\":%.3f,\"frames_rendered\":%u,\"saved\":%s,",
+        g_format_names[r.m_format], content, r.m_resolution.m_width,
+        r.m_resolution.m_height, r.m_fps, r.m_conversion_threads, r.m_seconds,
+        r.m_frames_rendered, r.m_saved ? "true" : "false");
+    fprintf(out, "\"captured_fps\":%.2f,\"recorded_fps\":%.2f,",
+        s.m_frames_captured / r.m_seconds,
+        (s.m_frames_captured + s.m_frames_duplicated) / r.m_seconds);
+    fprintf(out, "\"render_overhead_ms\":{\"mean\":%.3f,\"p99\":%.3f,"
+        "\"max\":%.3f},\"frame_budget_percent\":%.2f,", r.m_overhead_mean,
+        r.m_overhead_p99, r.m_overhead_max,
+        r.m_overhead_mean * r.m_fps / 10.0);
+    fprintf(out, "\"encoder_backlog\":{\"at_stop\":%u,\"high_water\":%u},"
+        "\"frames_captured\":%llu,\"frames_duplicated\":%llu,"
+        "\"frames_dropped\":%llu,\"frames_skipped\":%llu,",
+        r.m_queue_depth_at_stop, s.m_queue_high_water, s.m_frames_captured,
+        s.m_frames_duplicated, s.m_frames_dropped, s.m_frames_skipped);
+    if (r.m_damage > 0)
+    {
+        fprintf(out, "\"damage_percent\":%u,", r.m_damage);
+        writeLatency(out, "readback", s.m_readback);
+        fprintf(out, ",");
+    }
+    fprintf(out, "\"readback_bytes_per_frame\":%.0f,",
+        r.m_frames_rendered == 0 ? 0.0 :
+        (double)r.m_readback_bytes / r.m_frames_rendered);
+    writeLatency(out, "conversion", s.m_conversion);
+    fprintf(out, ",");
+    writeLatency(out, "scale", s.m_scale);
+    fprintf(out, ",");
+    writeLatency(out, "encode", s.m_encode);
+    fprintf(out, ",\"throttled_ms\":%.3f,\"encoder_adjustments\":%llu,"
+        "\"stop_to_saved_ms\":%.3f,\"bytes_written\":%llu}",
+        s.m_throttled_time / 1000.0, s.m_encoder_adjustments,
+        r.m_stop_to_saved, s.m_bytes_written);
+}   // writeResult
+
+// ----------------------------------------------------------------------------
+void writeCodecResult(FILE* out, const CodecResult& r)
+{
+    fprintf(out, "{\"content\":\"%s\",\"width\":%u,\"height\":%u,"
+        "\"frames\":%u,\"encode_mb_per_s\":%.1f,\"decode_mb_per_s\":%.1f,"
+        "\"compression_ratio\":%.2f,\"round_trip_mismatches\":%u}",
+        g_content_names[r.m_content], r.m_resolution.m_width,
+        r.m_resolution.m_height, r.m_frames, r.m_encode_mbps,
+        r.m_decode_mbps, r.m_ratio, r.m_mismatches);
+}   // writeCodecResult
+
+// ----------------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+    double seconds = 3.0;
+    bool quick = false;
+    bool check_gl = false;
+    bool thread_sweep = false;
+    const char* output = NULL;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strncmp(argv[i], "--seconds=", 10) == 0)
+            seconds = atof(argv[i] + 10);
+        else if (strncmp(argv[i], "--output=", 9) == 0)
+            output = argv[i] + 9;
+        else if (strncmp(argv[i], "--cpu-budget=", 13) == 0)
+            g_cpu_budget = (unsigned)atoi(argv[i] + 13);
+        else if (strncmp(argv[i], "--parallel-gop=", 15) == 0)
+            g_parallel_gop = (unsigned)atoi(argv[i] + 15);
+        else if (strncmp(argv[i], "--conversion-threads=", 21) == 0)
+            g_conversion_threads = (unsigned)atoi(argv[i] + 21);
+        else if (strcmp(argv[i], "--thread-sweep") == 0)
+            thread_sweep = true;
+        else if (strncmp(argv[i], "--output-width=", 15) == 0)
+            g_output_width = (unsigned)atoi(argv[i] + 15);
+        else if (strncmp(argv[i], "--output-height=", 16) == 0)
+            g_output_height = (unsigned)atoi(argv[i] + 16);
+        else if (strcmp(argv[i], "--scale-filter=area") == 0)
+            g_scale_filter = OGR_SF_AREA;
+        else if (strcmp(argv[i], "--scale-filter=bilinear") == 0)
+            g_scale_filter = OGR_SF_BILINEAR;
+        else if (strcmp(argv[i], "--quick") == 0)
+            quick = true;
+        else if (strcmp(argv[i], "--check-gl") == 0)
+            check_gl = true;
+        else
+        {
+            fprintf(stderr, "Usage: %s [--seconds=N] [--output=FILE] "
+                "[--cpu-budget=PERCENT] [--parallel-gop=FRAMES] "
+                "[--conversion-threads=N] [--thread-sweep] "
+                "[--output-width=N] [--output-height=N] "
+                "[--scale-filter=bilinear|area] [--quick] [--check-gl]\n"
+                "  --quick only records 1280x720 at 60 fps for 1 second.\n"
+                "  --thread-sweep records with 1 to the number of hardware"
+                " threads\n  for conversion.\n"
+                "  --check-gl checks the opengl calls instead.\n",
+                argv[0]);
+            return 1;
+        }
+    }
+    if (quick)
+        seconds = std::min(seconds, 1.0);
+    if (seconds <= 0.0)
+        seconds = 3.0;
+    FILE* out = stdout;
+    if (output != NULL)
+    {
+        out = fopen(output, "wb");
+        if (out == NULL)
+        {
+            fprintf(stderr, "ogr_bench: cannot open %s\n", output);
+            return 1;
+        }
+    }
+
+    ogrRegReadPixelsFunction(mockReadPixels);
+    ogrRegPBOFunctions(mockGenBuffers, mockBindBuffer, mockBufferData,
+        mockDeleteBuffers, mockMapBuffer, mockUnmapBuffer);
+    ogrRegStringCallback(OGR_CBT_SAVED_RECORDING, onSaved, NULL);
+    ogrRegStringCallback(OGR_CBT_ERROR_RECORDING, onError, NULL);
+    ogrSetSavedName("ogr_bench_recording");
+    if (check_gl)
+    {
+        const int failed = runGLChecks(out);
+        if (out != stdout)
+            fclose(out);
+        return failed == 0 ? 0 : 2;
+    }
+
+    fprintf(out, "{\"benchmark\":\"ogr_bench\",\"seconds\":%.3f,"
+        "\"cpu_budget\":%u,\"parallel_gop\":%u,\"conversion_threads\":%u,"
+        "\"output_width\":%u,\"output_height\":%u,\"scale_filter\":\"%s\","
+        "\"hardware_threads\":%u,\"results\":[", seconds, g_cpu_budget,
+        g_parallel_gop, g_conversion_threads, g_output_width, g_output_height,
+        g_filter_names[g_scale_filter], std::thread::hardware_concurrency());
+    bool first = true;
+    int failed = 0;
+    for (int f = 0; f < OGR_VF_COUNT; f++)
+    {
+        if (ogrCheckVideoEncoder((VideoFormat)f) == 0)
+            continue;
+        for (const Resolution& res : g_resolutions)
+        {
+            if (quick && res.m_width != 1280)
+                continue;
+            if (res.m_width < g_output_width || res.m_height < g_output_height)
+                continue;
+            for (unsigned fps : g_frame_rates)
+            {
+                if (quick && fps != 60)
+                    continue;
+                for (int c = 0; c < CT_COUNT; c++)
+                {
+                    BenchResult r;
+                    memset(&r, 0, sizeof(BenchResult));
+                    r.m_format = (VideoFormat)f;
+                    r.m_content = (Content)c;
+                    r.m_resolution = res;
+                    r.m_fps = fps;
+                    r.m_conversion_threads = g_conversion_threads;
+                    fprintf(stderr, "%s %ux%u@%u %s...\n", g_format_names[f],
+                        res.m_width, res.m_height, fps, g_content_names[c]);
+                    if (!runBenchmark(&r, seconds))
+                    {
+                        failed++;
+                        continue;
+                    }
+                    if (!r.m_saved)
+                        failed++;
+                    fprintf(out, first ? "\n" : ",\n");
+                    writeResult(out, r);
+                    first = false;
+                }
+            }
+        }
+    }
+    fprintf(out, "\n],\"damage\":[");
+    first = true;
+    const Resolution damage_res = quick ? g_resolutions[1] : g_resolutions[2];
+    for (int f = 0; f < OGR_VF_COUNT; f++)
+    {
+        if (ogrCheckVideoEncoder((VideoFormat)f) == 0 ||
+            damage_res.m_width < g_output_width ||
+            damage_res.m_height < g_output_height)
+            continue;
+        for (unsigned damage : g_damage_ratios)
+        {
+            // The same frames captured as regions and as the whole frame
+            BenchResult r[2];
+            bool ok = true;
+            for (int i = 0; i < 2 && ok; i++)
+            {
+                memset(&r[i], 0, sizeof(BenchResult));
+                r[i].m_format = (VideoFormat)f;
+                r[i].m_resolution = damage_res;
+                r[i].m_fps = 60;
+                r[i].m_conversion_threads = g_conversion_threads;
+                r[i].m_damage = damage;
+                r[i].m_regions = i == 0;
+                fprintf(stderr, "%s %ux%u@60 damage %u%% %s...\n",
+                    g_format_names[f], damage_res.m_width,
+                    damage_res.m_height, damage, i == 0 ? "regions" :
+                    "full");
+                ok = runBenchmark(&r[i], seconds) && r[i].m_saved;
+            }
+            if (!ok)
+            {
+                failed++;
+                continue;
+            }
+            const double readback[2] =
+            {
+                (double)r[0].m_readback_bytes / r[0].m_frames_rendered,
+                (double)r[1].m_readback_bytes / r[1].m_frames_rendered
+            };
+            const double conversion[2] =
+            {
+                r[0].m_stats.m_conversion.m_mean,
+                r[1].m_stats.m_conversion.m_mean
+            };
+            fprintf(out, "%s{\"format\":\"%s\",\"damage_percent\":%u,"
+                "\"readback_saved_percent\":%.1f,"
+                "\"conversion_saved_percent\":%.1f,\"regions\":",
+                first ? "\n" : ",\n", g_format_names[f], damage,
+                readback[1] == 0.0 ? 0.0 :
+                100.0 * (1.0 - readback[0] / readback[1]),
+                conversion[1] == 0.0 ? 0.0 :
+                100.0 * (1.0 - conversion[0] / conversion[1]));
+            writeResult(out, r[0]);
+            fprintf(out, ",\"full\":");
+            writeResult(out, r[1]);
+            fprintf(out, "}");
+            first = false;
+        }
+    }
+    fprintf(out, "\n],\"thread_sweep\":[");
+    first = true;
+    // The formats which split the conversion of each frame into stripes
+    const unsigned max_threads = !thread_sweep ? 0 :
+        std::min(64u, std::max(1u, std::thread::hardware_concurrency()));
+    for (int f = 0; f < OGR_VF_COUNT; f++)
+    {
+        if ((f != OGR_VF_MJPEG && f != OGR_VF_LOSSLESS) ||
+            ogrCheckVideoEncoder((VideoFormat)f) == 0 ||
+            damage_res.m_width < g_output_width ||
+            damage_res.m_height < g_output_height)
+            continue;
+        double single_thread = 0.0;
+        for (unsigned threads = 1; threads <= max_threads; threads++)
+        {
+            BenchResult r;
+            memset(&r, 0, sizeof(BenchResult));
+            r.m_format = (VideoFormat)f;
+            r.m_content = CT_GAME;
+            r.m_resolution = damage_res;
+            r.m_fps = 60;
+            r.m_conversion_threads = threads;
+            fprintf(stderr, "%s %ux%u@60 %u conversion threads...\n",
+                g_format_names[f], damage_res.m_width, damage_res.m_height,
+                threads);
+            if (!runBenchmark(&r, seconds) || !r.m_saved)
+            {
+                failed++;
+                continue;
+            }
+            const double conversion = r.m_stats.m_conversion.m_mean;
+            if (threads == 1)
+                single_thread = conversion;
+            fprintf(out, "%s{\"format\":\"%s\",\"conversion_threads\":%u,"
+                "\"conversion_speedup\":%.2f,\"result\":", first ? "\n" :
+                ",\n", g_format_names[f], threads, conversion == 0.0 ? 0.0 :
+                single_thread / conversion);
+            writeResult(out, r);
+            fprintf(out, "}");
+            first = false;
+        }
+    }
+    fprintf(out, "\n],\"lossless_codec\":[");
+    first = true;
+    for (const Resolution& res : g_resolutions)
+    {
+        if (quick && res.m_width != 1280)
+            continue;
+        for (int c = 0; c < CT_COUNT; c++)
+        {
+            CodecResult r;
+            memset(&r, 0, sizeof(CodecResult));
+            r.m_content = (Content)c;
+            r.m_resolution = res;
+            r.m_frames = quick ? 10 : 60;
+            fprintf(stderr, "lossless codec %ux%u %s...\n", res.m_width,
+                res.m_height, g_content_names[c]);
+            runCodecBenchmark(&r);
+            if (r.m_mismatches > 0)
+                failed++;
+            fprintf(out, first ? "\n" : ",\n");
+            writeCodecResult(out, r);
+            first = false;
+        }
+    }
+    fprintf(out, "\n]}\n");
+    if (out != stdout)
+        fclose(out);
+    return failed == 0 ? 0 : 2;
+}   // main
@@ -0,0 +1,129 @@
+/* Copyright (c) 2017, libopenglrecorder contributors
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+
+#include "core/buffer_arena.hpp"
+#include "core/recorder_private.hpp"
+
+#include <cstring>
+
+#if defined(_WIN32)
+#  define WIN32_LEAN_AND_MEAN
+#  include <windows.h>
+#else
+#  include <sys/mman.h>
+#endif
+
+// Size of a huge page on x86 and most arm64 systems
+const size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+// ----------------------------------------------------------------------------
+BufferArena::BufferArena(bool huge_pages, bool lock_memory)
+{
+    m_huge_pages = huge_pages;
+    m_lock_memory = lock_memory;
+    memset(m_buffers, 0, sizeof(m_buffers));
+}   // BufferArena
+
+// ----------------------------------------------------------------------------
+BufferArena::~BufferArena()
+{
+    for (unsigned i = 0; i < BT_COUNT; i++)
+        free(&m_buffers[i]);
+}   // ~BufferArena
+
+// ----------------------------------------------------------------------------
+uint8_t* BufferArena::get(BufferType type, size_t size)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Buffer* b = &m_buffers[type];
+    if (b->m_size < size)
+    {
+        free(b);
+        allocate(b, size);
+    }
+    return b->m_data;
+}   // get
+
+// ----------------------------------------------------------------------------
+void BufferArena::allocate(Buffer* b, size_t size)
+{
+    // Page aligned memory from the system is always 64 bytes aligned
+#if defined(_WIN32)
+    b->m_mapped_size = size;
+    b->m_data = (uint8_t*)VirtualAlloc(NULL, size, MEM_COMMIT | MEM_RESERVE,
+        PAGE_READWRITE);
+#else
+    void* ptr = MAP_FAILED;
+    b->m_mapped_size = size;
+#ifdef MAP_HUGETLB
+    if (m_huge_pages)
+    {
+        // Reserved huge pages first, it fails if none are configured
+        const size_t huge_size = (size + HUGE_PAGE_SIZE - 1) &
+            ~(HUGE_PAGE_SIZE - 1);
+        ptr = mmap(NULL, huge_size, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (ptr != MAP_FAILED)
+            b->m_mapped_size = huge_size;
+    }
+#endif
+    if (ptr == MAP_FAILED)
+    {
+        ptr = mmap(NULL, size, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+#ifdef MADV_HUGEPAGE
+        // Otherwise ask for transparent huge pages
+        if (ptr != MAP_FAILED && m_huge_pages)
+            madvise(ptr, size, MADV_HUGEPAGE);
+#endif
+    }
+    b->m_data = ptr == MAP_FAILED ? NULL : (uint8_t*)ptr;
+#endif
+    if (b->m_data == NULL)
+    {
+        runCallback(OGR_CBT_ERROR_RECORDING, "Failed to allocate buffer.\n");
+        b->m_size = 0;
+        b->m_mapped_size = 0;
+        return;
+    }
+    b->m_size = size;
+    // Fault in every page now instead of inside the pipeline
+    memset(b->m_data, 0, size);
+    b->m_locked = false;
+    if (!m_lock_memory)
+        return;
+#if defined(_WIN32)
+    b->m_locked = VirtualLock(b->m_data, size) != 0;
+#else
+    b->m_locked = mlock(b->m_data, size) == 0;
+#endif
+    if (!b->m_locked)
+    {
+        runCallback(OGR_CBT_ERROR_RECORDING, "Failed to lock buffer in"
+            " memory.\n");
+    }
+}   // allocate
+
+// ----------------------------------------------------------------------------
+void BufferArena::free(Buffer* b)
+{
+    if (b->m_data == NULL)
+        return;
+#if defined(_WIN32)
+    if (b->m_locked)
+        VirtualUnlock(b->m_data, b->m_size);
+    VirtualFree(b->m_data, 0, MEM_RELEASE);
+#else
+    if (b->m_locked)
+        munlock(b->m_data, b->m_size);
+    munmap(b->m_data, b->m_mapped_size);
+#endif
+    b->m_data = NULL;
+    b->m_size = 0;
+    b->m_mapped_size = 0;
+    b->m_locked = false;
+}   // free
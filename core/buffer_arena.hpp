@@ -0,0 +1,66 @@
+/* Copyright (c) 2017, libopenglrecorder contributors
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+
+#ifndef HEADER_BUFFER_ARENA_HPP
+#define HEADER_BUFFER_ARENA_HPP
+
+#include <cstddef>
+#include <mutex>
+#include <stdint.h>
+
+/** Owner of the large buffers of the recording pipeline, one for each
+ *  \ref BufferType. They are 64 bytes aligned, optionally backed by huge
+ *  pages and locked in memory, and kept for later recordings, so after the
+ *  first recording no page fault happens when a recording starts.
+ */
+class BufferArena
+{
+public:
+    enum BufferType
+    {
+        BT_FRAME = 0,
+        BT_STRIPE_YUV,
+        BT_ENCODER_YUV,
+        BT_MUXER,
+        BT_COUNT
+    };
+
+private:
+    struct Buffer
+    {
+        uint8_t* m_data;
+        size_t m_size;
+        size_t m_mapped_size;
+        bool m_locked;
+    };
+
+    Buffer m_buffers[BT_COUNT];
+
+    bool m_huge_pages, m_lock_memory;
+
+    std::mutex m_mutex;
+
+    // ------------------------------------------------------------------------
+    void allocate(Buffer* b, size_t size);
+    // ------------------------------------------------------------------------
+    void free(Buffer* b);
+
+public:
+    // ------------------------------------------------------------------------
+    BufferArena(bool huge_pages, bool lock_memory);
+    // ------------------------------------------------------------------------
+    ~BufferArena();
+    // ------------------------------------------------------------------------
+    /** Return the buffer of type with at least size bytes, it's allocated
+     *  and pre-faulted with zeros only if the current one is smaller, so the
+     *  content is kept otherwise. Each type must be used by one thread at a
+     *  time. */
+    uint8_t* get(BufferType type, size_t size);
+
+};
+
+#endif
@@ -9,67 +9,251 @@
 
 #include "audio/pulseaudio_recorder.hpp"
 #include "audio/wasapi_recorder.hpp"
+#include "core/buffer_arena.hpp"
+#include "core/cpu_governor.hpp"
+#include "core/frame_scaler.hpp"
+#include "core/gl_constants.hpp"
+#include "core/gpu_yuv_converter.hpp"
 #include "core/mkv_writer.hpp"
+#include "core/pipeline_stats.hpp"
 #include "core/recorder_private.hpp"
-#include "video/mjpeg_writer.hpp"
-#include "video/openh264_encoder.hpp"
+#include "core/trace_recorder.hpp"
+#include "core/worker_pool.hpp"
 #include "video/vpx_encoder.hpp"
 
-const uint32_t E_GL_PIXEL_PACK_BUFFER = 0x88EB;
-const uint32_t E_GL_STREAM_READ = 0x88E1;
-const uint32_t E_GL_READ_ONLY = 0x88B8;
-const uint32_t E_GL_RGBA = 0x1908;
-const uint32_t E_GL_UNSIGNED_BYTE = 0x1401;
-const uint32_t E_GL_MAP_READ_BIT = 0x0001;
+#include <algorithm>
+#include <functional>
+#include <thread>
+#include <sys/stat.h>
+
+struct ReadbackFormatInfo
+{
+    uint32_t m_gl_format;
+    uint32_t m_gl_type;
+    int m_tj_format;
+    LosslessPixelLayout m_pixel_layout;
+};
+
+// Indexed by ReadbackFormat, the turbojpeg format and the lossless layout
+// match the byte order in memory so no swizzle is needed anywhere
+const ReadbackFormatInfo g_readback_formats[OGR_RF_COUNT] =
+{
+    { E_GL_RGBA, E_GL_UNSIGNED_BYTE, TJPF_RGBX, { 4, 0, 1, 2 } },
+    { E_GL_BGRA, E_GL_UNSIGNED_BYTE, TJPF_BGRX, { 4, 2, 1, 0 } },
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    { E_GL_BGRA, E_GL_UNSIGNED_INT_8_8_8_8_REV, TJPF_XRGB, { 4, 1, 2, 3 } },
+#else
+    { E_GL_BGRA, E_GL_UNSIGNED_INT_8_8_8_8_REV, TJPF_BGRX, { 4, 2, 1, 0 } },
+#endif
+    { E_GL_RGB, E_GL_UNSIGNED_BYTE, TJPF_RGB, { 3, 0, 1, 2 } },
+    { E_GL_BGR, E_GL_UNSIGNED_BYTE, TJPF_BGR, { 3, 2, 1, 0 } }
+};
+
+// ----------------------------------------------------------------------------
+static uint64_t getFileSize(const std::string& name)
+{
+    struct stat st;
+    if (stat(name.c_str(), &st) != 0)
+        return 0;
+    return (uint64_t)st.st_size;
+}   // getFileSize
 
 // ----------------------------------------------------------------------------
 CaptureLibrary::CaptureLibrary(RecorderConfig* rc)
 {
     m_recorder_cfg = rc;
     m_destroy = false;
+    m_destroying.store(false);
     m_capturing = false;
     m_sound_stop.store(true);
     m_display_progress.store(false);
+    m_draining.store(false);
+    m_cancelled.store(false);
     m_compress_handle = tjInitCompress();
-    m_decompress_handle = tjInitDecompress();
     m_audio_data = NULL;
+    m_yuv_planes = NULL;
+    m_arena.reset(new BufferArena(m_recorder_cfg->m_huge_pages > 0,
+        m_recorder_cfg->m_lock_memory > 0));
+    // The RecorderConfig is the first output, the profiles only change the
+    // video of theirs
+    m_outputs.emplace_back(new VideoOutput(this, *m_recorder_cfg, "", true));
+    for (const OutputProfileEntry& entry : getOutputProfiles())
+    {
+        RecorderConfig output_cfg = *m_recorder_cfg;
+        output_cfg.m_video_format = entry.m_profile.m_video_format;
+        output_cfg.m_output_width = entry.m_profile.m_width;
+        output_cfg.m_output_height = entry.m_profile.m_height;
+        if (entry.m_profile.m_video_bitrate != 0)
+            output_cfg.m_video_bitrate = entry.m_profile.m_video_bitrate;
+        output_cfg.m_deferred_encoding = 0;
+        m_outputs.emplace_back(new VideoOutput(this, output_cfg,
+            entry.m_name_suffix, false));
+    }
+    m_jpg_frames = m_lossless_frames = false;
+    for (auto& output : m_outputs)
+    {
+        if (output->isLossless())
+            m_lossless_frames = true;
+        else
+            m_jpg_frames = true;
+    }
+    // The lossless encoder needs the RGB pixels as read back
+    if (m_recorder_cfg->m_gpu_yuv > 0 && !m_lossless_frames)
+        initGPUYUV();
+    m_gpu_scale = !m_yuv_converter && ogrBlitFramebuffer != NULL &&
+        (m_recorder_cfg->m_output_width != m_recorder_cfg->m_width ||
+        m_recorder_cfg->m_output_height != m_recorder_cfg->m_height);
+    // The packed YUV planes are always drawn as RGBA
+    const ReadbackFormatInfo& format = g_readback_formats[m_yuv_converter ?
+        OGR_RF_RGBA : m_recorder_cfg->m_readback_format];
+    m_gl_format = format.m_gl_format;
+    m_gl_type = format.m_gl_type;
+    m_tj_format = format.m_tj_format;
+    m_pixel_layout = format.m_pixel_layout;
+    m_bpp = m_pixel_layout.m_bpp;
+    if (m_yuv_converter)
+    {
+        m_readback_width = m_yuv_converter->getReadbackWidth();
+        m_readback_height = m_yuv_converter->getReadbackHeight();
+    }
+    else
+    {
+        m_readback_width = m_gpu_scale ? m_recorder_cfg->m_output_width :
+            m_recorder_cfg->m_width;
+        m_readback_height = m_gpu_scale ? m_recorder_cfg->m_output_height :
+            m_recorder_cfg->m_height;
+    }
+    unsigned threads = m_recorder_cfg->m_conversion_threads;
+    if (threads == 0)
+    {
+        threads = std::max(1u, std::min(4u,
+            std::thread::hardware_concurrency() / 2));
+    }
+    if (!m_yuv_converter &&
+        (m_readback_width != m_recorder_cfg->m_output_width ||
+        m_readback_height != m_recorder_cfg->m_output_height))
+    {
+        m_scaler.reset(new FrameScaler(m_readback_width, m_readback_height,
+            m_recorder_cfg->m_output_width, m_recorder_cfg->m_output_height,
+            m_bpp, m_recorder_cfg->m_scale_filter));
+    }
+#ifdef TJ_NUMCS
+    // GPU YUV frames only need the compression which is not split
+    if (!m_yuv_converter && m_jpg_frames && threads > 1)
+    {
+        for (unsigned i = 0; i < threads; i++)
+            m_stripe_handles.push_back(tjInitCompress());
+        m_yuv_planes = m_arena->get(BufferArena::BT_STRIPE_YUV,
+            m_recorder_cfg->m_output_width *
+            m_recorder_cfg->m_output_height * 3 / 2);
+    }
+#endif
+    m_conversion_jobs = m_scaler || m_lossless_frames ||
+        !m_stripe_handles.empty() ? threads : 1;
+    unsigned workers = m_recorder_cfg->m_worker_threads;
+    if (workers == 0)
+    {
+        // Capture conversion (followed by muxing), video encoders, audio
+        // recorder and audio encoder run at the same time
+        workers = (m_recorder_cfg->m_record_audio > 0 ? 3 : 1) +
+            (unsigned)m_outputs.size() + m_conversion_jobs - 1;
+    }
+    m_worker_pool.reset(new WorkerPool(workers));
+    m_stats.reset(new PipelineStats());
+    m_cpu_governor.reset(new CPUGovernor(m_recorder_cfg->m_cpu_budget,
+        m_stats.get()));
+    m_worker_pool->setCPUGovernor(m_cpu_governor.get());
+    if (m_jpg_frames)
+    {
+        m_jpg_pool.reset(new JPGBufferPool(
+            tjBufSize(m_recorder_cfg->m_output_width,
+            m_recorder_cfg->m_output_height, TJSAMP_420)));
+    }
+    if (m_lossless_frames)
+    {
+        m_lossless_pool.reset(new JPGBufferPool(
+            Recorder::getLosslessMaxSize(m_recorder_cfg->m_output_width,
+            m_recorder_cfg->m_output_height, m_conversion_jobs)));
+    }
+    m_saved_read_fbo = m_saved_draw_fbo = 0;
+    if (m_gpu_scale)
+    {
+        int draw_fbo = 0;
+        if (ogrGetIntegerv != NULL)
+            ogrGetIntegerv(E_GL_DRAW_FRAMEBUFFER_BINDING, &draw_fbo);
+        ogrGenRenderbuffers(1, &m_rbo);
+        ogrBindRenderbuffer(E_GL_RENDERBUFFER, m_rbo);
+        ogrRenderbufferStorage(E_GL_RENDERBUFFER, E_GL_RGBA8,
+            m_readback_width, m_readback_height);
+        ogrBindRenderbuffer(E_GL_RENDERBUFFER, 0);
+        ogrGenFramebuffers(1, &m_fbo);
+        ogrBindFramebuffer(E_GL_DRAW_FRAMEBUFFER, m_fbo);
+        ogrFramebufferRenderbuffer(E_GL_DRAW_FRAMEBUFFER,
+            E_GL_COLOR_ATTACHMENT0, E_GL_RENDERBUFFER, m_rbo);
+        ogrBindFramebuffer(E_GL_DRAW_FRAMEBUFFER, draw_fbo);
+    }
     if (m_recorder_cfg->m_triple_buffering > 0)
     {
         ogrGenBuffers(3, m_pbo);
         for (int i = 0; i < 3; i++)
         {
             ogrBindBuffer(E_GL_PIXEL_PACK_BUFFER, m_pbo[i]);
-            ogrBufferData(E_GL_PIXEL_PACK_BUFFER, m_recorder_cfg->m_width *
-                m_recorder_cfg->m_height * 4, NULL, E_GL_STREAM_READ);
+            ogrBufferData(E_GL_PIXEL_PACK_BUFFER,
+                getRowSize(m_readback_width) * m_readback_height, NULL,
+                E_GL_STREAM_READ);
         }
         ogrBindBuffer(E_GL_PIXEL_PACK_BUFFER, 0);
     }
-    m_fbi = new uint8_t[m_recorder_cfg->m_width * m_recorder_cfg->m_height
-        * 4]();
+    m_fbi = m_arena->get(BufferArena::BT_FRAME,
+        getRowSize(m_readback_width) * m_readback_height);
+    m_region_capture = false;
+    m_need_full_frame = true;
     m_frame_type = 0;
-    m_capture_thread = std::thread(CaptureLibrary::captureConversion, this);
+    m_capture_seq = m_fbi_frame = 0;
+    memset(m_pbo_extra, 0, sizeof(m_pbo_extra));
 }   // CaptureLibrary
 
 // ----------------------------------------------------------------------------
 CaptureLibrary::~CaptureLibrary()
 {
     m_display_progress.store(false);
+    m_destroying.store(true);
     std::unique_lock<std::mutex> uld(m_destroy_mutex);
     m_destroy = true;
     uld.unlock();
-    std::unique_lock<std::mutex> ulf(m_fbi_mutex);
-    m_frame_type = isCapturing() ? -1 : -2;
-    m_fbi_ready.notify_one();
-    ulf.unlock();
-    m_capture_thread.join();
+    stopCapture();
+    // Conversion hands over to muxing when it is stopped
+    if (m_capture_task.valid())
+        m_capture_task.wait();
+    if (m_finalize_task.valid())
+        m_finalize_task.wait();
+    // Started by finalizeRecording, m_destroying stops its transcoding
+    if (m_transcode_task.valid())
+        m_transcode_task.wait();
+    // After finalizeRecording, which may start it
+    if (m_warmup_task.valid())
+        m_warmup_task.wait();
+    m_scaler.reset();
+    m_worker_pool.reset();
+    m_yuv_converter.reset();
+    // Queued frames go back to the pools first
+    m_outputs.clear();
+    m_jpg_pool.reset();
+    m_lossless_pool.reset();
+    m_arena.reset();
     tjDestroy(m_compress_handle);
-    tjDestroy(m_decompress_handle);
+    for (tjhandle handle : m_stripe_handles)
+        tjDestroy(handle);
     delete m_audio_data;
-    delete[] m_fbi;
     if (m_recorder_cfg->m_triple_buffering > 0)
     {
         ogrDeleteBuffers(3, m_pbo);
     }
+    if (m_gpu_scale)
+    {
+        ogrDeleteFramebuffers(1, &m_fbo);
+        ogrDeleteRenderbuffers(1, &m_rbo);
+    }
 }   // ~CaptureLibrary
 
 // ----------------------------------------------------------------------------
@@ -80,45 +264,133 @@ void CaptureLibrary::reset()
     {
         return;
     }
+    // Only blocks if the recording is started before the warm up is done
+    if (m_warmup_task.valid())
+        m_warmup_task.wait();
     m_capturing = true;
     runCallback(OGR_CBT_START_RECORDING, NULL);
     m_pbo_use = 0;
+    memset(m_pbo_extra, 0, sizeof(m_pbo_extra));
     m_accumulated_time = 0.;
+    m_region_capture = false;
+    m_need_full_frame = true;
+    m_stats->reset();
+    m_cpu_governor->reset();
+    m_draining.store(false);
+    m_cancelled.store(false);
+    m_capture_seq = m_fbi_frame = 0;
+    TraceRecorder::start();
+    allocateMuxerBuffer();
+    m_capture_task = m_worker_pool->submit(
+        std::bind(CaptureLibrary::captureConversion, this));
     if (m_recorder_cfg->m_record_audio > 0)
     {
         m_sound_stop.store(false);
-        m_audio_enc_thread = std::thread(Recorder::audioRecorder, this);
-    }
-    switch (m_recorder_cfg->m_video_format)
-    {
-    case OGR_VF_VP8:
-    case OGR_VF_VP9:
-        m_video_enc_thread = std::thread(Recorder::vpxEncoder, this);
-        break;
-    case OGR_VF_MJPEG:
-        m_video_enc_thread = std::thread(Recorder::mjpegWriter, this);
-        break;
-    case OGR_VF_H264:
-        m_video_enc_thread = std::thread(Recorder::openh264Encoder, this);
-        break;
-    default:
-        break;
+        m_audio_enc_task = m_worker_pool->submit(
+            std::bind(Recorder::audioRecorder, this));
     }
+    for (auto& output : m_outputs)
+        output->start();
 }   // reset
 
+// ----------------------------------------------------------------------------
+/** Allocate and fault in the buffer of the muxer, so the pipeline doesn't
+ *  stall on page faults when the recording starts. */
+void CaptureLibrary::allocateMuxerBuffer()
+{
+    size_t muxer_size = 0;
+    for (auto& output : m_outputs)
+    {
+        const RecorderConfig& rc = output->getRecorderConfig();
+        muxer_size = std::max(muxer_size, Recorder::getMKVBufferSize(
+            rc.m_video_format, rc.m_output_width, rc.m_output_height));
+    }
+    m_arena->get(BufferArena::BT_MUXER, muxer_size);
+}   // allocateMuxerBuffer
+
+// ----------------------------------------------------------------------------
+void CaptureLibrary::warmup()
+{
+    std::lock_guard<std::mutex> lock(m_capturing_mutex);
+    if (m_capturing || m_warmup_task.valid())
+        return;
+    m_warmup_task = m_worker_pool->submit(
+        std::bind(CaptureLibrary::warmupRecording, this));
+}   // warmup
+
+// ----------------------------------------------------------------------------
+/** Everything reset and the first frames of a recording would wait for,
+ *  which doesn't need the OpenGL context. The connection of the audio
+ *  recorder and the buffers are kept for all recordings, the encoders are
+ *  created again by finalizeRecording for the next one. */
+void CaptureLibrary::warmupRecording(CaptureLibrary* cl)
+{
+    setThreadName("warmup");
+    OGR_TRACE("warmup", TraceRecorder::NO_FRAME);
+    if (cl->m_recorder_cfg->m_record_audio > 0)
+        Recorder::warmupAudio(cl);
+    cl->allocateMuxerBuffer();
+    for (auto& output : cl->m_outputs)
+        output->allocateBuffers();
+    prepareEncoders(cl);
+}   // warmupRecording
+
+// ----------------------------------------------------------------------------
+void CaptureLibrary::prepareEncoders(CaptureLibrary* cl)
+{
+    for (auto& output : cl->m_outputs)
+        output->prepareEncoder();
+}   // prepareEncoders
+
+// ----------------------------------------------------------------------------
+void CaptureLibrary::stopCapture()
+{
+    if (!isCapturing()) return;
+    // Nothing competes with the rendering anymore, so the budget is lifted
+    // and the encoders may use all cores for the queued frames
+    m_cpu_governor->lift();
+    m_draining.store(true);
+    std::unique_lock<std::mutex> ul(m_fbi_mutex);
+    if (!m_cancelled.load() && flushPBOs())
+    {
+        // The frames shown last are only in m_fbi, let the conversion take
+        // them before it stops
+        m_fbi_ready.wait(ul, [this] { return m_frame_type <= 0; });
+    }
+    m_frame_type = -1;
+    m_fbi_ready.notify_one();
+}   // stopCapture
+
+// ----------------------------------------------------------------------------
+void CaptureLibrary::cancelCapture()
+{
+    if (!isCapturing()) return;
+    m_cancelled.store(true);
+    stopCapture();
+}   // cancelCapture
+
 // ----------------------------------------------------------------------------
 int CaptureLibrary::bmpToJPG(uint8_t* raw, unsigned width, unsigned height,
-                             uint8_t** jpeg_buffer, unsigned long* jpeg_size)
+                             unsigned pitch, bool bottom_up,
+                             uint8_t** jpeg_buffer, unsigned long* jpeg_size,
+                             uint64_t frame)
 {
+    OGR_TRACE("bmpToJPG", frame);
+    if (!m_stripe_handles.empty())
+    {
+        return stripedToJPG(raw, width, height, pitch, bottom_up, jpeg_buffer,
+            jpeg_size);
+    }
     int ret = 0;
+    const int flags = TJFLAG_NOREALLOC | (bottom_up ? TJFLAG_BOTTOMUP : 0);
 #ifdef TJFLAG_FASTDCT
-    ret = tjCompress2(m_compress_handle, raw, width, 0, height, TJPF_RGBX,
-        jpeg_buffer, jpeg_size, TJSAMP_420,
-        m_recorder_cfg->m_record_jpg_quality, TJFLAG_FASTDCT);
+    ret = tjCompress2(m_compress_handle, raw, width, pitch, height,
+        m_tj_format, jpeg_buffer, jpeg_size, TJSAMP_420,
+        m_recorder_cfg->m_record_jpg_quality, flags | TJFLAG_FASTDCT);
 #else
-    ret = tjCompress2(m_compress_handle, raw, width, 0, height, TJPF_RGBX,
-        jpeg_buffer, jpeg_size, TJSAMP_420,
-        m_recorder_cfg->m_record_jpg_quality, 0);
+    ret = tjCompress2(m_compress_handle, raw, width, pitch, height,
+        m_tj_format, jpeg_buffer, jpeg_size, TJSAMP_420,
+        m_recorder_cfg->m_record_jpg_quality, flags);
 #endif
     if (ret != 0)
     {
@@ -131,12 +403,145 @@ int CaptureLibrary::bmpToJPG(uint8_t* raw, unsigned width, unsigned height,
     return ret;
 }   // bmpToJPG
 
+// ----------------------------------------------------------------------------
+int CaptureLibrary::stripedToJPG(uint8_t* raw, unsigned width,
+                                 unsigned height, unsigned pitch,
+                                 bool bottom_up, uint8_t** jpeg_buffer,
+                                 unsigned long* jpeg_size)
+{
+    int ret = 0;
+#ifdef TJ_NUMCS
+    if (pitch == 0)
+        pitch = getRowSize(width);
+    const unsigned count = (unsigned)m_stripe_handles.size();
+    // Stripes are made of whole 4:2:0 MCU rows, so each one owns its rows in
+    // the chroma planes too, and they are converted in place
+    const unsigned stripe = ((height + count - 1) / count + 15) & ~15u;
+    uint8_t* y_plane = m_yuv_planes;
+    uint8_t* u_plane = y_plane + width * height;
+    uint8_t* v_plane = u_plane + width * height / 4;
+    int strides[3] = { (int)width, (int)width / 2, (int)width / 2 };
+    const int flags = bottom_up ? TJFLAG_BOTTOMUP : 0;
+    std::vector<int> stripe_ret(count, 0);
+    std::function<void(unsigned)> job = [&](unsigned i)
+    {
+        const unsigned y0 = std::min(i * stripe, height);
+        const unsigned y1 = std::min(y0 + stripe, height);
+        if (y0 == y1)
+            return;
+        // Rows of a bottom-up image for [y0, y1) start at height - y1
+        const uint8_t* src = raw +
+            (bottom_up ? height - y1 : y0) * (size_t)pitch;
+        unsigned char* planes[3] =
+        {
+            y_plane + y0 * width,
+            u_plane + y0 / 2 * width / 2,
+            v_plane + y0 / 2 * width / 2
+        };
+        stripe_ret[i] = tjEncodeYUVPlanes(m_stripe_handles[i], src,
+            width, pitch, y1 - y0, m_tj_format, planes, strides,
+            TJSAMP_420, flags);
+    };
+    m_worker_pool->parallelFor(count, job);
+    for (int r : stripe_ret)
+    {
+        if (r != 0)
+            ret = r;
+    }
+    if (ret == 0)
+    {
+        const unsigned char* planes[3] = { y_plane, u_plane, v_plane };
+#ifdef TJFLAG_FASTDCT
+        ret = tjCompressFromYUVPlanes(m_compress_handle, planes, width,
+            strides, height, TJSAMP_420, jpeg_buffer, jpeg_size,
+            m_recorder_cfg->m_record_jpg_quality,
+            TJFLAG_NOREALLOC | TJFLAG_FASTDCT);
+#else
+        ret = tjCompressFromYUVPlanes(m_compress_handle, planes, width,
+            strides, height, TJSAMP_420, jpeg_buffer, jpeg_size,
+            m_recorder_cfg->m_record_jpg_quality, TJFLAG_NOREALLOC);
+#endif
+    }
+#else
+    // No stripe handles are created without the YUV planes functions
+    assert(false);
+    ret = -1;
+#endif
+    if (ret != 0)
+    {
+        char* err = tjGetErrorStr();
+        std::string msg = "Turbojpeg encode error: ";
+        msg = msg + err + "\n";
+        runCallback(OGR_CBT_ERROR_RECORDING, msg.c_str());
+        return ret;
+    }
+    return ret;
+}   // stripedToJPG
+
+// ----------------------------------------------------------------------------
+int CaptureLibrary::bmpToLossless(uint8_t* raw, unsigned width,
+                                  unsigned height, unsigned pitch,
+                                  bool bottom_up, uint8_t* buffer,
+                                  unsigned long* size, uint64_t frame)
+{
+    OGR_TRACE("bmpToLossless", frame);
+    if (pitch == 0)
+        pitch = getRowSize(width);
+    // Stripes are always encoded top to bottom
+    const uint8_t* top = bottom_up ? raw + (height - 1) * (size_t)pitch : raw;
+    const ptrdiff_t top_pitch = bottom_up ? -(ptrdiff_t)pitch : pitch;
+    const unsigned count = m_conversion_jobs;
+    std::vector<size_t> stripe_sizes(count, 0);
+    std::function<void(unsigned)> job = [&](unsigned i)
+    {
+        stripe_sizes[i] = Recorder::losslessEncodeStripe(buffer, top,
+            top_pitch, width, height, count, i, m_pixel_layout);
+    };
+    m_worker_pool->parallelFor(count, job);
+    *size = Recorder::losslessFinishFrame(buffer, width, height, count,
+        stripe_sizes.data());
+    return 0;
+}   // bmpToLossless
+
+// ----------------------------------------------------------------------------
+int CaptureLibrary::yuvToJPG(uint8_t* yuv, unsigned width, unsigned height,
+                             uint8_t** jpeg_buffer, unsigned long* jpeg_size)
+{
+    int ret = 0;
+#if defined(TJ_NUMCS) && defined(TJFLAG_FASTDCT)
+    ret = tjCompressFromYUV(m_compress_handle, yuv, width, 4, height,
+        TJSAMP_420, jpeg_buffer, jpeg_size,
+        m_recorder_cfg->m_record_jpg_quality,
+        TJFLAG_NOREALLOC | TJFLAG_FASTDCT);
+#elif defined(TJ_NUMCS)
+    ret = tjCompressFromYUV(m_compress_handle, yuv, width, 4, height,
+        TJSAMP_420, jpeg_buffer, jpeg_size,
+        m_recorder_cfg->m_record_jpg_quality, TJFLAG_NOREALLOC);
+#else
+    // initGPUYUV never enables it without tjCompressFromYUV
+    assert(false);
+    ret = -1;
+#endif
+    if (ret != 0)
+    {
+        char* err = tjGetErrorStr();
+        std::string msg = "Turbojpeg encode error: ";
+        msg = msg + err + "\n";
+        runCallback(OGR_CBT_ERROR_RECORDING, msg.c_str());
+        return ret;
+    }
+    return ret;
+}   // yuvToJPG
+
 // ----------------------------------------------------------------------------
 int CaptureLibrary::yuvConversion(uint8_t* jpeg_buffer, unsigned jpeg_size,
-                                  uint8_t* yuv_buffer)
+                                  uint8_t* yuv_buffer, uint64_t frame,
+                                  tjhandle handle)
 {
-    int ret = tjDecompressToYUV(m_decompress_handle, jpeg_buffer, jpeg_size,
-        yuv_buffer, 0);
+    ScopedLatency decode_latency(&m_stats->m_decode);
+    OGR_TRACE("yuvConversion", frame);
+    int ret = tjDecompressToYUV(handle, jpeg_buffer, jpeg_size, yuv_buffer,
+        0);
     if (ret != 0)
     {
         char* err = tjGetErrorStr();
@@ -167,53 +572,308 @@ int CaptureLibrary::getFrameCount(double rate)
 }   // getFrameCount
 
 // ----------------------------------------------------------------------------
-void CaptureLibrary::capture()
+void CaptureLibrary::initGPUYUV()
+{
+#ifdef TJ_NUMCS
+    if (ogrGenFramebuffers == NULL || ogrCreateShader == NULL ||
+        ogrGenTextures == NULL)
+    {
+        runCallback(OGR_CBT_ERROR_RECORDING, "Missing opengl functions for"
+            " GPU YUV conversion, fallback to RGBA read back.\n");
+        return;
+    }
+    if (m_recorder_cfg->m_output_height % 4 != 0)
+    {
+        runCallback(OGR_CBT_ERROR_RECORDING, "Output height is not divisble"
+            " by 4 for GPU YUV conversion, fallback to RGBA read back.\n");
+        return;
+    }
+    m_yuv_converter.reset(new GPUYUVConverter(m_recorder_cfg->m_width,
+        m_recorder_cfg->m_height, m_recorder_cfg->m_output_width,
+        m_recorder_cfg->m_output_height));
+    if (!m_yuv_converter->isReady())
+    {
+        m_yuv_converter.reset();
+        runCallback(OGR_CBT_ERROR_RECORDING, "Failed to compile the GPU YUV"
+            " conversion shader, fallback to RGBA read back.\n");
+    }
+#else
+    runCallback(OGR_CBT_ERROR_RECORDING, "Turbojpeg is too old for GPU YUV"
+        " conversion, fallback to RGBA read back.\n");
+#endif
+}   // initGPUYUV
+
+// ----------------------------------------------------------------------------
+void CaptureLibrary::bindReadBackFrameBuffer()
+{
+    if (m_yuv_converter)
+    {
+        m_yuv_converter->convert();
+        return;
+    }
+    if (!m_gpu_scale)
+        return;
+    if (ogrGetIntegerv != NULL)
+    {
+        ogrGetIntegerv(E_GL_READ_FRAMEBUFFER_BINDING, &m_saved_read_fbo);
+        ogrGetIntegerv(E_GL_DRAW_FRAMEBUFFER_BINDING, &m_saved_draw_fbo);
+    }
+    ogrBindFramebuffer(E_GL_DRAW_FRAMEBUFFER, m_fbo);
+    ogrBlitFramebuffer(0, 0, m_recorder_cfg->m_width,
+        m_recorder_cfg->m_height, 0, 0, m_readback_width, m_readback_height,
+        E_GL_COLOR_BUFFER_BIT, E_GL_LINEAR);
+    ogrBindFramebuffer(E_GL_READ_FRAMEBUFFER, m_fbo);
+}   // bindReadBackFrameBuffer
+
+// ----------------------------------------------------------------------------
+void CaptureLibrary::unbindReadBackFrameBuffer()
+{
+    if (m_yuv_converter)
+    {
+        m_yuv_converter->restore();
+        return;
+    }
+    if (!m_gpu_scale)
+        return;
+    ogrBindFramebuffer(E_GL_READ_FRAMEBUFFER, m_saved_read_fbo);
+    ogrBindFramebuffer(E_GL_DRAW_FRAMEBUFFER, m_saved_draw_fbo);
+}   // unbindReadBackFrameBuffer
+
+// ----------------------------------------------------------------------------
+void CaptureLibrary::scaleRegion(CaptureRegion* r) const
+{
+    // Round outwards and add one pixel for the linear filter footprint
+    const uint64_t w = m_recorder_cfg->m_width;
+    const uint64_t h = m_recorder_cfg->m_height;
+    uint64_t x0 = r->m_x * (uint64_t)m_readback_width / w;
+    uint64_t y0 = r->m_y * (uint64_t)m_readback_height / h;
+    uint64_t x1 = ((r->m_x + r->m_width) * (uint64_t)m_readback_width +
+        w - 1) / w + 1;
+    uint64_t y1 = ((r->m_y + r->m_height) * (uint64_t)m_readback_height +
+        h - 1) / h + 1;
+    x0 = x0 > 0 ? x0 - 1 : 0;
+    y0 = y0 > 0 ? y0 - 1 : 0;
+    x1 = std::min(x1, (uint64_t)m_readback_width);
+    y1 = std::min(y1, (uint64_t)m_readback_height);
+    r->m_x = (unsigned)x0;
+    r->m_y = (unsigned)y0;
+    r->m_width = (unsigned)(x1 - x0);
+    r->m_height = (unsigned)(y1 - y0);
+}   // scaleRegion
+
+// ----------------------------------------------------------------------------
+void CaptureLibrary::copyRegions(const uint8_t* src,
+                                 const std::vector<CaptureRegion>& regions)
+{
+    const unsigned width = m_readback_width;
+    const unsigned height = m_readback_height;
+    const unsigned pitch = getRowSize(width);
+    if (regions.empty())
+    {
+        memcpy(m_fbi, src, pitch * height);
+        return;
+    }
+    for (const CaptureRegion& r : regions)
+    {
+        const unsigned size = r.m_width * m_bpp;
+        const unsigned row_size = getRowSize(r.m_width);
+        for (unsigned y = r.m_y; y < r.m_y + r.m_height; y++)
+        {
+            memcpy(m_fbi + y * pitch + r.m_x * m_bpp, src, size);
+            src += row_size;
+        }
+    }
+}   // copyRegions
+
+// ----------------------------------------------------------------------------
+/** Copy the finished read back of pixel buffer object pbo to m_fbi, call it
+ *  with m_fbi_mutex locked. */
+void CaptureLibrary::readPBO(int pbo)
+{
+    const unsigned size = getRowSize(m_readback_width) * m_readback_height;
+    ogrBindBuffer(E_GL_PIXEL_PACK_BUFFER, m_pbo[pbo]);
+    void* ptr;
+    if (ogrMapBuffer != NULL)
+    {
+        ptr = ogrMapBuffer(E_GL_PIXEL_PACK_BUFFER, E_GL_READ_ONLY);
+    }
+    else if (ogrMapBufferRange != NULL)
+    {
+        ptr = ogrMapBufferRange(E_GL_PIXEL_PACK_BUFFER, 0, size,
+            E_GL_MAP_READ_BIT);
+    }
+    else
+    {
+        assert(false && "Missing callback for MapBuffer");
+    }
+    copyRegions((uint8_t*)ptr, m_pbo_regions[pbo]);
+    ogrUnmapBuffer(E_GL_PIXEL_PACK_BUFFER);
+    if (m_pbo_regions[pbo].empty())
+        m_need_full_frame = false;
+}   // readPBO
+
+// ----------------------------------------------------------------------------
+/** Hand the image in m_fbi to the conversion for frame_count frames, call it
+ *  with m_fbi_mutex locked. */
+void CaptureLibrary::frameReady(int frame_count, uint64_t frame)
+{
+    // Keep the duration of a frame which is not converted yet
+    if (frame_count == 0 || m_frame_type < 0)
+        return;
+    // The image still waiting for conversion is replaced
+    if (m_frame_type > 0)
+        m_stats->m_frames_dropped.fetch_add(1, std::memory_order_relaxed);
+    m_stats->m_frames_captured.fetch_add(1, std::memory_order_relaxed);
+    m_stats->m_frames_duplicated.fetch_add(frame_count - 1,
+        std::memory_order_relaxed);
+    m_frame_type += frame_count;
+    m_fbi_frame = frame;
+    m_fbi_ready.notify_one();
+}   // frameReady
+
+// ----------------------------------------------------------------------------
+/** When capture stops after unchanged frames, the images on screen are still
+ *  in the pixel buffer objects. Copy them to m_fbi in order up to the newest
+ *  one with unchanged frames, call it with m_fbi_mutex locked. Returns true
+ *  if a frame was handed to the conversion. */
+bool CaptureLibrary::flushPBOs()
+{
+    if (m_recorder_cfg->m_triple_buffering == 0 || m_frame_type < 0)
+        return false;
+    const unsigned in_flight = std::min(m_pbo_use, 3u);
+    unsigned last = 0;
+    for (unsigned i = 1; i <= in_flight; i++)
+    {
+        if (m_pbo_extra[(m_pbo_use - i) % 3] > 0)
+        {
+            last = i;
+            break;
+        }
+    }
+    if (last == 0)
+        return false;
+    for (unsigned i = in_flight; i >= last; i--)
+    {
+        const int pbo = (m_pbo_use - i) % 3;
+        readPBO(pbo);
+        frameReady(m_pbo_extra[pbo], m_capture_seq - i);
+        m_pbo_extra[pbo] = 0;
+    }
+    ogrBindBuffer(E_GL_PIXEL_PACK_BUFFER, 0);
+    return m_frame_type > 0;
+}   // flushPBOs
+
+// ----------------------------------------------------------------------------
+void CaptureLibrary::capture(const CaptureRegion* regions, unsigned count)
 {
     if (!isCapturing()) return;
+    ScopedLatency capture_latency(&m_stats->m_capture);
+    OGR_TRACE("capture", m_capture_seq++);
+    const unsigned width = m_recorder_cfg->m_width;
+    const unsigned height = m_recorder_cfg->m_height;
+    // Empty m_regions means the whole frame buffer
+    m_regions.clear();
+    if (regions != NULL)
+    {
+        for (unsigned i = 0; i < count; i++)
+        {
+            CaptureRegion r = regions[i];
+            if (r.m_x >= width || r.m_y >= height)
+                continue;
+            r.m_width = std::min(r.m_width, width - r.m_x);
+            r.m_height = std::min(r.m_height, height - r.m_y);
+            if (r.m_width == 0 || r.m_height == 0)
+                continue;
+            m_regions.push_back(r);
+        }
+        if (m_regions.empty())
+        {
+            captureUnchanged();
+            return;
+        }
+        // Regions can only be patched on top of a complete frame, and the
+        // packed YUV planes cannot be patched at all
+        if (m_yuv_converter)
+            m_regions.clear();
+        else
+            m_region_capture = true;
+        if (m_need_full_frame)
+            m_regions.clear();
+        if (m_gpu_scale)
+        {
+            for (CaptureRegion& r : m_regions)
+                scaleRegion(&r);
+        }
+        // Overlapping regions may not fit inside a pixel buffer object
+        size_t total = 0;
+        for (const CaptureRegion& r : m_regions)
+            total += getRowSize(r.m_width) * r.m_height;
+        if (total > getRowSize(m_readback_width) * m_readback_height)
+            m_regions.clear();
+    }
+    const unsigned readback_width = m_readback_width;
+    const unsigned readback_height = m_readback_height;
     int pbo_read = -1;
     if (m_pbo_use > 3 && m_pbo_use % 3 == 0)
         m_pbo_use = 3;
     auto rate = std::chrono::high_resolution_clock::now() - m_framerate_timer;
     m_framerate_timer = std::chrono::high_resolution_clock::now();
-    const unsigned width = m_recorder_cfg->m_width;
-    const unsigned height = m_recorder_cfg->m_height;
     const bool use_pbo = m_recorder_cfg->m_triple_buffering > 0;
     if (m_pbo_use >= 3)
     {
         int frame_count = getFrameCount(std::chrono::duration_cast
             <std::chrono::duration<double> >(rate).count());
-        if (frame_count != 0)
+        if (frame_count == 0)
+            m_stats->m_frames_skipped.fetch_add(1, std::memory_order_relaxed);
+        // Unchanged frames after the one read back into this pixel buffer
+        // object go to it
+        if (use_pbo)
         {
-            const unsigned size = width * height * 4;
+            frame_count += m_pbo_extra[m_pbo_use % 3];
+            m_pbo_extra[m_pbo_use % 3] = 0;
+        }
+        // With regions every read back has to reach m_fbi, otherwise later
+        // regions will be patched on top of an outdated frame
+        if (frame_count == 0 && !m_region_capture)
+        {
+            // m_fbi misses this frame, so regions which come later need a
+            // full one first
+            m_need_full_frame = true;
+        }
+        else
+        {
+            const unsigned size = getRowSize(readback_width) *
+                readback_height;
             std::lock_guard<std::mutex> lock(m_fbi_mutex);
+            ScopedLatency readback_latency(&m_stats->m_readback);
             if (use_pbo)
             {
                 pbo_read = m_pbo_use % 3;
-                ogrBindBuffer(E_GL_PIXEL_PACK_BUFFER, m_pbo[pbo_read]);
-                void* ptr;
-                if (ogrMapBuffer != NULL)
-                {
-                    ptr = ogrMapBuffer(E_GL_PIXEL_PACK_BUFFER, E_GL_READ_ONLY);
-                }
-                else if (ogrMapBufferRange != NULL)
-                {
-                    ptr = ogrMapBufferRange(E_GL_PIXEL_PACK_BUFFER, 0, size,
-                        E_GL_MAP_READ_BIT);
-                }
-                else
-                {
-                    assert(false && "Missing callback for MapBuffer");
-                }
-                memcpy(m_fbi, ptr, size);
-                ogrUnmapBuffer(E_GL_PIXEL_PACK_BUFFER);
+                readPBO(pbo_read);
+            }
+            else if (m_regions.empty())
+            {
+                bindReadBackFrameBuffer();
+                ogrReadPixels(0, 0, readback_width, readback_height,
+                    m_gl_format, m_gl_type, m_fbi);
+                unbindReadBackFrameBuffer();
+                m_need_full_frame = false;
             }
             else
             {
-                ogrReadPixels(0, 0, width, height, E_GL_RGBA,
-                    E_GL_UNSIGNED_BYTE, m_fbi);
+                m_region_buf.resize(size);
+                uint8_t* ptr = m_region_buf.data();
+                bindReadBackFrameBuffer();
+                for (const CaptureRegion& r : m_regions)
+                {
+                    ogrReadPixels(r.m_x, r.m_y, r.m_width, r.m_height,
+                        m_gl_format, m_gl_type, ptr);
+                    ptr += getRowSize(r.m_width) * r.m_height;
+                }
+                unbindReadBackFrameBuffer();
+                copyRegions(m_region_buf.data(), m_regions);
             }
-            m_frame_type = frame_count;
-            m_fbi_ready.notify_one();
+            frameReady(frame_count, m_capture_seq - 1);
         }
     }
     int pbo_use = m_pbo_use++ % 3;
@@ -222,16 +882,264 @@ void CaptureLibrary::capture()
 
     assert(pbo_read == -1 || pbo_use == pbo_read);
     ogrBindBuffer(E_GL_PIXEL_PACK_BUFFER, m_pbo[pbo_use]);
-    ogrReadPixels(0, 0, width, height, E_GL_RGBA, E_GL_UNSIGNED_BYTE, NULL);
+    m_pbo_regions[pbo_use] = m_regions;
+    bindReadBackFrameBuffer();
+    if (m_regions.empty())
+    {
+        // m_need_full_frame is cleared when it is copied to m_fbi
+        ogrReadPixels(0, 0, readback_width, readback_height, m_gl_format,
+            m_gl_type, NULL);
+    }
+    else
+    {
+        // Pack the regions one after another inside the pixel buffer object
+        size_t offset = 0;
+        for (const CaptureRegion& r : m_regions)
+        {
+            ogrReadPixels(r.m_x, r.m_y, r.m_width, r.m_height, m_gl_format,
+                m_gl_type, (void*)offset);
+            offset += getRowSize(r.m_width) * r.m_height;
+        }
+    }
+    unbindReadBackFrameBuffer();
     ogrBindBuffer(E_GL_PIXEL_PACK_BUFFER, 0);
 }   // capture
 
+// ----------------------------------------------------------------------------
+void CaptureLibrary::captureUnchanged()
+{
+    if (!isCapturing()) return;
+    auto rate = std::chrono::high_resolution_clock::now() - m_framerate_timer;
+    m_framerate_timer = std::chrono::high_resolution_clock::now();
+    // No frame has been read back yet, so there is nothing to extend
+    const bool use_pbo = m_recorder_cfg->m_triple_buffering > 0;
+    if (use_pbo ? m_pbo_use == 0 : m_pbo_use < 3)
+        return;
+    int frame_count = getFrameCount(std::chrono::duration_cast
+        <std::chrono::duration<double> >(rate).count());
+    if (frame_count == 0)
+    {
+        m_stats->m_frames_skipped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    std::lock_guard<std::mutex> lock(m_fbi_mutex);
+    if (m_frame_type < 0)
+        return;
+    if (use_pbo)
+    {
+        // m_fbi is a few frames behind, the one on screen is the newest read
+        // back still in flight
+        m_pbo_extra[(m_pbo_use - 1) % 3] += frame_count;
+        return;
+    }
+    m_stats->m_frames_duplicated.fetch_add(frame_count,
+        std::memory_order_relaxed);
+    if (m_frame_type > 0)
+    {
+        // Last frame is still waiting for conversion, extend it directly
+        m_frame_type += frame_count;
+        return;
+    }
+    for (auto& output : m_outputs)
+        output->queueFrame(NULL, 0, frame_count);
+}   // captureUnchanged
+
+// ----------------------------------------------------------------------------
+/** Wait for the encoders to finish the stopped recording and mux them. */
+void CaptureLibrary::finalizeRecording(CaptureLibrary* cl)
+{
+    setThreadName("finalizeRecord");
+    applyThreadConfig(OGR_TS_MUXER);
+    if (cl->m_recorder_cfg->m_record_audio > 0)
+    {
+        cl->m_sound_stop.store(true);
+        cl->m_audio_enc_task.wait();
+    }
+    const bool cancelled = cl->isCancelled();
+    std::unique_lock<std::mutex> ld(cl->m_destroy_mutex);
+    int val_for_cb = 0;
+    for (auto& output : cl->m_outputs)
+        output->finish(cancelled);
+    if (!cancelled && !cl->m_destroy)
+        runCallback(OGR_CBT_PROGRESS_RECORDING, &val_for_cb);
+    cl->m_display_progress.store(!cl->m_destroy && !cancelled);
+    for (auto& output : cl->m_outputs)
+        output->wait();
+    const std::string audio = getSavedName() + ".audio";
+    // Checked again as the recording may be cancelled while draining
+    if (cl->isCancelled())
+    {
+        for (auto& output : cl->m_outputs)
+            remove((output->getName() + ".video").c_str());
+        remove(audio.c_str());
+        TraceRecorder::stop();
+        std::lock_guard<std::mutex> lc(cl->m_capturing_mutex);
+        std::lock_guard<std::mutex> lf(cl->m_fbi_mutex);
+        cl->m_capturing = false;
+        cl->m_frame_type = 0;
+        return;
+    }
+    // The temporary video files are removed by muxing, the audio one after
+    // all outputs have it
+    uint64_t bytes = getFileSize(audio);
+    std::vector<std::string> saved;
+    std::unique_ptr<DeferredRecording> deferred;
+    for (auto& output : cl->m_outputs)
+    {
+        const RecorderConfig& rc = output->getRecorderConfig();
+        const std::string video = output->getName() + ".video";
+        bytes += getFileSize(video);
+        // Transcoded in background once this recording is done, unless the
+        // MJPEG video has to be saved now
+        if (rc.m_deferred_encoding > 0 && !cl->m_destroy)
+        {
+            if (rename(video.c_str(), (output->getName() + ".mjpeg").c_str())
+                == 0)
+            {
+                deferred.reset(new DeferredRecording());
+                deferred->m_config = rc;
+                deferred->m_name = output->getName();
+                continue;
+            }
+            runCallback(OGR_CBT_ERROR_RECORDING, "Failed to move MJPEG video"
+                " for transcoding, saving it instead.\n");
+        }
+        std::string f;
+        {
+            ScopedLatency mux_latency(&cl->m_stats->m_mux);
+            OGR_TRACE("writeMKV", TraceRecorder::NO_FRAME);
+            f = Recorder::writeMKV(video, audio, rc.m_deferred_encoding > 0 ?
+                OGR_VF_MJPEG : rc.m_video_format, rc.m_output_width,
+                rc.m_output_height, cl->m_arena.get());
+        }
+        if (!f.empty())
+            bytes += getFileSize(f);
+        saved.push_back(f);
+    }
+    struct stat st;
+    if (stat(audio.c_str(), &st) == 0)
+    {
+        if (deferred)
+        {
+            deferred->m_audio = getSavedName() + ".deferred_audio";
+            if (rename(audio.c_str(), deferred->m_audio.c_str()) != 0)
+            {
+                runCallback(OGR_CBT_ERROR_RECORDING, "Failed to move audio"
+                    " data file for transcoding.\n");
+                deferred->m_audio.clear();
+            }
+        }
+        else if (remove(audio.c_str()) != 0 && !cl->m_destroy)
+        {
+            runCallback(OGR_CBT_ERROR_RECORDING, "Failed to remove audio"
+                " data file\n");
+        }
+    }
+    if (!TraceRecorder::stop() && !cl->m_destroy)
+    {
+        runCallback(OGR_CBT_ERROR_RECORDING, "Failed to save trace file.\n");
+    }
+    cl->m_stats->m_bytes_written.fetch_add(bytes, std::memory_order_relaxed);
+    if (deferred)
+    {
+        deferred->m_display_progress = cl->m_display_progress.load();
+        // One transcoding at a time, as each uses all cores
+        std::shared_future<void> previous = cl->m_transcode_task;
+        cl->m_transcode_task = cl->m_worker_pool->submit(
+            std::bind(CaptureLibrary::transcodeRecording, cl, *deferred,
+            previous)).share();
+    }
+    if (cl->m_destroy)
+    {
+        return;
+    }
+    if (cl->m_display_progress.load())
+    {
+        // The transcoding reports the end of saving
+        if (!deferred)
+        {
+            val_for_cb = 100;
+            runCallback(OGR_CBT_PROGRESS_RECORDING, &val_for_cb);
+        }
+        for (const std::string& f : saved)
+        {
+            if (f.empty())
+            {
+                runCallback(OGR_CBT_ERROR_RECORDING, "Failed to mux a"
+                    " mkv.\n");
+            }
+            else
+            {
+                runCallback(OGR_CBT_SAVED_RECORDING, f.c_str());
+            }
+        }
+    }
+    cl->m_display_progress.store(false);
+    std::lock_guard<std::mutex> lc(cl->m_capturing_mutex);
+    std::lock_guard<std::mutex> lf(cl->m_fbi_mutex);
+    // An encoder can't be restarted after its end of stream, so create the
+    // ones of the next recording now instead of when it starts
+    if (cl->m_warmup_task.valid())
+    {
+        cl->m_warmup_task = cl->m_worker_pool->submit(
+            std::bind(CaptureLibrary::prepareEncoders, cl));
+    }
+    cl->m_capturing = false;
+    cl->m_frame_type = 0;
+}   // finalizeRecording
+
+// ----------------------------------------------------------------------------
+/** Transcode the MJPEG video of a stopped recording to VP9 and mux it, only
+ *  touching the files of that recording. */
+void CaptureLibrary::transcodeRecording(CaptureLibrary* cl,
+                                        const DeferredRecording& dr,
+                                        std::shared_future<void> previous)
+{
+    setThreadName("transcode");
+    applyThreadConfig(OGR_TS_MUXER);
+    if (previous.valid())
+        previous.wait();
+    const std::string mjpeg = dr.m_name + ".mjpeg";
+    const std::string vp9 = dr.m_name + ".vp9";
+    // Its own buffers, the ones of the library are used by the next
+    // recording
+    BufferArena arena(dr.m_config.m_huge_pages > 0,
+        dr.m_config.m_lock_memory > 0);
+    // Muxed as MJPEG if the transcoding is stopped by ogrDestroy or fails
+    const bool transcoded = !cl->isDestroying() &&
+        Recorder::vpxTranscode(cl, dr.m_config, &arena, dr.m_display_progress,
+        mjpeg, vp9);
+    if (transcoded)
+        remove(mjpeg.c_str());
+    const std::string f = Recorder::writeMKV(transcoded ? vp9 : mjpeg,
+        dr.m_audio, transcoded ? OGR_VF_VP9 : OGR_VF_MJPEG,
+        dr.m_config.m_output_width, dr.m_config.m_output_height, &arena);
+    if (!dr.m_audio.empty() && remove(dr.m_audio.c_str()) != 0 &&
+        !cl->isDestroying())
+    {
+        runCallback(OGR_CBT_ERROR_RECORDING, "Failed to remove audio data"
+            " file\n");
+    }
+    if (cl->isDestroying() || !dr.m_display_progress)
+        return;
+    int val_for_cb = 100;
+    runCallback(OGR_CBT_PROGRESS_RECORDING, &val_for_cb);
+    if (f.empty())
+        runCallback(OGR_CBT_ERROR_RECORDING, "Failed to mux a mkv.\n");
+    else
+        runCallback(OGR_CBT_SAVED_RECORDING, f.c_str());
+}   // transcodeRecording
+
 // ----------------------------------------------------------------------------
 void CaptureLibrary::captureConversion(CaptureLibrary* cl)
 {
     setThreadName("captureConvert");
+    applyThreadConfig(OGR_TS_CONVERSION);
     while (true)
     {
+        // Without holding m_fbi_mutex, so newer frames replace the waiting
+        // one meanwhile
+        cl->m_cpu_governor->throttle();
         std::unique_lock<std::mutex> ul(cl->m_fbi_mutex);
         cl->m_fbi_ready.wait(ul, [&cl]
             { return cl->m_frame_type != 0; });
@@ -240,78 +1148,134 @@ void CaptureLibrary::captureConversion(CaptureLibrary* cl)
         if (frame_count == -1)
         {
             ul.unlock();
-            if (cl->m_recorder_cfg->m_record_audio > 0)
+            // Muxing only waits for the encoders, give this thread back
+            cl->m_finalize_task = cl->m_worker_pool->submit(
+                std::bind(CaptureLibrary::finalizeRecording, cl));
+            return;
+        }
+
+        OGR_TRACE("captureConversion", cl->m_fbi_frame);
+        ScopedCPUTime cpu_time(cl->m_cpu_governor.get());
+        const unsigned width = cl->m_readback_width;
+        const unsigned height = cl->m_readback_height;
+        const int pitch = cl->getRowSize(width);
+        const unsigned output_width = cl->m_recorder_cfg->m_output_width;
+        const unsigned output_height = cl->m_recorder_cfg->m_output_height;
+        const auto conversion_start = std::chrono::steady_clock::now();
+        // One conversion for each kind of frame the outputs take
+        uint8_t* jpg = NULL;
+        unsigned long jpg_size = 0;
+        uint8_t* lossless = NULL;
+        unsigned long lossless_size = 0;
+        int jpg_ret = -1;
+        int lossless_ret = -1;
+        if (cl->m_jpg_frames)
+        {
+            jpg = cl->m_jpg_pool->acquire();
+            if (jpg == NULL)
             {
-                cl->m_sound_stop.store(true);
-                cl->m_audio_enc_thread.join();
+                runCallback(OGR_CBT_ERROR_RECORDING, "Failed to allocate"
+                    " jpeg buffer.\n");
             }
-            std::unique_lock<std::mutex> ulj(cl->m_jpg_list_mutex);
-            std::lock_guard<std::mutex> ld(cl->m_destroy_mutex);
-            int val_for_cb = 0;
-            if (!cl->m_destroy)
+        }
+        if (cl->m_lossless_frames)
+        {
+            lossless = cl->m_lossless_pool->acquire();
+            if (lossless == NULL)
             {
-                runCallback(OGR_CBT_PROGRESS_RECORDING, &val_for_cb);
+                runCallback(OGR_CBT_ERROR_RECORDING, "Failed to allocate"
+                    " lossless buffer.\n");
             }
-            cl->m_jpg_list.emplace_back((uint8_t*)NULL, 0, 0);
-            cl->m_jpg_list_ready.notify_one();
-            ulj.unlock();
-            cl->m_display_progress.store(!cl->m_destroy);
-            cl->m_video_enc_thread.join();
-            std::string f = Recorder::writeMKV(getSavedName() + ".video",
-                getSavedName() + ".audio");
-            if (cl->m_destroy)
+        }
+        if (cl->m_yuv_converter)
+        {
+            // Already a top-down I420 image from the GPU, there are no
+            // lossless outputs with it
+            if (jpg != NULL)
             {
-                return;
+                jpg_ret = cl->yuvToJPG(fbi, output_width, output_height, &jpg,
+                    &jpg_size);
             }
-            if (cl->m_display_progress.load())
+        }
+        else if (jpg != NULL || lossless != NULL)
+        {
+            // m_fbi is bottom-up as read back, let the scaler and turbojpeg
+            // read it in that order instead of flipping it
+            uint8_t* image = fbi;
+            unsigned image_pitch = 0;
+            bool bottom_up = true;
+            if (cl->m_scaler)
             {
-                val_for_cb = 100;
-                runCallback(OGR_CBT_PROGRESS_RECORDING, &val_for_cb);
-                if (f.empty())
-                {
-                    runCallback(OGR_CBT_ERROR_RECORDING, "Failed to mux a"
-                        " mkv.\n");
-                }
-                else
-                {
-                    runCallback(OGR_CBT_SAVED_RECORDING, f.c_str());
-                }
+                ScopedLatency scale_latency(&cl->m_stats->m_scale);
+                // Negative stride makes the scaled image top-down
+                cl->m_scaler->scale(fbi + (height - 1) * pitch, -pitch,
+                    cl->m_worker_pool.get(), cl->m_conversion_jobs);
+                image = cl->m_scaler->getOutput();
+                image_pitch = cl->m_scaler->getPitch();
+                bottom_up = false;
+            }
+            if (lossless != NULL)
+            {
+                lossless_ret = cl->bmpToLossless(image, output_width,
+                    output_height, image_pitch, bottom_up, lossless,
+                    &lossless_size, cl->m_fbi_frame);
+            }
+            if (jpg != NULL)
+            {
+                jpg_ret = cl->bmpToJPG(image, output_width, output_height,
+                    image_pitch, bottom_up, &jpg, &jpg_size, cl->m_fbi_frame);
             }
-            cl->m_display_progress.store(false);
-            std::lock_guard<std::mutex> lc(cl->m_capturing_mutex);
-            std::lock_guard<std::mutex> lf(cl->m_fbi_mutex);
-            cl->m_capturing = false;
-            cl->m_frame_type = 0;
-            continue;
         }
-        else if (frame_count == -2)
+        cl->m_stats->m_conversion.add(std::chrono::duration_cast
+            <std::chrono::nanoseconds>(std::chrono::steady_clock::now() -
+            conversion_start).count());
+        // Keep the duration of a failed frame with the previous image
+        if (cl->m_jpg_frames && jpg_ret != 0)
         {
-            ul.unlock();
-            return;
+            cl->releaseJPG(jpg);
+            jpg = NULL;
+            jpg_size = 0;
         }
-
-        const unsigned width = cl->m_recorder_cfg->m_width;
-        const unsigned height = cl->m_recorder_cfg->m_height;
-        const int pitch = width * 4;
-        uint8_t* p2 = fbi + (height - 1) * pitch;
-        uint8_t* tmp_buf = new uint8_t[pitch];
-        for (unsigned i = 0; i < height; i += 2)
+        if (cl->m_lossless_frames && lossless_ret != 0)
         {
-            memcpy(tmp_buf, fbi, pitch);
-            memcpy(fbi, p2, pitch);
-            memcpy(p2, tmp_buf, pitch);
-            fbi += pitch;
-            p2 -= pitch;
+            cl->releaseJPG(lossless);
+            lossless = NULL;
+            lossless_size = 0;
         }
-        delete [] tmp_buf;
-        uint8_t* jpg = NULL;
-        unsigned long jpg_size = 0;
-        cl->bmpToJPG(cl->m_fbi, width, height, &jpg, &jpg_size);
+        if ((cl->m_jpg_frames && jpg == NULL) ||
+            (cl->m_lossless_frames && lossless == NULL))
+        {
+            cl->m_stats->m_frames_dropped.fetch_add(1,
+                std::memory_order_relaxed);
+        }
+        // Each output gets a reference, the one of acquire included
+        unsigned jpg_outputs = 0;
+        unsigned lossless_outputs = 0;
+        for (auto& output : cl->m_outputs)
+        {
+            if (output->isLossless())
+                lossless_outputs++;
+            else
+                jpg_outputs++;
+        }
+        if (jpg != NULL && jpg_outputs > 1)
+            JPGBufferPool::addRef(jpg, jpg_outputs - 1);
+        if (lossless != NULL && lossless_outputs > 1)
+            JPGBufferPool::addRef(lossless, lossless_outputs - 1);
+        // Queue it before releasing m_fbi_mutex, so unchanged frames from
+        // captureUnchanged always come after this
+        unsigned queue_depth = 0;
+        for (auto& output : cl->m_outputs)
+        {
+            const unsigned depth = output->isLossless() ?
+                output->queueFrame(lossless, (unsigned)lossless_size,
+                frame_count) :
+                output->queueFrame(jpg, (unsigned)jpg_size, frame_count);
+            queue_depth = std::max(queue_depth, depth);
+        }
+        cl->m_stats->setQueueDepth(queue_depth);
         cl->m_frame_type = 0;
-        ul.unlock();
-
-        std::lock_guard<std::mutex> lg(cl->m_jpg_list_mutex);
-        cl->m_jpg_list.emplace_back(jpg, jpg_size, frame_count);
-        cl->m_jpg_list_ready.notify_one();
+        // stopCapture may wait for the last frame
+        cl->m_fbi_ready.notify_all();
     }
 }   // captureConversion
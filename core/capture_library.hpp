@@ -9,6 +9,9 @@
 #define HEADER_CAPTURE_LIBRARY_HPP
 
 #include "openglrecorder.h"
+#include "core/jpg_buffer_pool.hpp"
+#include "core/lossless_codec.hpp"
+#include "core/video_output.hpp"
 
 #if defined(_MSC_VER) && _MSC_VER < 1700
     typedef unsigned char    uint8_t;
@@ -26,10 +29,11 @@
 #include <chrono>
 #include <condition_variable>
 #include <cstring>
+#include <future>
 #include <list>
 #include <memory>
 #include <mutex>
-#include <thread>
+#include <string>
 #include <vector>
 
 #include <turbojpeg.h>
@@ -46,6 +50,27 @@ struct AudioEncoderData
     AudioType m_audio_type;
 };
 
+/** The output of a stopped recording with deferred encoding, transcoded and
+ *  muxed by CaptureLibrary::transcodeRecording while the next recording may
+ *  already run. Its MJPEG video and audio are moved aside, so the next
+ *  recording doesn't write over them.
+ */
+struct DeferredRecording
+{
+    RecorderConfig m_config;
+    /* Saved name of the output without extension. */
+    std::string m_name;
+    std::string m_audio;
+    bool m_display_progress;
+};
+
+class BufferArena;
+class CPUGovernor;
+class FrameScaler;
+class GPUYUVConverter;
+struct PipelineStats;
+class WorkerPool;
+
 class CommonAudioData
 {
 public:
@@ -53,8 +78,6 @@ public:
     virtual ~CommonAudioData() {}
 };
 
-typedef std::list<std::tuple<uint8_t*, unsigned, int> > JPGList;
-
 class CaptureLibrary
 {
 private:
@@ -62,27 +85,110 @@ private:
 
     std::atomic_bool m_display_progress, m_sound_stop;
 
+    /* Set when capture stops, the encoders then finish the queued frames as
+     * fast as possible. */
+    std::atomic_bool m_draining;
+
+    /* Set by cancelCapture, queued frames are thrown away and nothing is
+     * saved. */
+    std::atomic_bool m_cancelled;
+
     bool m_destroy;
     std::mutex m_destroy_mutex;
 
+    /* Same as m_destroy, but readable while finalizeRecording holds
+     * m_destroy_mutex, so a deferred transcoding can stop early. */
+    std::atomic_bool m_destroying;
+
     bool m_capturing;
     mutable std::mutex m_capturing_mutex;
 
-    tjhandle m_compress_handle, m_decompress_handle;
+    tjhandle m_compress_handle;
 
-    JPGList m_jpg_list;
-    std::mutex m_jpg_list_mutex;
-    std::condition_variable m_jpg_list_ready;
+    /* The output of the RecorderConfig first, then one for each output
+     * profile. */
+    std::vector<std::unique_ptr<VideoOutput> > m_outputs;
 
     uint8_t* m_fbi;
     int m_frame_type;
+    /* Number of captures in this recording, and the one m_fbi is from, to
+     * link the trace spans of a frame. */
+    uint64_t m_capture_seq, m_fbi_frame;
     std::mutex m_fbi_mutex;
     std::condition_variable m_fbi_ready;
 
-    std::thread m_capture_thread, m_audio_enc_thread, m_video_enc_thread;
+    /* Stages of the current recording running on m_worker_pool. */
+    std::future<void> m_capture_task, m_audio_enc_task, m_finalize_task;
+
+    /* Started by \ref warmup, then by finalizeRecording after each
+     * recording, reset waits for it. */
+    std::future<void> m_warmup_task;
+
+    /* Transcoding of the last recording with deferred encoding, the one of
+     * the next recording waits for it. */
+    std::shared_future<void> m_transcode_task;
 
     uint32_t m_pbo[3];
 
+    uint32_t m_fbo, m_rbo;
+
+    bool m_gpu_scale;
+
+    int m_saved_read_fbo, m_saved_draw_fbo;
+
+    std::unique_ptr<GPUYUVConverter> m_yuv_converter;
+
+    unsigned m_readback_width, m_readback_height;
+
+    /* Pixel format of m_fbi and the pixel buffer objects. */
+    uint32_t m_gl_format, m_gl_type;
+
+    int m_tj_format;
+
+    unsigned m_bpp;
+
+    LosslessPixelLayout m_pixel_layout;
+
+    /* Kinds of frames converted for the outputs, by turbojpeg and by
+     * \ref bmpToLossless. */
+    bool m_jpg_frames, m_lossless_frames;
+
+    std::unique_ptr<WorkerPool> m_worker_pool;
+
+    /* Number of parts each frame is converted in. */
+    unsigned m_conversion_jobs;
+
+    std::unique_ptr<FrameScaler> m_scaler;
+
+    /* One compressor per stripe and the I420 planes they convert into, empty
+     * if frames are not converted in stripes. */
+    std::vector<tjhandle> m_stripe_handles;
+
+    uint8_t* m_yuv_planes;
+
+    std::unique_ptr<JPGBufferPool> m_jpg_pool, m_lossless_pool;
+
+    std::unique_ptr<BufferArena> m_arena;
+
+    std::unique_ptr<PipelineStats> m_stats;
+
+    std::unique_ptr<CPUGovernor> m_cpu_governor;
+
+    std::vector<CaptureRegion> m_pbo_regions[3];
+
+    /* Unchanged frames reported by captureUnchanged while the read back of
+     * each pixel buffer object was in flight, they extend that frame once it
+     * reaches m_fbi. */
+    int m_pbo_extra[3];
+
+    std::vector<CaptureRegion> m_regions;
+
+    std::vector<uint8_t> m_region_buf;
+
+    /* m_need_full_frame is set until a complete frame is copied to m_fbi,
+     * regions are read back as the whole frame buffer until then. */
+    bool m_region_capture, m_need_full_frame;
+
     unsigned m_pbo_use;
 
     std::chrono::high_resolution_clock::time_point m_framerate_timer;
@@ -93,6 +199,44 @@ private:
 
     // ------------------------------------------------------------------------
     int getFrameCount(double rate);
+    // ------------------------------------------------------------------------
+    static void finalizeRecording(CaptureLibrary* cl);
+    // ------------------------------------------------------------------------
+    static void transcodeRecording(CaptureLibrary* cl,
+                                   const DeferredRecording& dr,
+                                   std::shared_future<void> previous);
+    // ------------------------------------------------------------------------
+    static void warmupRecording(CaptureLibrary* cl);
+    // ------------------------------------------------------------------------
+    static void prepareEncoders(CaptureLibrary* cl);
+    // ------------------------------------------------------------------------
+    void allocateMuxerBuffer();
+    // ------------------------------------------------------------------------
+    void initGPUYUV();
+    // ------------------------------------------------------------------------
+    int stripedToJPG(uint8_t* raw, unsigned width, unsigned height,
+                     unsigned pitch, bool bottom_up, uint8_t** jpeg_buffer,
+                     unsigned long* jpeg_size);
+    // ------------------------------------------------------------------------
+    void bindReadBackFrameBuffer();
+    // ------------------------------------------------------------------------
+    void unbindReadBackFrameBuffer();
+    // ------------------------------------------------------------------------
+    /** Size of a row read back by glReadPixels with the default
+     *  GL_PACK_ALIGNMENT of 4. */
+    unsigned getRowSize(unsigned width) const
+                                         { return (width * m_bpp + 3) & ~3u; }
+    // ------------------------------------------------------------------------
+    void scaleRegion(CaptureRegion* r) const;
+    // ------------------------------------------------------------------------
+    void copyRegions(const uint8_t* src,
+                     const std::vector<CaptureRegion>& regions);
+    // ------------------------------------------------------------------------
+    void readPBO(int pbo);
+    // ------------------------------------------------------------------------
+    void frameReady(int frame_count, uint64_t frame);
+    // ------------------------------------------------------------------------
+    bool flushPBOs();
 
 public:
     // ------------------------------------------------------------------------
@@ -100,21 +244,40 @@ public:
     // ------------------------------------------------------------------------
     ~CaptureLibrary();
     // ------------------------------------------------------------------------
-    void capture();
+    void capture(const CaptureRegion* regions = NULL, unsigned count = 0);
+    // ------------------------------------------------------------------------
+    void captureUnchanged();
     // ------------------------------------------------------------------------
     void reset();
     // ------------------------------------------------------------------------
+    /** Connect the audio recorder, fault in the buffers and create the
+     *  video encoders on m_worker_pool, so \ref reset doesn't have to. */
+    void warmup();
+    // ------------------------------------------------------------------------
+    /** Compress into *jpeg_buffer which must come from the JPEG buffer
+     *  pool, the same for \ref yuvToJPG. frame is the capture traced. */
     int bmpToJPG(uint8_t* raw, unsigned width, unsigned height,
-        uint8_t** jpeg_buffer, unsigned long* jpeg_size);
+                 unsigned pitch, bool bottom_up, uint8_t** jpeg_buffer,
+                 unsigned long* jpeg_size, uint64_t frame);
     // ------------------------------------------------------------------------
-    int yuvConversion(uint8_t* jpeg_buffer, unsigned jpeg_size,
-                      uint8_t* yuv_buffer);
+    int yuvToJPG(uint8_t* yuv, unsigned width, unsigned height,
+                 uint8_t** jpeg_buffer, unsigned long* jpeg_size);
     // ------------------------------------------------------------------------
-    JPGList* getJPGList()                               { return &m_jpg_list; }
+    /** Encode an OGR_VF_LOSSLESS frame into buffer from the pool, in
+     *  \ref m_conversion_jobs stripes at the same time. */
+    int bmpToLossless(uint8_t* raw, unsigned width, unsigned height,
+                      unsigned pitch, bool bottom_up, uint8_t* buffer,
+                      unsigned long* size, uint64_t frame);
     // ------------------------------------------------------------------------
-    std::mutex* getJPGListMutex()                 { return &m_jpg_list_mutex; }
+    /** Decode a JPEG to I420 with the decompressor of the calling thread,
+     *  see \ref VideoOutput::yuvConversion. */
+    int yuvConversion(uint8_t* jpeg_buffer, unsigned jpeg_size,
+                      uint8_t* yuv_buffer, uint64_t frame, tjhandle handle);
     // ------------------------------------------------------------------------
-    std::condition_variable* getJPGListCV()       { return &m_jpg_list_ready; }
+    /** Give a JPEG from \ref VideoOutput::getJPGList back once written, it
+     *  goes back to the pool when all outputs are done with it. */
+    void releaseJPG(uint8_t* jpeg_buffer)
+                                     { JPGBufferPool::release(jpeg_buffer); }
     // ------------------------------------------------------------------------
     bool displayingProgress() const       { return m_display_progress.load(); }
     // ------------------------------------------------------------------------
@@ -126,18 +289,28 @@ public:
         return m_capturing;
     }
     // ------------------------------------------------------------------------
-    void stopCapture()
-    {
-        if (!isCapturing()) return;
-        std::lock_guard<std::mutex> lock(m_fbi_mutex);
-        m_frame_type = -1;
-        m_fbi_ready.notify_one();
-    }
+    void stopCapture();
+    // ------------------------------------------------------------------------
+    void cancelCapture();
+    // ------------------------------------------------------------------------
+    bool isDraining() const                       { return m_draining.load(); }
+    // ------------------------------------------------------------------------
+    bool isCancelled() const                     { return m_cancelled.load(); }
+    // ------------------------------------------------------------------------
+    bool isDestroying() const                   { return m_destroying.load(); }
     // ------------------------------------------------------------------------
     const RecorderConfig& getRecorderConfig() const { return *m_recorder_cfg; }
     // ------------------------------------------------------------------------
     static void captureConversion(CaptureLibrary* cl);
     // ------------------------------------------------------------------------
+    WorkerPool* getWorkerPool() const           { return m_worker_pool.get(); }
+    // ------------------------------------------------------------------------
+    PipelineStats* getStats() const                    { return m_stats.get(); }
+    // ------------------------------------------------------------------------
+    CPUGovernor* getCPUGovernor() const         { return m_cpu_governor.get(); }
+    // ------------------------------------------------------------------------
+    BufferArena* getBufferArena() const                { return m_arena.get(); }
+    // ------------------------------------------------------------------------
     CommonAudioData* getAudioData() const              { return m_audio_data; }
     // ------------------------------------------------------------------------
     void setAudioData(CommonAudioData* data)           { m_audio_data = data; }
@@ -0,0 +1,131 @@
+/* Copyright (c) 2017, libopenglrecorder contributors
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+
+#include "core/cpu_governor.hpp"
+#include "core/pipeline_stats.hpp"
+
+#include <algorithm>
+#include <thread>
+
+#if defined(_WIN32)
+#  define WIN32_LEAN_AND_MEAN
+#  include <windows.h>
+#else
+#  include <time.h>
+#endif
+
+// A thread never waits longer than this at once, and the unused budget
+// saved for bursts (like a key frame) is this long at the allowed cores
+const int64_t MAX_WAIT_NS = 100000000;
+const double MAX_SAVED_NS = 200000000.0;
+
+// ----------------------------------------------------------------------------
+static int64_t toNanoseconds(std::chrono::steady_clock::time_point t)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>
+        (t.time_since_epoch()).count();
+}   // toNanoseconds
+
+// ----------------------------------------------------------------------------
+CPUGovernor::CPUGovernor(unsigned budget, PipelineStats* stats)
+{
+    m_stats = stats;
+    m_cores = budget / 100.0;
+    reset();
+}   // CPUGovernor
+
+// ----------------------------------------------------------------------------
+void CPUGovernor::reset()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_balance = MAX_SAVED_NS * m_cores;
+    m_last_refill = m_window_start = std::chrono::steady_clock::now();
+    m_window_time = 0;
+    m_last_throttle.store(0, std::memory_order_relaxed);
+    m_lifted.store(false);
+}   // reset
+
+// ----------------------------------------------------------------------------
+/** Called with m_mutex locked. */
+void CPUGovernor::refill(std::chrono::steady_clock::time_point now)
+{
+    const double elapsed = (double)std::chrono::duration_cast
+        <std::chrono::nanoseconds>(now - m_last_refill).count();
+    m_last_refill = now;
+    m_balance = std::min(m_balance + elapsed * m_cores,
+        MAX_SAVED_NS * m_cores);
+}   // refill
+
+// ----------------------------------------------------------------------------
+void CPUGovernor::addTime(uint64_t cpu_ns)
+{
+    const std::chrono::steady_clock::time_point now =
+        std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    refill(now);
+    m_balance -= (double)cpu_ns;
+    m_window_time += cpu_ns;
+    const uint64_t window = std::chrono::duration_cast
+        <std::chrono::nanoseconds>(now - m_window_start).count();
+    if (window >= 1000000000)
+    {
+        m_stats->m_cpu_usage.store((unsigned)(m_window_time * 100 / window),
+            std::memory_order_relaxed);
+        m_window_start = now;
+        m_window_time = 0;
+    }
+}   // addTime
+
+// ----------------------------------------------------------------------------
+void CPUGovernor::throttle()
+{
+    if (!isEnabled() || m_lifted.load())
+        return;
+    std::unique_lock<std::mutex> ul(m_mutex);
+    const std::chrono::steady_clock::time_point now =
+        std::chrono::steady_clock::now();
+    refill(now);
+    if (m_balance >= 0.0)
+        return;
+    const int64_t wait = std::min((int64_t)(-m_balance / m_cores),
+        MAX_WAIT_NS);
+    ul.unlock();
+    m_last_throttle.store(toNanoseconds(now), std::memory_order_relaxed);
+    m_stats->m_throttled_time.fetch_add(wait / 1000,
+        std::memory_order_relaxed);
+    std::this_thread::sleep_for(std::chrono::nanoseconds(wait));
+}   // throttle
+
+// ----------------------------------------------------------------------------
+bool CPUGovernor::isOverBudget() const
+{
+    const int64_t last = m_last_throttle.load(std::memory_order_relaxed);
+    return !m_lifted.load() && last != 0 &&
+        toNanoseconds(std::chrono::steady_clock::now()) - last < 1000000000;
+}   // isOverBudget
+
+// ----------------------------------------------------------------------------
+uint64_t CPUGovernor::getThreadTime()
+{
+#if defined(_WIN32)
+    FILETIME creation, exit, kernel, user;
+    if (GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel,
+        &user) == 0)
+        return 0;
+    // 100 nanoseconds units
+    const uint64_t k = ((uint64_t)kernel.dwHighDateTime << 32) |
+        kernel.dwLowDateTime;
+    const uint64_t u = ((uint64_t)user.dwHighDateTime << 32) |
+        user.dwLowDateTime;
+    return (k + u) * 100;
+#else
+    struct timespec ts;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0)
+        return 0;
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}   // getThreadTime
@@ -0,0 +1,109 @@
+/* Copyright (c) 2017, libopenglrecorder contributors
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+
+#ifndef HEADER_CPU_GOVERNOR_HPP
+#define HEADER_CPU_GOVERNOR_HPP
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <stdint.h>
+
+struct PipelineStats;
+
+/** Keep the CPU time of the recording threads within
+ *  \ref RecorderConfig::m_cpu_budget. The threads add the CPU time of each
+ *  frame they work on, which is taken from a budget refilled at the allowed
+ *  number of cores per second of wall time, and a thread overdrawing it
+ *  waits in \ref throttle until it's paid back. While it throttles, the
+ *  video encoder is told to lower its effort by EncoderController.
+ */
+class CPUGovernor
+{
+private:
+    PipelineStats* m_stats;
+
+    /* Allowed cores in nanoseconds of CPU time per nanosecond, 0 for no
+     * limit. */
+    double m_cores;
+
+    std::mutex m_mutex;
+
+    /* Nanoseconds of CPU time which can still be used, negative if
+     * overdrawn. */
+    double m_balance;
+
+    std::chrono::steady_clock::time_point m_last_refill, m_window_start;
+
+    uint64_t m_window_time;
+
+    /* steady_clock time in nanoseconds when throttled last. */
+    std::atomic<int64_t> m_last_throttle;
+
+    /* No limit until the next recording. */
+    std::atomic<bool> m_lifted;
+
+    // ------------------------------------------------------------------------
+    void refill(std::chrono::steady_clock::time_point now);
+
+public:
+    // ------------------------------------------------------------------------
+    /** budget is in percent of a core, 0 for no limit. */
+    CPUGovernor(unsigned budget, PipelineStats* stats);
+    // ------------------------------------------------------------------------
+    /** Start a new recording with the full budget. */
+    void reset();
+    // ------------------------------------------------------------------------
+    /** Stop throttling once capture stops, until \ref reset. */
+    void lift()                                     { m_lifted.store(true); }
+    // ------------------------------------------------------------------------
+    bool isEnabled() const                           { return m_cores > 0.0; }
+    // ------------------------------------------------------------------------
+    void addTime(uint64_t cpu_ns);
+    // ------------------------------------------------------------------------
+    /** Wait until the budget is no longer overdrawn, called by the stages
+     *  between frames. */
+    void throttle();
+    // ------------------------------------------------------------------------
+    /** True if a thread had to wait for the budget in the last second. */
+    bool isOverBudget() const;
+    // ------------------------------------------------------------------------
+    /** CPU time used by this thread in nanoseconds. */
+    static uint64_t getThreadTime();
+
+};
+
+/** Add the CPU time of this thread from its construction to its destruction
+ *  to a CPUGovernor, nothing if it's NULL or without budget.
+ */
+class ScopedCPUTime
+{
+private:
+    CPUGovernor* m_governor;
+
+    uint64_t m_start;
+
+public:
+    // ------------------------------------------------------------------------
+    ScopedCPUTime(CPUGovernor* governor)
+    {
+        m_governor = governor != NULL && governor->isEnabled() ?
+            governor : NULL;
+        m_start = 0;
+        if (m_governor != NULL)
+            m_start = CPUGovernor::getThreadTime();
+    }
+    // ------------------------------------------------------------------------
+    ~ScopedCPUTime()
+    {
+        if (m_governor != NULL)
+            m_governor->addTime(CPUGovernor::getThreadTime() - m_start);
+    }
+
+};
+
+#endif
@@ -0,0 +1,82 @@
+/* Copyright (c) 2017, libopenglrecorder contributors
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+
+#include "core/encoder_controller.hpp"
+#include "core/cpu_governor.hpp"
+#include "core/pipeline_stats.hpp"
+
+// ----------------------------------------------------------------------------
+EncoderController::EncoderController(const RecorderConfig& rc,
+                                     PipelineStats* stats,
+                                     const CPUGovernor* governor)
+{
+    m_stats = stats;
+    m_governor = governor;
+    m_adaptive = rc.m_adaptive_encoder != 0;
+    m_enabled = m_adaptive || m_governor->isEnabled();
+    m_level = 0;
+    m_bitrate = rc.m_video_bitrate;
+    m_frame_budget = 1000000000.0 / rc.m_record_fps;
+    m_average_time = 0.0;
+    m_frames_since_change = 0;
+    m_depth_at_change = 0;
+    // Wait for half a second of frames before judging the last change
+    m_hold_frames = rc.m_record_fps / 2 + 1;
+    m_stats->m_encoder_level.store(0, std::memory_order_relaxed);
+    m_stats->m_encoder_bitrate.store(m_bitrate, std::memory_order_relaxed);
+}   // EncoderController
+
+// ----------------------------------------------------------------------------
+bool EncoderController::update(unsigned queue_depth, uint64_t frame_ns)
+{
+    if (!m_enabled)
+        return false;
+    m_average_time = m_average_time == 0.0 ? (double)frame_ns :
+        m_average_time * 0.9 + (double)frame_ns * 0.1;
+    m_frames_since_change++;
+    if (m_frames_since_change < m_hold_frames)
+        return false;
+
+    unsigned level = m_level;
+    // Falling behind if the backlog doesn't shrink since the last change, or
+    // each frame takes longer than the frame rate allows
+    const bool behind = m_adaptive && ((queue_depth > 2 &&
+        queue_depth >= m_depth_at_change) ||
+        (queue_depth > 0 && m_average_time > m_frame_budget));
+    const bool over_budget = m_governor->isOverBudget();
+    if ((behind || over_budget) && level < MAX_LEVEL)
+    {
+        level++;
+        if (!behind)
+        {
+            m_stats->m_budget_adjustments.fetch_add(1,
+                std::memory_order_relaxed);
+        }
+    }
+    else if (!behind && !over_budget && level > 0 && queue_depth <= 1 &&
+        m_average_time < m_frame_budget * 0.5 &&
+        m_frames_since_change >= m_hold_frames * 4)
+    {
+        level--;
+    }
+    if (level == m_level)
+        return false;
+
+    m_level = level;
+    m_frames_since_change = 0;
+    m_depth_at_change = queue_depth;
+    m_stats->m_encoder_level.store(m_level, std::memory_order_relaxed);
+    m_stats->m_encoder_bitrate.store(getBitrate(), std::memory_order_relaxed);
+    m_stats->m_encoder_adjustments.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}   // update
+
+// ----------------------------------------------------------------------------
+unsigned EncoderController::getBitrate() const
+{
+    return (unsigned)((uint64_t)m_bitrate * (10 - m_level) / 10);
+}   // getBitrate
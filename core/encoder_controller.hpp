@@ -0,0 +1,79 @@
+/* Copyright (c) 2017, libopenglrecorder contributors
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+
+#ifndef HEADER_ENCODER_CONTROLLER_HPP
+#define HEADER_ENCODER_CONTROLLER_HPP
+
+#include "openglrecorder.h"
+
+#include <stdint.h>
+
+class CPUGovernor;
+struct PipelineStats;
+
+/** Feedback control of the speed of a video encoder for
+ *  \ref RecorderConfig::m_adaptive_encoder. From the number of frames
+ *  waiting in front of the encoder and the time taken by each one, it picks
+ *  a level between 0 (the configured settings) and \ref MAX_LEVEL (fastest
+ *  encoding at lowest bitrate), which the encoder maps to its own options.
+ *  It speeds up as soon as the queue keeps growing or the CPUGovernor
+ *  throttles, but only slows down after catching up for a while, so it
+ *  doesn't oscillate.
+ */
+class EncoderController
+{
+public:
+    static const unsigned MAX_LEVEL = 4;
+
+private:
+    PipelineStats* m_stats;
+
+    const CPUGovernor* m_governor;
+
+    /* Reacting to the queue depth, otherwise only to the CPUGovernor. */
+    bool m_adaptive;
+
+    bool m_enabled;
+
+    unsigned m_level;
+
+    unsigned m_bitrate;
+
+    /* Time available for each frame at the recording frame rate. */
+    double m_frame_budget;
+
+    /* Moving average of the time taken by each frame. */
+    double m_average_time;
+
+    unsigned m_frames_since_change;
+
+    unsigned m_depth_at_change;
+
+    unsigned m_hold_frames;
+
+public:
+    // ------------------------------------------------------------------------
+    EncoderController(const RecorderConfig& rc, PipelineStats* stats,
+                      const CPUGovernor* governor);
+    // ------------------------------------------------------------------------
+    /** Call after each frame encoded, with the number of frames left in the
+     *  queue when it was taken and its decoding and encoding time. Return
+     *  true if the level changed, so the encoder has to be reconfigured. */
+    bool update(unsigned queue_depth, uint64_t frame_ns);
+    // ------------------------------------------------------------------------
+    unsigned getLevel() const                               { return m_level; }
+    // ------------------------------------------------------------------------
+    /** Stop adjusting once capture stops, the encoder then keeps its
+     *  settings for draining the queue. */
+    void stop()                                          { m_enabled = false; }
+    // ------------------------------------------------------------------------
+    /** The configured bitrate lowered by 10% per level. */
+    unsigned getBitrate() const;
+
+};
+
+#endif
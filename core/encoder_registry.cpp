@@ -0,0 +1,91 @@
+/* Copyright (c) 2017, libopenglrecorder contributors
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+
+#include "core/encoder_registry.hpp"
+#include "audio/vorbis_encoder.hpp"
+#include "video/mjpeg_writer.hpp"
+#include "video/openh264_encoder.hpp"
+#include "video/vpx_encoder.hpp"
+
+#include <cassert>
+#include <mutex>
+
+namespace Recorder
+{
+    // Indexed by format, a NULL m_create or m_encoder means no encoder
+    VideoEncoderInfo g_video_encoders[OGR_VF_COUNT] = {};
+    AudioEncoderInfo g_audio_encoders[OGR_AF_COUNT] = {};
+    // Recursive as the built-in codecs register themselves while loading
+    std::recursive_mutex g_encoders_mutex;
+    bool g_builtin_encoders_loaded = false;
+    // ------------------------------------------------------------------------
+    /** Explicit list instead of static registrars in each codec, which a
+     *  static build of the library would drop as nothing else uses them. */
+    static void registerBuiltinEncoders()
+    {
+        registerMJPEGWriter();
+        registerOpenH264Encoder();
+        registerVPXEncoders();
+        registerVorbisEncoder();
+    }   // registerBuiltinEncoders
+    // ------------------------------------------------------------------------
+    static void addVideoEncoder(const VideoEncoderInfo& info)
+    {
+        assert(info.m_format < OGR_VF_COUNT && info.m_create != NULL);
+        if (info.m_format < OGR_VF_COUNT)
+            g_video_encoders[info.m_format] = info;
+    }   // addVideoEncoder
+    // ------------------------------------------------------------------------
+    static void addAudioEncoder(const AudioEncoderInfo& info)
+    {
+        assert(info.m_format < OGR_AF_COUNT && info.m_encoder != NULL);
+        if (info.m_format < OGR_AF_COUNT)
+            g_audio_encoders[info.m_format] = info;
+    }   // addAudioEncoder
+    // ------------------------------------------------------------------------
+    /** Call with g_encoders_mutex locked. */
+    static void loadBuiltinEncoders()
+    {
+        if (g_builtin_encoders_loaded)
+            return;
+        g_builtin_encoders_loaded = true;
+        registerBuiltinEncoders();
+    }   // loadBuiltinEncoders
+    // ------------------------------------------------------------------------
+    void registerVideoEncoder(const VideoEncoderInfo& info)
+    {
+        std::lock_guard<std::recursive_mutex> lg(g_encoders_mutex);
+        // Built-in ones first, so they don't replace this one later
+        loadBuiltinEncoders();
+        addVideoEncoder(info);
+    }   // registerVideoEncoder
+    // ------------------------------------------------------------------------
+    void registerAudioEncoder(const AudioEncoderInfo& info)
+    {
+        std::lock_guard<std::recursive_mutex> lg(g_encoders_mutex);
+        loadBuiltinEncoders();
+        addAudioEncoder(info);
+    }   // registerAudioEncoder
+    // ------------------------------------------------------------------------
+    const VideoEncoderInfo* getVideoEncoderInfo(VideoFormat vf)
+    {
+        std::lock_guard<std::recursive_mutex> lg(g_encoders_mutex);
+        loadBuiltinEncoders();
+        if (vf >= OGR_VF_COUNT || g_video_encoders[vf].m_create == NULL)
+            return NULL;
+        return &g_video_encoders[vf];
+    }   // getVideoEncoderInfo
+    // ------------------------------------------------------------------------
+    const AudioEncoderInfo* getAudioEncoderInfo(AudioFormat af)
+    {
+        std::lock_guard<std::recursive_mutex> lg(g_encoders_mutex);
+        loadBuiltinEncoders();
+        if (af >= OGR_AF_COUNT || g_audio_encoders[af].m_encoder == NULL)
+            return NULL;
+        return &g_audio_encoders[af];
+    }   // getAudioEncoderInfo
+};
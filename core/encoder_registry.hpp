@@ -0,0 +1,70 @@
+/* Copyright (c) 2017, libopenglrecorder contributors
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+
+#ifndef HEADER_ENCODER_REGISTRY_HPP
+#define HEADER_ENCODER_REGISTRY_HPP
+
+#include "openglrecorder.h"
+
+struct AudioEncoderData;
+class VideoEncoder;
+
+/** How to encode and mux a VideoFormat. */
+struct VideoEncoderInfo
+{
+    VideoFormat m_format;
+
+    /* Matroska codec ID of the video track. */
+    const char* m_codec_id;
+
+    /* Saved as .webm instead of .mkv. */
+    bool m_webm;
+
+    /* Name of the encoder thread, also used for its trace events. */
+    const char* m_thread_name;
+
+    /* Load the library of the codec if it is not linked, called by
+     * ogrCheckVideoEncoder, NULL if the codec is always available. */
+    bool (*m_load)();
+
+    VideoEncoder* (*m_create)();
+};
+
+/** How to encode and mux an AudioFormat. */
+struct AudioEncoderInfo
+{
+    AudioFormat m_format;
+
+    /* Matroska codec ID of the audio track. */
+    const char* m_codec_id;
+
+    /* Encoder thread, returns 1 if the encoder is available when called
+     * with NULL. */
+    int (*m_encoder)(AudioEncoderData* aed);
+};
+
+/** The registry is internal to the library and keyed on the VideoFormat and
+ *  AudioFormat values of openglrecorder.h: a new codec still needs its own
+ *  value there and a call of its register function added to
+ *  registerBuiltinEncoders, apps cannot register encoders. */
+namespace Recorder
+{
+    /** Add or replace the encoder of info.m_format, call it before the
+     *  recorder is created. The built-in ones are registered by
+     *  registerBuiltinEncoders, each codec adds its own with a register
+     *  function next to it. */
+    void registerVideoEncoder(const VideoEncoderInfo& info);
+    // ------------------------------------------------------------------------
+    void registerAudioEncoder(const AudioEncoderInfo& info);
+    // ------------------------------------------------------------------------
+    /** NULL if no encoder was registered for vf. */
+    const VideoEncoderInfo* getVideoEncoderInfo(VideoFormat vf);
+    // ------------------------------------------------------------------------
+    const AudioEncoderInfo* getAudioEncoderInfo(AudioFormat af);
+};
+
+#endif
@@ -0,0 +1,285 @@
+/* Copyright (c) 2017, libopenglrecorder contributors
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+
+#include "core/frame_scaler.hpp"
+#include "core/worker_pool.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+
+#if defined(_MSC_VER) || defined(__MINGW32__)
+#include <malloc.h>
+#endif
+
+// Weights of each output pixel sum up to 1 << 14
+const unsigned WEIGHT_BITS = 14;
+// Rows are kept with 8 bits of fraction between the two passes
+const unsigned ROW_SHIFT = WEIGHT_BITS - 8;
+const unsigned OUTPUT_SHIFT = WEIGHT_BITS + 8;
+
+// ----------------------------------------------------------------------------
+static uint8_t* alignedAlloc(size_t size)
+{
+#if defined(_MSC_VER) || defined(__MINGW32__)
+    return (uint8_t*)_aligned_malloc(size, 64);
+#else
+    void* ptr = NULL;
+    if (posix_memalign(&ptr, 64, size) != 0)
+        return NULL;
+    return (uint8_t*)ptr;
+#endif
+}   // alignedAlloc
+
+// ----------------------------------------------------------------------------
+static void alignedFree(uint8_t* ptr)
+{
+#if defined(_MSC_VER) || defined(__MINGW32__)
+    _aligned_free(ptr);
+#else
+    free(ptr);
+#endif
+}   // alignedFree
+
+// ----------------------------------------------------------------------------
+FrameScaler::FrameScaler(unsigned src_width, unsigned src_height,
+                         unsigned dst_width, unsigned dst_height,
+                         unsigned bpp, ScaleFilter filter)
+{
+    assert(src_width >= 2 && src_height >= 2);
+    assert(dst_width > 0 && dst_height > 0);
+    m_src_width = src_width;
+    m_src_height = src_height;
+    m_dst_width = dst_width;
+    m_dst_height = dst_height;
+    m_bpp = bpp;
+    // Each row of the output starts at 64 bytes alignment
+    m_pitch = (dst_width * bpp + 63) & ~63u;
+    m_output = alignedAlloc(m_pitch * dst_height);
+    buildContribution(src_width, dst_width, filter, &m_horizontal);
+    buildContribution(src_height, dst_height, filter, &m_vertical);
+}   // FrameScaler
+
+// ----------------------------------------------------------------------------
+FrameScaler::~FrameScaler()
+{
+    alignedFree(m_output);
+}   // ~FrameScaler
+
+// ----------------------------------------------------------------------------
+void FrameScaler::buildContribution(unsigned src, unsigned dst,
+                                    ScaleFilter filter, Contribution* c)
+{
+    const double scale = double(src) / double(dst);
+    c->m_taps = filter == OGR_SF_AREA ?
+        std::min((unsigned)std::ceil(scale) + 1, src) : 2;
+    c->m_start.resize(dst);
+    c->m_weights.assign(dst * c->m_taps, 0);
+    std::vector<double> w(c->m_taps);
+    for (unsigned i = 0; i < dst; i++)
+    {
+        std::fill(w.begin(), w.end(), 0.0);
+        unsigned start = 0;
+        if (filter == OGR_SF_AREA)
+        {
+            // Average of all source pixels covered by this output pixel
+            const double x0 = i * scale;
+            const double x1 = std::min((i + 1) * scale, double(src));
+            start = std::min((unsigned)x0, src - 1);
+            for (unsigned k = 0; k < c->m_taps && start + k < src; k++)
+            {
+                const double overlap = std::min(x1, double(start + k + 1)) -
+                    std::max(x0, double(start + k));
+                if (overlap > 0.0)
+                    w[k] = overlap;
+            }
+        }
+        else
+        {
+            double center = (i + 0.5) * scale - 0.5;
+            center = std::max(0.0, std::min(center, double(src - 1)));
+            start = std::min((unsigned)center, src - 2);
+            const double frac = center - start;
+            w[0] = 1.0 - frac;
+            w[1] = frac;
+        }
+        // Never let the taps read past the last pixel
+        if (start + c->m_taps > src)
+        {
+            const unsigned shift = start + c->m_taps - src;
+            for (unsigned k = c->m_taps; k-- > shift;)
+                w[k] = w[k - shift];
+            for (unsigned k = 0; k < shift; k++)
+                w[k] = 0.0;
+            start -= shift;
+        }
+        double sum = 0.0;
+        for (unsigned k = 0; k < c->m_taps; k++)
+            sum += w[k];
+        unsigned total = 0, biggest = 0;
+        uint16_t* weights = &c->m_weights[i * c->m_taps];
+        for (unsigned k = 0; k < c->m_taps; k++)
+        {
+            weights[k] = (uint16_t)std::floor(w[k] / sum *
+                double(1 << WEIGHT_BITS) + 0.5);
+            total += weights[k];
+            if (weights[k] > weights[biggest])
+                biggest = k;
+        }
+        // Put the rounding error to the biggest weight so they sum up exactly
+        weights[biggest] = (uint16_t)(weights[biggest] +
+            (1 << WEIGHT_BITS) - total);
+        c->m_start[i] = start;
+    }
+}   // buildContribution
+
+// ----------------------------------------------------------------------------
+/** Horizontal pass of one row, with a compile time pixel size the channels
+ *  of a pixel are computed together as one vector.
+ */
+template<unsigned BPP>
+static void scaleRow(const uint32_t* row, const unsigned* starts,
+                     const uint16_t* weights, unsigned taps, unsigned width,
+                     uint8_t* out)
+{
+    for (unsigned x = 0; x < width; x++)
+    {
+        const uint16_t* hw = weights + x * taps;
+        const uint32_t* p = row + starts[x] * BPP;
+        uint32_t sum[BPP] = {};
+        for (unsigned k = 0; k < taps; k++)
+        {
+            for (unsigned c = 0; c < BPP; c++)
+                sum[c] += hw[k] * p[k * BPP + c];
+        }
+        for (unsigned c = 0; c < BPP; c++)
+        {
+            out[x * BPP + c] = (uint8_t)((sum[c] +
+                (1 << (OUTPUT_SHIFT - 1))) >> OUTPUT_SHIFT);
+        }
+    }
+}   // scaleRow
+
+// ----------------------------------------------------------------------------
+void FrameScaler::scaleRows(const uint8_t* src, ptrdiff_t src_stride,
+                            unsigned y0, unsigned y1, uint32_t* row_buffer)
+{
+    const unsigned row_size = m_src_width * m_bpp;
+    const unsigned vt = m_vertical.m_taps;
+    for (unsigned y = y0; y < y1; y++)
+    {
+        // Vertical pass on the whole source row, plain loops over contiguous
+        // bytes so the compiler can vectorize them
+        const unsigned start = m_vertical.m_start[y];
+        const uint16_t* vw = &m_vertical.m_weights[y * vt];
+        const uint8_t* row = src + (ptrdiff_t)start * src_stride;
+        const uint32_t w0 = vw[0];
+        for (unsigned x = 0; x < row_size; x++)
+            row_buffer[x] = w0 * row[x] + (1 << (ROW_SHIFT - 1));
+        for (unsigned k = 1; k < vt; k++)
+        {
+            const uint32_t w = vw[k];
+            if (w == 0)
+                continue;
+            row = src + (ptrdiff_t)(start + k) * src_stride;
+            for (unsigned x = 0; x < row_size; x++)
+                row_buffer[x] += w * row[x];
+        }
+        for (unsigned x = 0; x < row_size; x++)
+            row_buffer[x] >>= ROW_SHIFT;
+
+        uint8_t* out = m_output + (size_t)y * m_pitch;
+        if (m_bpp == 4)
+        {
+            scaleRow<4>(row_buffer, m_horizontal.m_start.data(),
+                m_horizontal.m_weights.data(), m_horizontal.m_taps,
+                m_dst_width, out);
+        }
+        else if (m_bpp == 3)
+        {
+            scaleRow<3>(row_buffer, m_horizontal.m_start.data(),
+                m_horizontal.m_weights.data(), m_horizontal.m_taps,
+                m_dst_width, out);
+        }
+        else
+        {
+            scaleRow<1>(row_buffer, m_horizontal.m_start.data(),
+                m_horizontal.m_weights.data(), m_horizontal.m_taps,
+                m_dst_width, out);
+        }
+    }
+}   // scaleRows
+
+// ----------------------------------------------------------------------------
+void FrameScaler::scale(const uint8_t* src, ptrdiff_t src_stride,
+                        WorkerPool* pool, unsigned jobs)
+{
+    if (pool == NULL || jobs == 0)
+        jobs = 1;
+    if (m_row_buffers.size() < jobs)
+    {
+        m_row_buffers.resize(jobs,
+            std::vector<uint32_t>(m_src_width * m_bpp));
+    }
+    const unsigned rows = (m_dst_height + jobs - 1) / jobs;
+    std::function<void(unsigned)> job = [&](unsigned i)
+    {
+        const unsigned y0 = i * rows;
+        const unsigned y1 = std::min(y0 + rows, m_dst_height);
+        if (y0 < y1)
+            scaleRows(src, src_stride, y0, y1, m_row_buffers[i].data());
+    };
+    if (pool == NULL)
+        job(0);
+    else
+        pool->parallelFor(jobs, job);
+}   // scale
+
+// ----------------------------------------------------------------------------
+YUVScaler::YUVScaler(unsigned src_width, unsigned src_height,
+                     unsigned dst_width, unsigned dst_height,
+                     ScaleFilter filter)
+{
+    m_src_width = src_width;
+    m_src_height = src_height;
+    m_dst_width = dst_width;
+    m_dst_height = dst_height;
+    m_input.resize(src_width * src_height * 3 / 2);
+    m_planes[0].reset(new FrameScaler(src_width, src_height, dst_width,
+        dst_height, 1, filter));
+    for (int i = 1; i < 3; i++)
+    {
+        m_planes[i].reset(new FrameScaler(src_width / 2, src_height / 2,
+            dst_width / 2, dst_height / 2, 1, filter));
+    }
+}   // YUVScaler
+
+// ----------------------------------------------------------------------------
+void YUVScaler::scale(uint8_t* dst)
+{
+    const uint8_t* src = m_input.data();
+    for (int i = 0; i < 3; i++)
+    {
+        const unsigned src_width = i == 0 ? m_src_width : m_src_width / 2;
+        const unsigned src_height = i == 0 ? m_src_height : m_src_height / 2;
+        const unsigned dst_width = i == 0 ? m_dst_width : m_dst_width / 2;
+        const unsigned dst_height = i == 0 ? m_dst_height : m_dst_height / 2;
+        // Called by the encoder threads, so the rows are not split
+        m_planes[i]->scale(src, src_width, NULL, 1);
+        const uint8_t* out = m_planes[i]->getOutput();
+        for (unsigned y = 0; y < dst_height; y++)
+        {
+            memcpy(dst, out + (size_t)y * m_planes[i]->getPitch(),
+                dst_width);
+            dst += dst_width;
+        }
+        src += src_width * src_height;
+    }
+}   // scale
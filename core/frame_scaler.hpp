@@ -0,0 +1,95 @@
+/* Copyright (c) 2017, libopenglrecorder contributors
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+
+#ifndef HEADER_FRAME_SCALER_HPP
+#define HEADER_FRAME_SCALER_HPP
+
+#include "openglrecorder.h"
+
+#include <cstddef>
+#include <memory>
+#include <stdint.h>
+#include <vector>
+
+class WorkerPool;
+
+/** Separable scaler for packed 8-bit pixels (1, 3 or 4 bytes each) using fixed
+ *  point weights, every output row can be computed independently so the rows
+ *  are split between the threads of a \ref WorkerPool.
+ */
+class FrameScaler
+{
+private:
+    struct Contribution
+    {
+        std::vector<unsigned> m_start;
+        std::vector<uint16_t> m_weights;
+        unsigned m_taps;
+    };
+
+    Contribution m_horizontal, m_vertical;
+
+    unsigned m_src_width, m_src_height, m_dst_width, m_dst_height, m_bpp;
+
+    unsigned m_pitch;
+
+    uint8_t* m_output;
+
+    std::vector<std::vector<uint32_t> > m_row_buffers;
+
+    // ------------------------------------------------------------------------
+    static void buildContribution(unsigned src, unsigned dst,
+                                  ScaleFilter filter, Contribution* c);
+    // ------------------------------------------------------------------------
+    void scaleRows(const uint8_t* src, ptrdiff_t src_stride, unsigned y0,
+                   unsigned y1, uint32_t* row_buffer);
+
+public:
+    // ------------------------------------------------------------------------
+    FrameScaler(unsigned src_width, unsigned src_height, unsigned dst_width,
+                unsigned dst_height, unsigned bpp, ScaleFilter filter);
+    // ------------------------------------------------------------------------
+    ~FrameScaler();
+    // ------------------------------------------------------------------------
+    /** Scale the image starting at the row src points to, a negative
+     *  src_stride reads a bottom-up image so the output is top-down. The rows
+     *  are split into jobs parts for the pool. */
+    void scale(const uint8_t* src, ptrdiff_t src_stride, WorkerPool* pool,
+               unsigned jobs);
+    // ------------------------------------------------------------------------
+    uint8_t* getOutput() const                             { return m_output; }
+    // ------------------------------------------------------------------------
+    unsigned getPitch() const                               { return m_pitch; }
+
+};
+
+/** Scale I420 images by scaling each plane on its own, for video outputs
+ *  smaller than the frames of the recording.
+ */
+class YUVScaler
+{
+private:
+    std::unique_ptr<FrameScaler> m_planes[3];
+
+    std::vector<uint8_t> m_input;
+
+    unsigned m_src_width, m_src_height, m_dst_width, m_dst_height;
+
+public:
+    // ------------------------------------------------------------------------
+    YUVScaler(unsigned src_width, unsigned src_height, unsigned dst_width,
+              unsigned dst_height, ScaleFilter filter);
+    // ------------------------------------------------------------------------
+    /** Scale the image in \ref getInput to the I420 image in dst. */
+    void scale(uint8_t* dst);
+    // ------------------------------------------------------------------------
+    /** Buffer for an I420 image of the source size. */
+    uint8_t* getInput()                               { return m_input.data(); }
+
+};
+
+#endif
@@ -0,0 +1,55 @@
+/* Copyright (c) 2017, libopenglrecorder contributors
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+
+#ifndef HEADER_GL_CONSTANTS_HPP
+#define HEADER_GL_CONSTANTS_HPP
+
+#include <stdint.h>
+
+const uint32_t E_GL_PIXEL_PACK_BUFFER = 0x88EB;
+const uint32_t E_GL_STREAM_READ = 0x88E1;
+const uint32_t E_GL_READ_ONLY = 0x88B8;
+const uint32_t E_GL_RGBA = 0x1908;
+const uint32_t E_GL_BGRA = 0x80E1;
+const uint32_t E_GL_RGB = 0x1907;
+const uint32_t E_GL_BGR = 0x80E0;
+const uint32_t E_GL_UNSIGNED_BYTE = 0x1401;
+const uint32_t E_GL_UNSIGNED_INT_8_8_8_8_REV = 0x8367;
+const uint32_t E_GL_MAP_READ_BIT = 0x0001;
+const uint32_t E_GL_FRAMEBUFFER = 0x8D40;
+const uint32_t E_GL_READ_FRAMEBUFFER = 0x8CA8;
+const uint32_t E_GL_DRAW_FRAMEBUFFER = 0x8CA9;
+const uint32_t E_GL_READ_FRAMEBUFFER_BINDING = 0x8CAA;
+const uint32_t E_GL_DRAW_FRAMEBUFFER_BINDING = 0x8CA6;
+const uint32_t E_GL_RENDERBUFFER = 0x8D41;
+const uint32_t E_GL_RGBA8 = 0x8058;
+const uint32_t E_GL_COLOR_ATTACHMENT0 = 0x8CE0;
+const uint32_t E_GL_COLOR_BUFFER_BIT = 0x00004000;
+const uint32_t E_GL_LINEAR = 0x2601;
+const uint32_t E_GL_TEXTURE_2D = 0x0DE1;
+const uint32_t E_GL_TEXTURE_BINDING_2D = 0x8069;
+const uint32_t E_GL_TEXTURE_MAG_FILTER = 0x2800;
+const uint32_t E_GL_TEXTURE_MIN_FILTER = 0x2801;
+const uint32_t E_GL_TEXTURE_WRAP_S = 0x2802;
+const uint32_t E_GL_TEXTURE_WRAP_T = 0x2803;
+const uint32_t E_GL_CLAMP_TO_EDGE = 0x812F;
+const uint32_t E_GL_ACTIVE_TEXTURE = 0x84E0;
+const uint32_t E_GL_TEXTURE0 = 0x84C0;
+const uint32_t E_GL_VERTEX_SHADER = 0x8B31;
+const uint32_t E_GL_FRAGMENT_SHADER = 0x8B30;
+const uint32_t E_GL_LINK_STATUS = 0x8B82;
+const uint32_t E_GL_CURRENT_PROGRAM = 0x8B8D;
+const uint32_t E_GL_VERTEX_ARRAY_BINDING = 0x85B5;
+const uint32_t E_GL_VIEWPORT = 0x0BA2;
+const uint32_t E_GL_TRIANGLES = 0x0004;
+const uint32_t E_GL_BLEND = 0x0BE2;
+const uint32_t E_GL_CULL_FACE = 0x0B44;
+const uint32_t E_GL_DEPTH_TEST = 0x0B71;
+const uint32_t E_GL_SCISSOR_TEST = 0x0C11;
+const uint32_t E_GL_STENCIL_TEST = 0x0B90;
+
+#endif
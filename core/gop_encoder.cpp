@@ -0,0 +1,178 @@
+/* Copyright (c) 2017, libopenglrecorder contributors
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+
+#include "core/gop_encoder.hpp"
+#include "core/capture_library.hpp"
+#include "core/frame_scaler.hpp"
+#include "core/recorder_private.hpp"
+#include "core/trace_recorder.hpp"
+#include "core/worker_pool.hpp"
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <thread>
+
+namespace Recorder
+{
+    // ------------------------------------------------------------------------
+    static std::string getGOPName(VideoOutput* vo, unsigned gop)
+    {
+        return vo->getName() + ".gop" + std::to_string(gop);
+    }   // getGOPName
+    // ------------------------------------------------------------------------
+    /** Append the encoded group to the video and remove its file. */
+    static bool appendGOP(VideoOutput* vo, unsigned gop, FILE* out)
+    {
+        const std::string name = getGOPName(vo, gop);
+        FILE* input = fopen(name.c_str(), "rb");
+        if (input == NULL)
+            return false;
+        char buf[65536];
+        size_t readed;
+        bool ok = true;
+        while ((readed = fread(buf, 1, sizeof(buf), input)) > 0)
+        {
+            if (fwrite(buf, 1, readed, out) != readed)
+            {
+                ok = false;
+                break;
+            }
+        }
+        fclose(input);
+        remove(name.c_str());
+        return ok;
+    }   // appendGOP
+    // ------------------------------------------------------------------------
+    /** True if the queued frames are worth encoding as parallel groups of
+     *  pictures, called when the encoder starts draining. */
+    bool useParallelGOPs(CaptureLibrary* cl, VideoOutput* vo,
+                         unsigned queue_depth)
+    {
+        const unsigned gop_size = vo->getRecorderConfig().m_parallel_gop;
+        return gop_size > 0 && !cl->isCancelled() &&
+            queue_depth >= gop_size * 2;
+    }   // useParallelGOPs
+    // ------------------------------------------------------------------------
+    /** Take the whole backlog once capture has stopped, split it into groups
+     *  of \ref RecorderConfig::m_parallel_gop frames and encode each with
+     *  encode_gop on its own thread. The groups are written to out in order
+     *  with continuous frame indices, the next frame index is returned. */
+    int64_t encodeParallelGOPs(CaptureLibrary* cl, VideoOutput* vo,
+                               int64_t frames_encoded, FILE* out,
+                               const GOPFunction& encode_gop)
+    {
+        // The backlog is complete when finalizeRecording adds the end marker
+        std::vector<GOPFrame> frames;
+        std::unique_lock<std::mutex> ul(*vo->getJPGListMutex());
+        vo->getJPGListCV()->wait(ul, [&vo]
+            {
+                return !vo->getJPGList()->empty() &&
+                    std::get<0>(vo->getJPGList()->back()) == NULL &&
+                    std::get<2>(vo->getJPGList()->back()) == 0;
+            });
+        for (auto& p : *vo->getJPGList())
+        {
+            if (std::get<0>(p) != NULL)
+            {
+                GOPFrame gf = { std::get<0>(p), std::get<1>(p),
+                    frames_encoded };
+                frames.push_back(gf);
+            }
+            frames_encoded += std::get<2>(p);
+        }
+        vo->getJPGList()->clear();
+        ul.unlock();
+        if (frames.empty())
+            return frames_encoded;
+
+        const unsigned gop_size = vo->getRecorderConfig().m_parallel_gop;
+        const unsigned gop_count =
+            (unsigned)((frames.size() + gop_size - 1) / gop_size);
+        const unsigned instances = std::min(gop_count,
+            std::max(std::thread::hardware_concurrency(), 1u));
+        const unsigned yuv_size = vo->getRecorderConfig().m_output_width *
+            vo->getRecorderConfig().m_output_height * 3 / 2;
+        std::vector<bool> encoded(gop_count, false);
+        std::mutex progress_mutex;
+        unsigned next_gop = 0, finished = 0;
+        // Every instance takes the next group until none is left, only the
+        // encoder thread reports progress
+        auto run_instances = [&](bool report)
+        {
+            tjhandle handle = tjInitDecompress();
+            std::unique_ptr<YUVScaler> scaler(vo->createScaler());
+            std::vector<uint8_t> yuv(yuv_size);
+            while (true)
+            {
+                std::unique_lock<std::mutex> ulp(progress_mutex);
+                const unsigned gop = next_gop++;
+                ulp.unlock();
+                if (gop >= gop_count)
+                    break;
+                const unsigned first = gop * gop_size;
+                const unsigned count = std::min(gop_size,
+                    (unsigned)frames.size() - first);
+                bool ok = false;
+                if (!cl->isCancelled() && handle != NULL)
+                {
+                    FILE* gop_data = fopen(getGOPName(vo, gop).c_str(),
+                        "wb");
+                    if (gop_data != NULL)
+                    {
+                        OGR_TRACE("gopEncode", frames[first].m_frame_index);
+                        ok = encode_gop(&frames[first], count, handle,
+                            scaler.get(), yuv.data(), gop_data);
+                        fclose(gop_data);
+                    }
+                }
+                for (unsigned i = first; i < first + count; i++)
+                    cl->releaseJPG(frames[i].m_jpg);
+                ulp.lock();
+                encoded[gop] = ok;
+                const unsigned done = ++finished;
+                ulp.unlock();
+                if (report && vo->displayingProgress())
+                {
+                    int rate = (int)(done * 99ull / gop_count);
+                    runCallback(OGR_CBT_PROGRESS_RECORDING, &rate);
+                }
+            }
+            if (handle != NULL)
+                tjDestroy(handle);
+        };
+        std::vector<std::future<void> > helpers;
+        for (unsigned i = 1; i < instances; i++)
+        {
+            helpers.push_back(cl->getWorkerPool()->submit([&run_instances]()
+                {
+                    setThreadName("gopEncoder");
+                    applyThreadConfig(OGR_TS_VIDEO_ENCODER);
+                    run_instances(false);
+                }));
+        }
+        run_instances(true);
+        for (std::future<void>& helper : helpers)
+            helper.wait();
+
+        bool failed = false;
+        for (unsigned gop = 0; gop < gop_count; gop++)
+        {
+            if (!encoded[gop] || !appendGOP(vo, gop, out))
+            {
+                failed = failed || !cl->isCancelled();
+                remove(getGOPName(vo, gop).c_str());
+            }
+        }
+        if (failed)
+        {
+            runCallback(OGR_CBT_ERROR_RECORDING, "Failed to encode some"
+                " groups of pictures in parallel.\n");
+        }
+        return frames_encoded;
+    }   // encodeParallelGOPs
+};
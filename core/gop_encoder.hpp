@@ -0,0 +1,46 @@
+/* Copyright (c) 2017, libopenglrecorder contributors
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+
+#ifndef HEADER_GOP_ENCODER_HPP
+#define HEADER_GOP_ENCODER_HPP
+
+#include <cstdio>
+#include <functional>
+#include <stdint.h>
+#include <turbojpeg.h>
+
+class CaptureLibrary;
+class VideoOutput;
+class YUVScaler;
+
+/** A JPEG of the backlog and its index in the video. */
+struct GOPFrame
+{
+    uint8_t* m_jpg;
+    unsigned m_jpg_size;
+    int64_t m_frame_index;
+};
+
+namespace Recorder
+{
+    /** Encode a group of pictures with a new encoder, so it starts with a
+     *  key frame, and write it to out like the .video file. The JPEG
+     *  decompressor, the scaler (NULL for an output of full size) and the
+     *  yuv buffer belong to the calling thread. */
+    typedef std::function<bool(const GOPFrame* frames, unsigned count,
+        tjhandle handle, YUVScaler* scaler, uint8_t* yuv, FILE* out)>
+        GOPFunction;
+    // ------------------------------------------------------------------------
+    bool useParallelGOPs(CaptureLibrary* cl, VideoOutput* vo,
+                         unsigned queue_depth);
+    // ------------------------------------------------------------------------
+    int64_t encodeParallelGOPs(CaptureLibrary* cl, VideoOutput* vo,
+                               int64_t frames_encoded, FILE* out,
+                               const GOPFunction& encode_gop);
+};
+
+#endif
@@ -0,0 +1,231 @@
+/* Copyright (c) 2017, libopenglrecorder contributors
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+
+#include "core/gpu_yuv_converter.hpp"
+#include "core/gl_constants.hpp"
+#include "core/recorder_private.hpp"
+
+#include <cassert>
+
+// gl_VertexID needs GLSL 1.30, try the versions of OpenGL 3.0, 3.2 core
+// profile and OpenGL ES 3.0 until one links
+const char* const g_glsl_versions[] =
+{
+    "#version 130\n",
+    "#version 150\n",
+    "#version 300 es\n"
+};
+
+// A triangle covering the whole viewport, without any vertex buffer
+const char* const g_vertex_shader =
+    "void main()\n"
+    "{\n"
+    "    gl_Position = vec4(gl_VertexID == 1 ? 3.0 : -1.0,\n"
+    "        gl_VertexID == 2 ? 3.0 : -1.0, 0.0, 1.0);\n"
+    "}\n";
+
+// Each output texel holds 4 bytes of the I420 image: rows [0, h) are the Y
+// plane, followed by h / 4 rows of U and h / 4 rows of V (2 chroma rows per
+// texel row). The image is top-down while the texture is bottom-up, and full
+// range BT.601 is used like JPEG.
+const char* const g_fragment_shader =
+    "#ifdef GL_ES\n"
+    "precision highp float;\n"
+    "#endif\n"
+    "uniform sampler2D u_frame;\n"
+    "uniform vec4 u_size;\n"
+    "out vec4 o_color;\n"
+    "const vec3 Y_COEF = vec3(0.299, 0.587, 0.114);\n"
+    "const vec3 U_COEF = vec3(-0.168736, -0.331264, 0.5);\n"
+    "const vec3 V_COEF = vec3(0.5, -0.418688, -0.081312);\n"
+    "vec3 fetch(float x, float y)\n"
+    "{\n"
+    "    return texture(u_frame, vec2(x * u_size.z, 1.0 - y * u_size.w))"
+    ".rgb;\n"
+    "}\n"
+    "void main()\n"
+    "{\n"
+    "    float x = floor(gl_FragCoord.x) * 4.0;\n"
+    "    float row = floor(gl_FragCoord.y);\n"
+    "    if (row < u_size.y)\n"
+    "    {\n"
+    "        float y = row + 0.5;\n"
+    "        o_color = vec4(dot(fetch(x + 0.5, y), Y_COEF),\n"
+    "            dot(fetch(x + 1.5, y), Y_COEF),\n"
+    "            dot(fetch(x + 2.5, y), Y_COEF),\n"
+    "            dot(fetch(x + 3.5, y), Y_COEF));\n"
+    "        return;\n"
+    "    }\n"
+    "    row -= u_size.y;\n"
+    "    vec3 coef = U_COEF;\n"
+    "    if (row >= u_size.y * 0.25)\n"
+    "    {\n"
+    "        row -= u_size.y * 0.25;\n"
+    "        coef = V_COEF;\n"
+    "    }\n"
+    "    row *= 2.0;\n"
+    "    if (x >= u_size.x * 0.5)\n"
+    "    {\n"
+    "        x -= u_size.x * 0.5;\n"
+    "        row += 1.0;\n"
+    "    }\n"
+    // Sample the center of each 2x2 block, the linear filter averages it
+    "    x = x * 2.0 + 1.0;\n"
+    "    float y = row * 2.0 + 1.0;\n"
+    "    o_color = vec4(dot(fetch(x, y), coef),\n"
+    "        dot(fetch(x + 2.0, y), coef),\n"
+    "        dot(fetch(x + 4.0, y), coef),\n"
+    "        dot(fetch(x + 6.0, y), coef)) + 128.0 / 255.0;\n"
+    "}\n";
+
+const uint32_t g_saved_caps[5] =
+{
+    E_GL_BLEND, E_GL_CULL_FACE, E_GL_DEPTH_TEST, E_GL_SCISSOR_TEST,
+    E_GL_STENCIL_TEST
+};
+
+// ----------------------------------------------------------------------------
+GPUYUVConverter::GPUYUVConverter(unsigned width, unsigned height,
+                                 unsigned output_width,
+                                 unsigned output_height)
+{
+    assert(output_width % 8 == 0 && output_height % 4 == 0);
+    m_width = width;
+    m_height = height;
+    m_output_width = output_width;
+    m_output_height = output_height;
+    m_texture = m_fbo = m_rbo = m_vao = 0;
+    m_ready = false;
+    m_program = compileProgram();
+    if (m_program == 0)
+        return;
+
+    int texture = 0;
+    ogrGetIntegerv(E_GL_TEXTURE_BINDING_2D, &texture);
+    ogrGenTextures(1, &m_texture);
+    ogrBindTexture(E_GL_TEXTURE_2D, m_texture);
+    ogrTexImage2D(E_GL_TEXTURE_2D, 0, E_GL_RGBA8, m_width, m_height, 0,
+        E_GL_RGBA, E_GL_UNSIGNED_BYTE, NULL);
+    ogrTexParameteri(E_GL_TEXTURE_2D, E_GL_TEXTURE_MIN_FILTER, E_GL_LINEAR);
+    ogrTexParameteri(E_GL_TEXTURE_2D, E_GL_TEXTURE_MAG_FILTER, E_GL_LINEAR);
+    ogrTexParameteri(E_GL_TEXTURE_2D, E_GL_TEXTURE_WRAP_S,
+        E_GL_CLAMP_TO_EDGE);
+    ogrTexParameteri(E_GL_TEXTURE_2D, E_GL_TEXTURE_WRAP_T,
+        E_GL_CLAMP_TO_EDGE);
+    ogrBindTexture(E_GL_TEXTURE_2D, texture);
+
+    int draw_fbo = 0;
+    ogrGetIntegerv(E_GL_DRAW_FRAMEBUFFER_BINDING, &draw_fbo);
+    ogrGenRenderbuffers(1, &m_rbo);
+    ogrBindRenderbuffer(E_GL_RENDERBUFFER, m_rbo);
+    ogrRenderbufferStorage(E_GL_RENDERBUFFER, E_GL_RGBA8, getReadbackWidth(),
+        getReadbackHeight());
+    ogrBindRenderbuffer(E_GL_RENDERBUFFER, 0);
+    ogrGenFramebuffers(1, &m_fbo);
+    ogrBindFramebuffer(E_GL_DRAW_FRAMEBUFFER, m_fbo);
+    ogrFramebufferRenderbuffer(E_GL_DRAW_FRAMEBUFFER, E_GL_COLOR_ATTACHMENT0,
+        E_GL_RENDERBUFFER, m_rbo);
+    ogrBindFramebuffer(E_GL_DRAW_FRAMEBUFFER, draw_fbo);
+
+    ogrGenVertexArrays(1, &m_vao);
+    int program = 0;
+    ogrGetIntegerv(E_GL_CURRENT_PROGRAM, &program);
+    ogrUseProgram(m_program);
+    m_frame_location = ogrGetUniformLocation(m_program, "u_frame");
+    ogrUniform4f(ogrGetUniformLocation(m_program, "u_size"),
+        (float)m_output_width, (float)m_output_height,
+        1.0f / (float)m_output_width, 1.0f / (float)m_output_height);
+    ogrUseProgram(program);
+    m_ready = true;
+}   // GPUYUVConverter
+
+// ----------------------------------------------------------------------------
+GPUYUVConverter::~GPUYUVConverter()
+{
+    if (m_program == 0)
+        return;
+    ogrDeleteProgram(m_program);
+    ogrDeleteTextures(1, &m_texture);
+    ogrDeleteFramebuffers(1, &m_fbo);
+    ogrDeleteRenderbuffers(1, &m_rbo);
+    ogrDeleteVertexArrays(1, &m_vao);
+}   // ~GPUYUVConverter
+
+// ----------------------------------------------------------------------------
+uint32_t GPUYUVConverter::compileProgram()
+{
+    for (const char* version : g_glsl_versions)
+    {
+        uint32_t vs = ogrCreateShader(E_GL_VERTEX_SHADER);
+        const char* vs_source[2] = { version, g_vertex_shader };
+        ogrShaderSource(vs, 2, vs_source, NULL);
+        ogrCompileShader(vs);
+        uint32_t fs = ogrCreateShader(E_GL_FRAGMENT_SHADER);
+        const char* fs_source[2] = { version, g_fragment_shader };
+        ogrShaderSource(fs, 2, fs_source, NULL);
+        ogrCompileShader(fs);
+        uint32_t program = ogrCreateProgram();
+        ogrAttachShader(program, vs);
+        ogrAttachShader(program, fs);
+        ogrLinkProgram(program);
+        // Shaders are freed together with the program
+        ogrDeleteShader(vs);
+        ogrDeleteShader(fs);
+        int linked = 0;
+        ogrGetProgramiv(program, E_GL_LINK_STATUS, &linked);
+        if (linked != 0)
+            return program;
+        ogrDeleteProgram(program);
+    }
+    return 0;
+}   // compileProgram
+
+// ----------------------------------------------------------------------------
+void GPUYUVConverter::convert()
+{
+    ogrGetIntegerv(E_GL_VIEWPORT, m_viewport);
+    ogrGetIntegerv(E_GL_CURRENT_PROGRAM, &m_saved_program);
+    ogrGetIntegerv(E_GL_TEXTURE_BINDING_2D, &m_saved_texture);
+    ogrGetIntegerv(E_GL_VERTEX_ARRAY_BINDING, &m_saved_vao);
+    ogrGetIntegerv(E_GL_READ_FRAMEBUFFER_BINDING, &m_saved_read_fbo);
+    ogrGetIntegerv(E_GL_DRAW_FRAMEBUFFER_BINDING, &m_saved_draw_fbo);
+    for (unsigned i = 0; i < 5; i++)
+    {
+        m_saved_caps[i] = ogrIsEnabled(g_saved_caps[i]);
+        if (m_saved_caps[i] != 0)
+            ogrDisable(g_saved_caps[i]);
+    }
+    // Sample from whatever texture unit is active
+    int active_texture = E_GL_TEXTURE0;
+    ogrGetIntegerv(E_GL_ACTIVE_TEXTURE, &active_texture);
+
+    ogrBindTexture(E_GL_TEXTURE_2D, m_texture);
+    ogrCopyTexSubImage2D(E_GL_TEXTURE_2D, 0, 0, 0, 0, 0, m_width, m_height);
+    ogrBindFramebuffer(E_GL_DRAW_FRAMEBUFFER, m_fbo);
+    ogrViewport(0, 0, getReadbackWidth(), getReadbackHeight());
+    ogrUseProgram(m_program);
+    ogrUniform1i(m_frame_location, active_texture - E_GL_TEXTURE0);
+    ogrBindVertexArray(m_vao);
+    ogrDrawArrays(E_GL_TRIANGLES, 0, 3);
+    ogrBindFramebuffer(E_GL_READ_FRAMEBUFFER, m_fbo);
+}   // convert
+
+// ----------------------------------------------------------------------------
+void GPUYUVConverter::restore()
+{
+    ogrBindFramebuffer(E_GL_READ_FRAMEBUFFER, m_saved_read_fbo);
+    ogrBindFramebuffer(E_GL_DRAW_FRAMEBUFFER, m_saved_draw_fbo);
+    ogrBindVertexArray(m_saved_vao);
+    ogrUseProgram(m_saved_program);
+    ogrBindTexture(E_GL_TEXTURE_2D, m_saved_texture);
+    ogrViewport(m_viewport[0], m_viewport[1], m_viewport[2], m_viewport[3]);
+    for (unsigned i = 0; i < 5; i++)
+    {
+        if (m_saved_caps[i] != 0)
+            ogrEnable(g_saved_caps[i]);
+    }
+}   // restore
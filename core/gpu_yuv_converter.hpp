@@ -0,0 +1,62 @@
+/* Copyright (c) 2017, libopenglrecorder contributors
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+
+#ifndef HEADER_GPU_YUV_CONVERTER_HPP
+#define HEADER_GPU_YUV_CONVERTER_HPP
+
+#include <stdint.h>
+
+/** Draw the frame buffer with a shader into a RGBA8 render buffer of
+ *  width / 4 x height * 3 / 2, which packs the Y, U and V planes of a top-down
+ *  I420 image one after another, so reading it back with glReadPixels gives
+ *  the planar image directly. Scaling to the output size is done by the
+ *  linear texture filter.
+ */
+class GPUYUVConverter
+{
+private:
+    unsigned m_width, m_height, m_output_width, m_output_height;
+
+    uint32_t m_texture, m_fbo, m_rbo, m_vao, m_program;
+
+    int m_frame_location;
+
+    bool m_ready;
+
+    /* Opengl states changed by convert, restored by restore. */
+    int m_viewport[4];
+
+    int m_saved_program, m_saved_texture, m_saved_vao, m_saved_read_fbo,
+        m_saved_draw_fbo;
+
+    unsigned char m_saved_caps[5];
+
+    // ------------------------------------------------------------------------
+    uint32_t compileProgram();
+
+public:
+    // ------------------------------------------------------------------------
+    GPUYUVConverter(unsigned width, unsigned height, unsigned output_width,
+                    unsigned output_height);
+    // ------------------------------------------------------------------------
+    ~GPUYUVConverter();
+    // ------------------------------------------------------------------------
+    /** Draw the current read frame buffer into the packed YUV render buffer
+     *  and bind it for reading, call \ref restore after reading it back. */
+    void convert();
+    // ------------------------------------------------------------------------
+    void restore();
+    // ------------------------------------------------------------------------
+    bool isReady() const                                    { return m_ready; }
+    // ------------------------------------------------------------------------
+    unsigned getReadbackWidth() const          { return m_output_width / 4; }
+    // ------------------------------------------------------------------------
+    unsigned getReadbackHeight() const    { return m_output_height * 3 / 2; }
+
+};
+
+#endif
@@ -0,0 +1,105 @@
+/* Copyright (c) 2017, libopenglrecorder contributors
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+
+#include "core/jpg_buffer_pool.hpp"
+
+#include <atomic>
+#include <new>
+#include <turbojpeg.h>
+
+// Enough for the frames usually waiting for the encoder, buffers of a longer
+// backlog are freed so the worst case sized buffers don't pile up
+const unsigned MAX_FREE_BUFFERS = 4;
+
+// In front of the data of each buffer, turbojpeg never reallocates the
+// buffers with TJFLAG_NOREALLOC so it never sees the real start
+struct BufferHeader
+{
+    std::atomic<unsigned> m_refs;
+    JPGBufferPool* m_pool;
+};
+
+// Keeps the alignment of tjAlloc for the data
+const size_t HEADER_SIZE = 32;
+static_assert(sizeof(BufferHeader) <= HEADER_SIZE, "Header too large");
+
+// ----------------------------------------------------------------------------
+static inline BufferHeader* getHeader(uint8_t* buffer)
+{
+    return (BufferHeader*)(buffer - HEADER_SIZE);
+}   // getHeader
+
+// ----------------------------------------------------------------------------
+JPGBufferPool::JPGBufferPool(unsigned long buffer_size)
+{
+    m_buffer_size = buffer_size;
+}   // JPGBufferPool
+
+// ----------------------------------------------------------------------------
+JPGBufferPool::~JPGBufferPool()
+{
+    for (uint8_t* buffer : m_free_buffers)
+    {
+        getHeader(buffer)->~BufferHeader();
+        tjFree(buffer - HEADER_SIZE);
+    }
+}   // ~JPGBufferPool
+
+// ----------------------------------------------------------------------------
+uint8_t* JPGBufferPool::acquire()
+{
+    std::unique_lock<std::mutex> ul(m_mutex);
+    uint8_t* buffer = NULL;
+    if (!m_free_buffers.empty())
+    {
+        buffer = m_free_buffers.back();
+        m_free_buffers.pop_back();
+        ul.unlock();
+    }
+    else
+    {
+        ul.unlock();
+        uint8_t* data = tjAlloc((int)(m_buffer_size + HEADER_SIZE));
+        if (data == NULL)
+            return NULL;
+        buffer = data + HEADER_SIZE;
+        BufferHeader* header = new (data) BufferHeader;
+        header->m_pool = this;
+    }
+    getHeader(buffer)->m_refs.store(1);
+    return buffer;
+}   // acquire
+
+// ----------------------------------------------------------------------------
+void JPGBufferPool::addRef(uint8_t* buffer, unsigned count)
+{
+    getHeader(buffer)->m_refs.fetch_add(count);
+}   // addRef
+
+// ----------------------------------------------------------------------------
+void JPGBufferPool::release(uint8_t* buffer)
+{
+    if (buffer == NULL)
+        return;
+    BufferHeader* header = getHeader(buffer);
+    if (header->m_refs.fetch_sub(1) == 1)
+        header->m_pool->recycle(buffer);
+}   // release
+
+// ----------------------------------------------------------------------------
+void JPGBufferPool::recycle(uint8_t* buffer)
+{
+    std::unique_lock<std::mutex> ul(m_mutex);
+    if (m_free_buffers.size() < MAX_FREE_BUFFERS)
+    {
+        m_free_buffers.push_back(buffer);
+        return;
+    }
+    ul.unlock();
+    getHeader(buffer)->~BufferHeader();
+    tjFree(buffer - HEADER_SIZE);
+}   // recycle
@@ -0,0 +1,55 @@
+/* Copyright (c) 2017, libopenglrecorder contributors
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+
+#ifndef HEADER_JPG_BUFFER_POOL_HPP
+#define HEADER_JPG_BUFFER_POOL_HPP
+
+#include <mutex>
+#include <stdint.h>
+#include <vector>
+
+/** Recycle JPEG output buffers of the worst case size for a frame, so that
+ *  turbojpeg can compress into them with TJFLAG_NOREALLOC instead of
+ *  allocating a new buffer for each frame. Lossless frames use it the same
+ *  with their own worst case size. Each buffer is reference counted, so a
+ *  frame can be queued for several video outputs and is recycled when the
+ *  last one releases it.
+ */
+class JPGBufferPool
+{
+private:
+    unsigned long m_buffer_size;
+
+    std::vector<uint8_t*> m_free_buffers;
+
+    std::mutex m_mutex;
+
+    // ------------------------------------------------------------------------
+    void recycle(uint8_t* buffer);
+
+public:
+    // ------------------------------------------------------------------------
+    JPGBufferPool(unsigned long buffer_size);
+    // ------------------------------------------------------------------------
+    ~JPGBufferPool();
+    // ------------------------------------------------------------------------
+    /** Return a buffer of \ref getBufferSize bytes with one reference, or
+     *  NULL if out of memory. */
+    uint8_t* acquire();
+    // ------------------------------------------------------------------------
+    /** Add count references to a buffer from \ref acquire. */
+    static void addRef(uint8_t* buffer, unsigned count);
+    // ------------------------------------------------------------------------
+    /** Drop a reference of a buffer from any pool, it goes back to its pool
+     *  without references left. NULL is ignored. */
+    static void release(uint8_t* buffer);
+    // ------------------------------------------------------------------------
+    unsigned long getBufferSize() const               { return m_buffer_size; }
+
+};
+
+#endif
@@ -0,0 +1,288 @@
+/* Copyright (c) 2017, libopenglrecorder contributors
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+
+#include "core/lossless_codec.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+// Chunks of QOI, RGBA is never written as alpha is always opaque
+const uint8_t QOI_OP_INDEX = 0x00;
+const uint8_t QOI_OP_DIFF = 0x40;
+const uint8_t QOI_OP_LUMA = 0x80;
+const uint8_t QOI_OP_RUN = 0xc0;
+const uint8_t QOI_OP_RGB = 0xfe;
+const uint8_t QOI_OP_RGBA = 0xff;
+const uint8_t QOI_MASK = 0xc0;
+const unsigned QOI_MAX_RUN = 62;
+
+// Width, height and number of stripes
+const size_t HEADER_SIZE = 3 * sizeof(uint32_t);
+
+// Pixels are packed as r | g << 8 | b << 16 | a << 24, so the initial
+// zeroed index never matches an opaque pixel
+const uint32_t OPAQUE_BLACK = 0xff000000u;
+
+// ----------------------------------------------------------------------------
+static inline unsigned getHash(uint32_t px)
+{
+    return ((px & 0xff) * 3 + ((px >> 8) & 0xff) * 5 +
+        ((px >> 16) & 0xff) * 7 + (px >> 24) * 11) % 64;
+}   // getHash
+
+// ----------------------------------------------------------------------------
+static inline void writeUInt32(uint8_t* dst, uint32_t value)
+{
+    dst[0] = value & 0xff;
+    dst[1] = (value >> 8) & 0xff;
+    dst[2] = (value >> 16) & 0xff;
+    dst[3] = value >> 24;
+}   // writeUInt32
+
+// ----------------------------------------------------------------------------
+static inline uint32_t readUInt32(const uint8_t* src)
+{
+    return src[0] | (src[1] << 8) | (src[2] << 16) | ((uint32_t)src[3] << 24);
+}   // readUInt32
+
+// ----------------------------------------------------------------------------
+static size_t getMaxStripeSize(unsigned width, unsigned height,
+                               unsigned stripes)
+{
+    // A QOI_OP_RGB chunk for each pixel
+    return (size_t)width * Recorder::getLosslessStripeHeight(height, stripes)
+        * 4;
+}   // getMaxStripeSize
+
+// ----------------------------------------------------------------------------
+/** Encode rows of pixels with bpp bytes, templated so the pixel loads are
+ *  fixed size. */
+template<unsigned BPP>
+static size_t encodeRows(uint8_t* out, const uint8_t* row, ptrdiff_t pitch,
+                         unsigned width, unsigned rows,
+                         const LosslessPixelLayout& layout)
+{
+    uint32_t index[64] = {};
+    uint32_t prev = OPAQUE_BLACK;
+    unsigned run = 0;
+    uint8_t* p = out;
+    const unsigned r_off = layout.m_red;
+    const unsigned g_off = layout.m_green;
+    const unsigned b_off = layout.m_blue;
+    for (unsigned y = 0; y < rows; y++, row += pitch)
+    {
+        const uint8_t* src = row;
+        for (unsigned x = 0; x < width; x++, src += BPP)
+        {
+            const uint32_t px = src[r_off] | (src[g_off] << 8) |
+                (src[b_off] << 16) | OPAQUE_BLACK;
+            if (px == prev)
+            {
+                if (++run == QOI_MAX_RUN)
+                {
+                    *p++ = QOI_OP_RUN | (run - 1);
+                    run = 0;
+                }
+                continue;
+            }
+            if (run > 0)
+            {
+                *p++ = QOI_OP_RUN | (run - 1);
+                run = 0;
+            }
+            const unsigned hash = getHash(px);
+            if (index[hash] == px)
+            {
+                *p++ = QOI_OP_INDEX | hash;
+                prev = px;
+                continue;
+            }
+            index[hash] = px;
+            const int8_t vr = (int8_t)((px & 0xff) - (prev & 0xff));
+            const int8_t vg = (int8_t)(((px >> 8) & 0xff) -
+                ((prev >> 8) & 0xff));
+            const int8_t vb = (int8_t)(((px >> 16) & 0xff) -
+                ((prev >> 16) & 0xff));
+            const int8_t vg_r = vr - vg;
+            const int8_t vg_b = vb - vg;
+            if (vr > -3 && vr < 2 && vg > -3 && vg < 2 && vb > -3 && vb < 2)
+            {
+                *p++ = QOI_OP_DIFF | ((vr + 2) << 4) | ((vg + 2) << 2) |
+                    (vb + 2);
+            }
+            else if (vg_r > -9 && vg_r < 8 && vg > -33 && vg < 32 &&
+                vg_b > -9 && vg_b < 8)
+            {
+                *p++ = QOI_OP_LUMA | (vg + 32);
+                *p++ = ((vg_r + 8) << 4) | (vg_b + 8);
+            }
+            else
+            {
+                *p++ = QOI_OP_RGB;
+                *p++ = px & 0xff;
+                *p++ = (px >> 8) & 0xff;
+                *p++ = (px >> 16) & 0xff;
+            }
+            prev = px;
+        }
+    }
+    if (run > 0)
+        *p++ = QOI_OP_RUN | (run - 1);
+    return p - out;
+}   // encodeRows
+
+// ----------------------------------------------------------------------------
+/** Decode pixels of a stripe to RGB, false if the data ends too early. */
+static bool decodeRows(const uint8_t* data, size_t size, size_t pixels,
+                       uint8_t* rgb)
+{
+    uint32_t index[64] = {};
+    uint32_t px = OPAQUE_BLACK;
+    unsigned run = 0;
+    const uint8_t* p = data;
+    const uint8_t* end = data + size;
+    for (size_t i = 0; i < pixels; i++, rgb += 3)
+    {
+        if (run > 0)
+            run--;
+        else
+        {
+            if (p == end)
+                return false;
+            const uint8_t b1 = *p++;
+            if (b1 == QOI_OP_RGB || b1 == QOI_OP_RGBA)
+            {
+                const size_t n = b1 == QOI_OP_RGB ? 3 : 4;
+                if ((size_t)(end - p) < n)
+                    return false;
+                px = p[0] | (p[1] << 8) | (p[2] << 16) |
+                    (n == 4 ? (uint32_t)p[3] << 24 : px & 0xff000000u);
+                p += n;
+            }
+            else if ((b1 & QOI_MASK) == QOI_OP_INDEX)
+                px = index[b1];
+            else if ((b1 & QOI_MASK) == QOI_OP_DIFF)
+            {
+                const uint8_t r = (px & 0xff) + ((b1 >> 4) & 3) - 2;
+                const uint8_t g = ((px >> 8) & 0xff) + ((b1 >> 2) & 3) - 2;
+                const uint8_t b = ((px >> 16) & 0xff) + (b1 & 3) - 2;
+                px = r | (g << 8) | (b << 16) | (px & 0xff000000u);
+            }
+            else if ((b1 & QOI_MASK) == QOI_OP_LUMA)
+            {
+                if (p == end)
+                    return false;
+                const uint8_t b2 = *p++;
+                const int vg = (b1 & 0x3f) - 32;
+                const uint8_t r = (px & 0xff) + vg - 8 + ((b2 >> 4) & 0x0f);
+                const uint8_t g = ((px >> 8) & 0xff) + vg;
+                const uint8_t b = ((px >> 16) & 0xff) + vg - 8 + (b2 & 0x0f);
+                px = r | (g << 8) | (b << 16) | (px & 0xff000000u);
+            }
+            else
+                run = b1 & 0x3f;
+            index[getHash(px)] = px;
+        }
+        rgb[0] = px & 0xff;
+        rgb[1] = (px >> 8) & 0xff;
+        rgb[2] = (px >> 16) & 0xff;
+    }
+    return true;
+}   // decodeRows
+
+namespace Recorder
+{
+    // ------------------------------------------------------------------------
+    unsigned getLosslessStripeHeight(unsigned height, unsigned stripes)
+    {
+        return stripes == 0 ? height : (height + stripes - 1) / stripes;
+    }   // getLosslessStripeHeight
+    // ------------------------------------------------------------------------
+    size_t getLosslessMaxSize(unsigned width, unsigned height,
+                              unsigned stripes)
+    {
+        return HEADER_SIZE + stripes * (sizeof(uint32_t) +
+            getMaxStripeSize(width, height, stripes));
+    }   // getLosslessMaxSize
+    // ------------------------------------------------------------------------
+    size_t losslessEncodeStripe(uint8_t* frame, const uint8_t* top,
+                                ptrdiff_t pitch, unsigned width,
+                                unsigned height, unsigned stripes,
+                                unsigned stripe,
+                                const LosslessPixelLayout& layout)
+    {
+        const unsigned stripe_height =
+            getLosslessStripeHeight(height, stripes);
+        const unsigned y0 = std::min(stripe * stripe_height, height);
+        const unsigned y1 = std::min(y0 + stripe_height, height);
+        // Each stripe has a worst case sized slot after the header until
+        // losslessFinishFrame moves them together
+        uint8_t* out = frame + HEADER_SIZE + stripes * sizeof(uint32_t) +
+            stripe * getMaxStripeSize(width, height, stripes);
+        const uint8_t* row = top + y0 * pitch;
+        if (layout.m_bpp == 4)
+            return encodeRows<4>(out, row, pitch, width, y1 - y0, layout);
+        return encodeRows<3>(out, row, pitch, width, y1 - y0, layout);
+    }   // losslessEncodeStripe
+    // ------------------------------------------------------------------------
+    size_t losslessFinishFrame(uint8_t* frame, unsigned width,
+                               unsigned height, unsigned stripes,
+                               const size_t* stripe_sizes)
+    {
+        writeUInt32(frame, width);
+        writeUInt32(frame + 4, height);
+        writeUInt32(frame + 8, stripes);
+        const size_t max_stripe_size = getMaxStripeSize(width, height,
+            stripes);
+        uint8_t* data = frame + HEADER_SIZE + stripes * sizeof(uint32_t);
+        size_t offset = 0;
+        for (unsigned i = 0; i < stripes; i++)
+        {
+            writeUInt32(frame + HEADER_SIZE + i * sizeof(uint32_t),
+                (uint32_t)stripe_sizes[i]);
+            // The first stripe is already in place
+            if (offset != i * max_stripe_size)
+            {
+                memmove(data + offset, data + i * max_stripe_size,
+                    stripe_sizes[i]);
+            }
+            offset += stripe_sizes[i];
+        }
+        return HEADER_SIZE + stripes * sizeof(uint32_t) + offset;
+    }   // losslessFinishFrame
+    // ------------------------------------------------------------------------
+    bool losslessDecodeFrame(const uint8_t* frame, size_t size,
+                             unsigned width, unsigned height, uint8_t* rgb)
+    {
+        if (size < HEADER_SIZE || readUInt32(frame) != width ||
+            readUInt32(frame + 4) != height)
+            return false;
+        const unsigned stripes = readUInt32(frame + 8);
+        if (stripes == 0 || stripes > height ||
+            (size - HEADER_SIZE) / sizeof(uint32_t) < stripes)
+            return false;
+        const unsigned stripe_height =
+            getLosslessStripeHeight(height, stripes);
+        const uint8_t* data = frame + HEADER_SIZE + stripes * sizeof(uint32_t);
+        size_t remaining = size - HEADER_SIZE - stripes * sizeof(uint32_t);
+        for (unsigned i = 0; i < stripes; i++)
+        {
+            const size_t stripe_size =
+                readUInt32(frame + HEADER_SIZE + i * sizeof(uint32_t));
+            if (stripe_size > remaining)
+                return false;
+            const unsigned y0 = std::min(i * stripe_height, height);
+            const unsigned y1 = std::min(y0 + stripe_height, height);
+            if (!decodeRows(data, stripe_size, (size_t)width * (y1 - y0),
+                rgb + (size_t)y0 * width * 3))
+                return false;
+            data += stripe_size;
+            remaining -= stripe_size;
+        }
+        return true;
+    }   // losslessDecodeFrame
+};
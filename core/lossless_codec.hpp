@@ -0,0 +1,62 @@
+/* Copyright (c) 2017, libopenglrecorder contributors
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+
+#ifndef HEADER_LOSSLESS_CODEC_HPP
+#define HEADER_LOSSLESS_CODEC_HPP
+
+#include <cstddef>
+#include <stdint.h>
+
+/* Frames of OGR_VF_LOSSLESS are split into horizontal stripes of whole rows,
+ * which are encoded independently by the conversion threads, each as the
+ * chunks of a QOI image without alpha. A frame starts with its width,
+ * height, number of stripes and the size of each stripe as little endian
+ * uint32, followed by the stripes from top to bottom. Every stripe has
+ * getLosslessStripeHeight rows, except the last ones which may be shorter
+ * or empty.
+ */
+
+/** Byte offsets of red, green and blue in a pixel of m_bpp bytes. */
+struct LosslessPixelLayout
+{
+    unsigned m_bpp;
+    unsigned m_red, m_green, m_blue;
+};
+
+namespace Recorder
+{
+    unsigned getLosslessStripeHeight(unsigned height, unsigned stripes);
+    // ------------------------------------------------------------------------
+    /** Bytes of a frame in the worst case, where every pixel differs too
+     *  much from its neighbour. */
+    size_t getLosslessMaxSize(unsigned width, unsigned height,
+                              unsigned stripes);
+    // ------------------------------------------------------------------------
+    /** Encode a stripe of the image to its place in frame, which has
+     *  \ref getLosslessMaxSize bytes. top is the first pixel of the top row
+     *  of the image and pitch the bytes to the next row below, negative for
+     *  a bottom-up image. Returns the size of the stripe, stripes can be
+     *  encoded at the same time. */
+    size_t losslessEncodeStripe(uint8_t* frame, const uint8_t* top,
+                                ptrdiff_t pitch, unsigned width,
+                                unsigned height, unsigned stripes,
+                                unsigned stripe,
+                                const LosslessPixelLayout& layout);
+    // ------------------------------------------------------------------------
+    /** Write the header once all stripes are encoded and move them
+     *  together, returns the size of the frame. */
+    size_t losslessFinishFrame(uint8_t* frame, unsigned width,
+                               unsigned height, unsigned stripes,
+                               const size_t* stripe_sizes);
+    // ------------------------------------------------------------------------
+    /** Decode a frame of width x height to top-down RGB, false if it's
+     *  invalid. */
+    bool losslessDecodeFrame(const uint8_t* frame, size_t size,
+                             unsigned width, unsigned height, uint8_t* rgb);
+};
+
+#endif
@@ -5,6 +5,10 @@
  * tree.
  */
 
+#include "core/buffer_arena.hpp"
+#include "core/encoder_registry.hpp"
+#include "core/lossless_codec.hpp"
+#include "core/mkv_writer.hpp"
 #include "core/recorder_private.hpp"
 
 #include <algorithm>
@@ -19,12 +23,32 @@
 namespace Recorder
 {
     // ------------------------------------------------------------------------
-    std::string writeMKV(const std::string& video, const std::string& audio)
+    size_t getMKVBufferSize(VideoFormat vf, unsigned width,
+                            unsigned height)
     {
+        size_t frame_size = width * height * 3;
+        if (vf == OGR_VF_LOSSLESS)
+        {
+            // Noise takes 4 bytes per pixel, with up to 64 stripes
+            frame_size = getLosslessMaxSize(width, height, 64);
+        }
+        return std::max(frame_size, size_t(1024 * 1024));
+    }   // getMKVBufferSize
+
+    // ------------------------------------------------------------------------
+    std::string writeMKV(const std::string& video, const std::string& audio,
+                         VideoFormat vf, unsigned width, unsigned height,
+                         BufferArena* arena)
+    {
+        const VideoEncoderInfo* info = getVideoEncoderInfo(vf);
+        if (info == NULL)
+        {
+            runCallback(OGR_CBT_ERROR_RECORDING, "No encoder registered for"
+                " video format.\n");
+            return "";
+        }
         std::string no_ext = video.substr(0, video.find_last_of("."));
-        VideoFormat vf = getConfig()->m_video_format;
-        std::string file_name = no_ext +
-            (vf == OGR_VF_VP8 || vf == OGR_VF_VP9 ? ".webm" : ".mkv");
+        std::string file_name = no_ext + (info->m_webm ? ".webm" : ".mkv");
         mkvmuxer::MkvWriter writer;
         if (!writer.Open(file_name.c_str()))
         {
@@ -41,10 +65,11 @@ namespace Recorder
         }
 
         std::list<std::unique_ptr<mkvmuxer::Frame> > audio_frames;
-        const unsigned max_buf_size = std::max(getConfig()->m_height *
-            getConfig()->m_width * 3, unsigned(1024 * 1024));
-        std::unique_ptr<uint8_t[]> buf_holder(new uint8_t[max_buf_size]);
-        uint8_t* buf = buf_holder.get();
+        const unsigned max_buf_size = (unsigned)getMKVBufferSize(vf, width,
+            height);
+        uint8_t* buf = arena->get(BufferArena::BT_MUXER, max_buf_size);
+        if (buf == NULL)
+            return "";
 
         FILE* input = NULL;
         struct stat st;
@@ -90,6 +115,10 @@ namespace Recorder
                     " track.\n");
                 return "";
             }
+            const AudioEncoderInfo* audio_info =
+                getAudioEncoderInfo(getConfig()->m_audio_format);
+            if (audio_info != NULL)
+                at->set_codec_id(audio_info->m_codec_id);
             uint32_t codec_private_size = 0;
             readed = fread(&codec_private_size, 1, sizeof(uint32_t), input);
             if (readed != sizeof(uint32_t))
@@ -147,14 +176,8 @@ namespace Recorder
             }
             fclose(input);
             input = NULL;
-            if (remove(audio.c_str()) != 0)
-            {
-                runCallback(OGR_CBT_ERROR_RECORDING, "Failed to remove audio"
-                    " data file\n");
-            }
         }
-        uint64_t vid_track = muxer_segment.AddVideoTrack(getConfig()->m_width,
-            getConfig()->m_height, 0);
+        uint64_t vid_track = muxer_segment.AddVideoTrack(width, height, 0);
         if (!vid_track)
         {
             runCallback(OGR_CBT_ERROR_RECORDING, "Could not add video"
@@ -170,23 +193,7 @@ namespace Recorder
             return "";
         }
         vt->set_frame_rate(getConfig()->m_record_fps);
-        switch (vf)
-        {
-        case OGR_VF_VP8:
-            vt->set_codec_id("V_VP8");
-            break;
-        case OGR_VF_VP9:
-            vt->set_codec_id("V_VP9");
-            break;
-        case OGR_VF_MJPEG:
-            vt->set_codec_id("V_MJPEG");
-            break;
-        case OGR_VF_H264:
-            vt->set_codec_id("V_MPEG4/ISO/AVC");
-            break;
-        default:
-            break;
-        }
+        vt->set_codec_id(info->m_codec_id);
         result = stat(video.c_str(), &st);
         if (result == 0)
         {
@@ -7,11 +7,20 @@
 
 #ifndef HEADER_MKV_WRITER_HPP
 #define HEADER_MKV_WRITER_HPP
+#include "openglrecorder.h"
+
+#include <cstddef>
 #include <string>
 
+class BufferArena;
+
 namespace Recorder
 {
-    std::string writeMKV(const std::string& video, const std::string& audio);
+    size_t getMKVBufferSize(VideoFormat vf, unsigned width,
+                            unsigned height);
+    std::string writeMKV(const std::string& video, const std::string& audio,
+                         VideoFormat vf, unsigned width, unsigned height,
+                         BufferArena* arena);
 };
 
 #endif
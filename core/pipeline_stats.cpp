@@ -0,0 +1,160 @@
+/* Copyright (c) 2017, libopenglrecorder contributors
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+
+#include "core/pipeline_stats.hpp"
+
+#include <algorithm>
+
+// ----------------------------------------------------------------------------
+/** Values below 4 have their own bucket, others are split by their highest
+ *  bit and the 2 bits after it.
+ */
+unsigned LatencyHistogram::getBucket(uint64_t ns)
+{
+    if (ns < (1u << SUB_BUCKET_BITS))
+        return (unsigned)ns;
+    unsigned msb = SUB_BUCKET_BITS;
+    while (msb < 63 && (ns >> (msb + 1)) != 0)
+        msb++;
+    const unsigned sub = (unsigned)(ns >> (msb - SUB_BUCKET_BITS)) &
+        ((1u << SUB_BUCKET_BITS) - 1);
+    return ((msb - SUB_BUCKET_BITS + 1) << SUB_BUCKET_BITS) + sub;
+}   // getBucket
+
+// ----------------------------------------------------------------------------
+double LatencyHistogram::getBucketMiddle(unsigned bucket)
+{
+    if (bucket < (1u << SUB_BUCKET_BITS))
+        return (double)bucket;
+    const unsigned msb = (bucket >> SUB_BUCKET_BITS) + SUB_BUCKET_BITS - 1;
+    const unsigned sub = bucket & ((1u << SUB_BUCKET_BITS) - 1);
+    const double width = (double)(1ull << (msb - SUB_BUCKET_BITS));
+    return ((1u << SUB_BUCKET_BITS) + sub) * width + width * 0.5;
+}   // getBucketMiddle
+
+// ----------------------------------------------------------------------------
+void LatencyHistogram::reset()
+{
+    for (std::atomic<uint64_t>& bucket : m_buckets)
+        bucket.store(0, std::memory_order_relaxed);
+    m_sum.store(0, std::memory_order_relaxed);
+    m_max.store(0, std::memory_order_relaxed);
+}   // reset
+
+// ----------------------------------------------------------------------------
+void LatencyHistogram::add(uint64_t ns)
+{
+    m_buckets[getBucket(ns)].fetch_add(1, std::memory_order_relaxed);
+    m_sum.fetch_add(ns, std::memory_order_relaxed);
+    uint64_t max = m_max.load(std::memory_order_relaxed);
+    while (ns > max && !m_max.compare_exchange_weak(max, ns,
+        std::memory_order_relaxed));
+}   // add
+
+// ----------------------------------------------------------------------------
+/** Summarize in microseconds, the counts may change while reading them, so
+ *  it's only consistent when nothing is added at the same time.
+ */
+void LatencyHistogram::getSummary(LatencyStats* ls) const
+{
+    uint64_t counts[BUCKET_COUNT];
+    uint64_t total = 0;
+    for (unsigned i = 0; i < BUCKET_COUNT; i++)
+    {
+        counts[i] = m_buckets[i].load(std::memory_order_relaxed);
+        total += counts[i];
+    }
+    const double max = (double)m_max.load(std::memory_order_relaxed);
+    ls->m_count = total;
+    ls->m_mean = ls->m_p50 = ls->m_p99 = 0.0;
+    ls->m_max = max / 1000.0;
+    if (total == 0)
+        return;
+    ls->m_mean =
+        (double)m_sum.load(std::memory_order_relaxed) / total / 1000.0;
+    const uint64_t p50 = (total + 1) / 2;
+    const uint64_t p99 = total - total / 100;
+    uint64_t seen = 0;
+    for (unsigned i = 0; i < BUCKET_COUNT; i++)
+    {
+        if (counts[i] == 0)
+            continue;
+        const uint64_t before = seen;
+        seen += counts[i];
+        const double middle = std::min(getBucketMiddle(i), max) / 1000.0;
+        if (before < p50 && seen >= p50)
+            ls->m_p50 = middle;
+        if (before < p99 && seen >= p99)
+        {
+            ls->m_p99 = middle;
+            break;
+        }
+    }
+}   // getSummary
+
+// ----------------------------------------------------------------------------
+void PipelineStats::reset()
+{
+    m_capture.reset();
+    m_readback.reset();
+    m_conversion.reset();
+    m_scale.reset();
+    m_decode.reset();
+    m_encode.reset();
+    m_mux.reset();
+    m_frames_captured.store(0, std::memory_order_relaxed);
+    m_frames_duplicated.store(0, std::memory_order_relaxed);
+    m_frames_dropped.store(0, std::memory_order_relaxed);
+    m_frames_skipped.store(0, std::memory_order_relaxed);
+    m_bytes_written.store(0, std::memory_order_relaxed);
+    m_queue_depth.store(0, std::memory_order_relaxed);
+    m_queue_high_water.store(0, std::memory_order_relaxed);
+    m_encoder_level.store(0, std::memory_order_relaxed);
+    m_encoder_bitrate.store(0, std::memory_order_relaxed);
+    m_encoder_adjustments.store(0, std::memory_order_relaxed);
+    m_cpu_usage.store(0, std::memory_order_relaxed);
+    m_throttled_time.store(0, std::memory_order_relaxed);
+    m_budget_adjustments.store(0, std::memory_order_relaxed);
+}   // reset
+
+// ----------------------------------------------------------------------------
+void PipelineStats::setQueueDepth(unsigned depth)
+{
+    m_queue_depth.store(depth, std::memory_order_relaxed);
+    unsigned high = m_queue_high_water.load(std::memory_order_relaxed);
+    while (depth > high && !m_queue_high_water.compare_exchange_weak(high,
+        depth, std::memory_order_relaxed));
+}   // setQueueDepth
+
+// ----------------------------------------------------------------------------
+void PipelineStats::getStats(RecorderStats* rs) const
+{
+    m_capture.getSummary(&rs->m_capture);
+    m_readback.getSummary(&rs->m_readback);
+    m_conversion.getSummary(&rs->m_conversion);
+    m_scale.getSummary(&rs->m_scale);
+    m_decode.getSummary(&rs->m_decode);
+    m_encode.getSummary(&rs->m_encode);
+    m_mux.getSummary(&rs->m_mux);
+    rs->m_frames_captured = m_frames_captured.load(std::memory_order_relaxed);
+    rs->m_frames_duplicated =
+        m_frames_duplicated.load(std::memory_order_relaxed);
+    rs->m_frames_dropped = m_frames_dropped.load(std::memory_order_relaxed);
+    rs->m_frames_skipped = m_frames_skipped.load(std::memory_order_relaxed);
+    rs->m_bytes_written = m_bytes_written.load(std::memory_order_relaxed);
+    rs->m_queue_depth = m_queue_depth.load(std::memory_order_relaxed);
+    rs->m_queue_high_water =
+        m_queue_high_water.load(std::memory_order_relaxed);
+    rs->m_encoder_level = m_encoder_level.load(std::memory_order_relaxed);
+    rs->m_encoder_bitrate = m_encoder_bitrate.load(std::memory_order_relaxed);
+    rs->m_encoder_adjustments =
+        m_encoder_adjustments.load(std::memory_order_relaxed);
+    rs->m_cpu_usage = m_cpu_usage.load(std::memory_order_relaxed);
+    rs->m_throttled_time = m_throttled_time.load(std::memory_order_relaxed);
+    rs->m_budget_adjustments =
+        m_budget_adjustments.load(std::memory_order_relaxed);
+}   // getStats
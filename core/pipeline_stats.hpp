@@ -0,0 +1,107 @@
+/* Copyright (c) 2017, libopenglrecorder contributors
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+
+#ifndef HEADER_PIPELINE_STATS_HPP
+#define HEADER_PIPELINE_STATS_HPP
+
+#include "openglrecorder.h"
+
+#include <atomic>
+#include <chrono>
+#include <stdint.h>
+
+/** Histogram of latencies in nanoseconds, with 4 buckets for each power of
+ *  two so percentiles are within 12.5%. It only uses relaxed atomic
+ *  operations, so any thread can add to it without locking.
+ */
+class LatencyHistogram
+{
+private:
+    static const unsigned SUB_BUCKET_BITS = 2;
+
+    static const unsigned BUCKET_COUNT = 64 << SUB_BUCKET_BITS;
+
+    std::atomic<uint64_t> m_buckets[BUCKET_COUNT];
+
+    std::atomic<uint64_t> m_sum, m_max;
+
+    // ------------------------------------------------------------------------
+    static unsigned getBucket(uint64_t ns);
+    // ------------------------------------------------------------------------
+    static double getBucketMiddle(unsigned bucket);
+
+public:
+    // ------------------------------------------------------------------------
+    LatencyHistogram()                                             { reset(); }
+    // ------------------------------------------------------------------------
+    void reset();
+    // ------------------------------------------------------------------------
+    void add(uint64_t ns);
+    // ------------------------------------------------------------------------
+    void getSummary(LatencyStats* ls) const;
+
+};
+
+/** Add the time from its construction to its destruction to a histogram. */
+class ScopedLatency
+{
+private:
+    LatencyHistogram* m_histogram;
+
+    std::chrono::steady_clock::time_point m_start;
+
+public:
+    // ------------------------------------------------------------------------
+    ScopedLatency(LatencyHistogram* histogram)
+    {
+        m_histogram = histogram;
+        m_start = std::chrono::steady_clock::now();
+    }
+    // ------------------------------------------------------------------------
+    ~ScopedLatency()
+    {
+        m_histogram->add(std::chrono::duration_cast<std::chrono::nanoseconds>
+            (std::chrono::steady_clock::now() - m_start).count());
+    }
+
+};
+
+/** Counters and latencies of each stage for \ref ogrGetStats, reset when a
+ *  recording starts.
+ */
+struct PipelineStats
+{
+    LatencyHistogram m_capture, m_readback, m_conversion, m_scale, m_decode,
+        m_encode, m_mux;
+
+    std::atomic<uint64_t> m_frames_captured, m_frames_duplicated,
+        m_frames_dropped, m_frames_skipped, m_bytes_written;
+
+    std::atomic<unsigned> m_queue_depth, m_queue_high_water;
+
+    /* Set by EncoderController. */
+    std::atomic<unsigned> m_encoder_level, m_encoder_bitrate;
+
+    std::atomic<uint64_t> m_encoder_adjustments;
+
+    /* Set by CPUGovernor and EncoderController. */
+    std::atomic<unsigned> m_cpu_usage;
+
+    std::atomic<uint64_t> m_throttled_time, m_budget_adjustments;
+
+    // ------------------------------------------------------------------------
+    PipelineStats()                                                { reset(); }
+    // ------------------------------------------------------------------------
+    void reset();
+    // ------------------------------------------------------------------------
+    void setQueueDepth(unsigned depth);
+    // ------------------------------------------------------------------------
+    void getStats(RecorderStats* rs) const;
+
+};
+
+#endif
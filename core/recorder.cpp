@@ -5,16 +5,16 @@
  * tree.
  */
 
-#include "audio/vorbis_encoder.hpp"
 #include "core/capture_library.hpp"
+#include "core/encoder_registry.hpp"
+#include "core/pipeline_stats.hpp"
 #include "core/recorder_private.hpp"
-#include "video/mjpeg_writer.hpp"
-#include "video/openh264_encoder.hpp"
-#include "video/vpx_encoder.hpp"
+#include "core/trace_recorder.hpp"
 
 #include <array>
 #include <cassert>
 #include <memory>
+#include <mutex>
 #include <cstring>
 
 // ============================================================================
@@ -26,6 +26,43 @@ ogrFucDeleteBuffers ogrDeleteBuffers = NULL;
 ogrFucMapBuffer ogrMapBuffer = NULL;
 ogrFucMapBufferRange ogrMapBufferRange = NULL;
 ogrFucUnmapBuffer ogrUnmapBuffer = NULL;
+ogrFucGenFramebuffers ogrGenFramebuffers = NULL;
+ogrFucBindFramebuffer ogrBindFramebuffer = NULL;
+ogrFucDeleteFramebuffers ogrDeleteFramebuffers = NULL;
+ogrFucGenRenderbuffers ogrGenRenderbuffers = NULL;
+ogrFucBindRenderbuffer ogrBindRenderbuffer = NULL;
+ogrFucRenderbufferStorage ogrRenderbufferStorage = NULL;
+ogrFucFramebufferRenderbuffer ogrFramebufferRenderbuffer = NULL;
+ogrFucDeleteRenderbuffers ogrDeleteRenderbuffers = NULL;
+ogrFucBlitFramebuffer ogrBlitFramebuffer = NULL;
+ogrFucCreateShader ogrCreateShader = NULL;
+ogrFucShaderSource ogrShaderSource = NULL;
+ogrFucCompileShader ogrCompileShader = NULL;
+ogrFucCreateProgram ogrCreateProgram = NULL;
+ogrFucAttachShader ogrAttachShader = NULL;
+ogrFucLinkProgram ogrLinkProgram = NULL;
+ogrFucGetProgramiv ogrGetProgramiv = NULL;
+ogrFucUseProgram ogrUseProgram = NULL;
+ogrFucGetUniformLocation ogrGetUniformLocation = NULL;
+ogrFucUniform1i ogrUniform1i = NULL;
+ogrFucUniform4f ogrUniform4f = NULL;
+ogrFucDeleteShader ogrDeleteShader = NULL;
+ogrFucDeleteProgram ogrDeleteProgram = NULL;
+ogrFucGenTextures ogrGenTextures = NULL;
+ogrFucBindTexture ogrBindTexture = NULL;
+ogrFucTexImage2D ogrTexImage2D = NULL;
+ogrFucTexParameteri ogrTexParameteri = NULL;
+ogrFucCopyTexSubImage2D ogrCopyTexSubImage2D = NULL;
+ogrFucDeleteTextures ogrDeleteTextures = NULL;
+ogrFucGenVertexArrays ogrGenVertexArrays = NULL;
+ogrFucBindVertexArray ogrBindVertexArray = NULL;
+ogrFucDeleteVertexArrays ogrDeleteVertexArrays = NULL;
+ogrFucViewport ogrViewport = NULL;
+ogrFucDrawArrays ogrDrawArrays = NULL;
+ogrFucGetIntegerv ogrGetIntegerv = NULL;
+ogrFucIsEnabled ogrIsEnabled = NULL;
+ogrFucEnable ogrEnable = NULL;
+ogrFucDisable ogrDisable = NULL;
 // ============================================================================
 std::unique_ptr<RecorderConfig> g_recorder_config(nullptr);
 // ============================================================================
@@ -33,6 +70,9 @@ std::unique_ptr<CaptureLibrary> g_capture_library(nullptr);
 // ============================================================================
 std::string g_saved_name;
 // ============================================================================
+std::vector<OutputProfileEntry> g_output_profiles;
+const unsigned MAX_OUTPUT_PROFILES = 8;
+// ============================================================================
 StringCallback g_cb_saved_rec = NULL;
 // ============================================================================
 IntCallback g_cb_progress_rec = NULL;
@@ -43,6 +83,9 @@ StringCallback g_cb_error_rec = NULL;
 // ============================================================================
 std::array<void*, OGR_CBT_COUNT> g_all_user_data;
 // ============================================================================
+std::array<ThreadConfig, OGR_TS_COUNT> g_thread_configs = {};
+std::mutex g_thread_configs_mutex;
+// ============================================================================
 bool validateConfig(RecorderConfig* rc)
 {
     if (rc == NULL)
@@ -59,6 +102,28 @@ bool validateConfig(RecorderConfig* rc)
         return false;
     if (rc->m_record_jpg_quality > 100)
         return false;
+    if (rc->m_output_width > rc->m_width || rc->m_output_height > rc->m_height)
+        return false;
+    if (rc->m_scale_filter >= OGR_SF_COUNT)
+        return false;
+    if (rc->m_gpu_yuv > 1)
+        return false;
+    if (rc->m_readback_format >= OGR_RF_COUNT)
+        return false;
+    if (rc->m_conversion_threads > 64)
+        return false;
+    if (rc->m_huge_pages > 1 || rc->m_lock_memory > 1)
+        return false;
+    if (rc->m_worker_threads > 64)
+        return false;
+    if (rc->m_adaptive_encoder > 1)
+        return false;
+    if (rc->m_cpu_budget > 6400)
+        return false;
+    if (rc->m_deferred_encoding > 1)
+        return false;
+    if (rc->m_parallel_gop > 3600)
+        return false;
     return true;
 }   // validateConfig
 
@@ -67,9 +132,12 @@ int ogrInitConfig(RecorderConfig* rc)
 {
     RecorderConfig* new_rc = new RecorderConfig;
     g_recorder_config.reset(new_rc);
+    g_output_profiles.clear();
 
     if (!validateConfig(rc))
     {
+        runCallback(OGR_CBT_ERROR_RECORDING, "Invalid recorder config,"
+            " fallback to default\n");
         new_rc->m_triple_buffering = 1;
         new_rc->m_record_audio = 0;
         new_rc->m_width = 800;
@@ -80,6 +148,19 @@ int ogrInitConfig(RecorderConfig* rc)
         new_rc->m_video_bitrate = 100000;
         new_rc->m_record_fps = 30;
         new_rc->m_record_jpg_quality = 90;
+        new_rc->m_output_width = 800;
+        new_rc->m_output_height = 600;
+        new_rc->m_scale_filter = OGR_SF_BILINEAR;
+        new_rc->m_gpu_yuv = 0;
+        new_rc->m_readback_format = OGR_RF_RGBA;
+        new_rc->m_conversion_threads = 0;
+        new_rc->m_huge_pages = 0;
+        new_rc->m_lock_memory = 0;
+        new_rc->m_worker_threads = 0;
+        new_rc->m_adaptive_encoder = 0;
+        new_rc->m_cpu_budget = 0;
+        new_rc->m_deferred_encoding = 0;
+        new_rc->m_parallel_gop = 0;
         return 0;
     }
 
@@ -92,12 +173,36 @@ int ogrInitConfig(RecorderConfig* rc)
     {
         new_rc->m_height--;
     }
+    if (new_rc->m_output_width == 0)
+        new_rc->m_output_width = new_rc->m_width;
+    if (new_rc->m_output_height == 0)
+        new_rc->m_output_height = new_rc->m_height;
+    while (new_rc->m_output_width % 8 != 0)
+    {
+        new_rc->m_output_width--;
+    }
+    while (new_rc->m_output_height % 2 != 0)
+    {
+        new_rc->m_output_height--;
+    }
+    if (new_rc->m_output_width == 0 || new_rc->m_output_height == 0)
+    {
+        new_rc->m_output_width = new_rc->m_width;
+        new_rc->m_output_height = new_rc->m_height;
+    }
     if (ogrCheckVideoEncoder(new_rc->m_video_format) == 0)
     {
         runCallback(OGR_CBT_ERROR_RECORDING, "Unsupported video format,"
             " fallback to MJPEG\n");
         new_rc->m_video_format = OGR_VF_MJPEG;
     }
+    if (new_rc->m_deferred_encoding > 0 &&
+        new_rc->m_video_format != OGR_VF_VP9)
+    {
+        runCallback(OGR_CBT_ERROR_RECORDING, "Deferred encoding needs VP9,"
+            " disabled\n");
+        new_rc->m_deferred_encoding = 0;
+    }
     return 1;
 }   // ogrInitConfig
 
@@ -116,12 +221,83 @@ void ogrSetSavedName(const char* name)
         g_saved_name = name;
 }   // ogrSetSavedName
 
+// ----------------------------------------------------------------------------
+int ogrAddOutputProfile(const OutputProfile* op, const char* name_suffix)
+{
+    // The outputs are created with the capture library
+    if (g_recorder_config.get() == nullptr ||
+        g_capture_library.get() != nullptr || op == NULL ||
+        name_suffix == NULL || name_suffix[0] == 0 ||
+        g_output_profiles.size() >= MAX_OUTPUT_PROFILES)
+        return 0;
+    if (op->m_video_format >= OGR_VF_COUNT ||
+        ogrCheckVideoEncoder(op->m_video_format) == 0)
+        return 0;
+    const RecorderConfig* rc = getConfig();
+    if (op->m_width > rc->m_output_width ||
+        op->m_height > rc->m_output_height)
+        return 0;
+    OutputProfileEntry entry;
+    entry.m_profile = *op;
+    entry.m_name_suffix = name_suffix;
+    for (const OutputProfileEntry& other : g_output_profiles)
+    {
+        if (other.m_name_suffix == entry.m_name_suffix)
+            return 0;
+    }
+    unsigned& width = entry.m_profile.m_width;
+    unsigned& height = entry.m_profile.m_height;
+    if (width == 0)
+        width = rc->m_output_width;
+    if (height == 0)
+        height = rc->m_output_height;
+    while (width % 8 != 0)
+    {
+        width--;
+    }
+    while (height % 2 != 0)
+    {
+        height--;
+    }
+    if (width == 0 || height == 0)
+        return 0;
+    // Frames of these are shared as they are, so they cannot be scaled
+    if ((op->m_video_format == OGR_VF_MJPEG ||
+        op->m_video_format == OGR_VF_LOSSLESS) &&
+        (width != rc->m_output_width || height != rc->m_output_height))
+        return 0;
+    g_output_profiles.push_back(entry);
+    return 1;
+}   // ogrAddOutputProfile
+
+// ----------------------------------------------------------------------------
+void ogrClearOutputProfiles(void)
+{
+    if (g_capture_library.get() == nullptr)
+        g_output_profiles.clear();
+}   // ogrClearOutputProfiles
+
+// ----------------------------------------------------------------------------
+const std::vector<OutputProfileEntry>& getOutputProfiles()
+{
+    return g_output_profiles;
+}   // getOutputProfiles
+
 // ----------------------------------------------------------------------------
 const std::string& getSavedName()
 {
     return g_saved_name;
 }   // getSavedName
 
+// ----------------------------------------------------------------------------
+void ogrWarmup(void)
+{
+    assert(g_recorder_config.get() != nullptr && ogrReadPixels != NULL);
+    if (g_capture_library.get() == nullptr)
+        g_capture_library.reset(new CaptureLibrary(getConfig()));
+    g_capture_library.get()->warmup();
+}   // ogrWarmup
+
 // ----------------------------------------------------------------------------
 void ogrPrepareCapture(void)
 {
@@ -143,6 +319,28 @@ void ogrCapture(void)
     g_capture_library.get()->capture();
 }   // ogrCapture
 
+// ----------------------------------------------------------------------------
+void ogrCaptureUnchanged(void)
+{
+    if (g_capture_library.get() == nullptr)
+        return;
+    g_capture_library.get()->captureUnchanged();
+}   // ogrCaptureUnchanged
+
+// ----------------------------------------------------------------------------
+void ogrCaptureRegions(const CaptureRegion* regions, unsigned int count)
+{
+    if (g_capture_library.get() == nullptr)
+        return;
+    if (count == 0)
+    {
+        g_capture_library.get()->captureUnchanged();
+        return;
+    }
+    assert(regions != NULL);
+    g_capture_library.get()->capture(regions, count);
+}   // ogrCaptureRegions
+
 // ----------------------------------------------------------------------------
 void ogrStopCapture(void)
 {
@@ -151,6 +349,14 @@ void ogrStopCapture(void)
     g_capture_library.get()->stopCapture();
 }   // ogrStopCapture
 
+// ----------------------------------------------------------------------------
+void ogrCancelCapture(void)
+{
+    if (g_capture_library.get() == nullptr)
+        return;
+    g_capture_library.get()->cancelCapture();
+}   // ogrCancelCapture
+
 // ----------------------------------------------------------------------------
 void ogrDestroy(void)
 {
@@ -302,6 +508,172 @@ void ogrRegPBOFunctionsRange(ogrFucGenBuffers gen_buffers,
     ogrUnmapBuffer = unmap_buffer;
 }   // ogrRegPBOFunctions
 
+// ----------------------------------------------------------------------------
+void ogrRegFBOFunctions(ogrFucGenFramebuffers gen_framebuffers,
+                        ogrFucBindFramebuffer bind_framebuffer,
+                        ogrFucDeleteFramebuffers delete_framebuffers,
+                        ogrFucGenRenderbuffers gen_renderbuffers,
+                        ogrFucBindRenderbuffer bind_renderbuffer,
+                        ogrFucRenderbufferStorage renderbuffer_storage,
+                        ogrFucFramebufferRenderbuffer framebuffer_renderbuffer,
+                        ogrFucDeleteRenderbuffers delete_renderbuffers,
+                        ogrFucBlitFramebuffer blit_framebuffer)
+{
+    assert(gen_framebuffers != NULL);
+    ogrGenFramebuffers = gen_framebuffers;
+    assert(bind_framebuffer != NULL);
+    ogrBindFramebuffer = bind_framebuffer;
+    assert(delete_framebuffers != NULL);
+    ogrDeleteFramebuffers = delete_framebuffers;
+    assert(gen_renderbuffers != NULL);
+    ogrGenRenderbuffers = gen_renderbuffers;
+    assert(bind_renderbuffer != NULL);
+    ogrBindRenderbuffer = bind_renderbuffer;
+    assert(renderbuffer_storage != NULL);
+    ogrRenderbufferStorage = renderbuffer_storage;
+    assert(framebuffer_renderbuffer != NULL);
+    ogrFramebufferRenderbuffer = framebuffer_renderbuffer;
+    assert(delete_renderbuffers != NULL);
+    ogrDeleteRenderbuffers = delete_renderbuffers;
+    assert(blit_framebuffer != NULL);
+    ogrBlitFramebuffer = blit_framebuffer;
+}   // ogrRegFBOFunctions
+
+// ----------------------------------------------------------------------------
+void ogrRegShaderFunctions(ogrFucCreateShader create_shader,
+                           ogrFucShaderSource shader_source,
+                           ogrFucCompileShader compile_shader,
+                           ogrFucCreateProgram create_program,
+                           ogrFucAttachShader attach_shader,
+                           ogrFucLinkProgram link_program,
+                           ogrFucGetProgramiv get_programiv,
+                           ogrFucUseProgram use_program,
+                           ogrFucGetUniformLocation get_uniform_location,
+                           ogrFucUniform1i uniform1i,
+                           ogrFucUniform4f uniform4f,
+                           ogrFucDeleteShader delete_shader,
+                           ogrFucDeleteProgram delete_program)
+{
+    assert(create_shader != NULL);
+    ogrCreateShader = create_shader;
+    assert(shader_source != NULL);
+    ogrShaderSource = shader_source;
+    assert(compile_shader != NULL);
+    ogrCompileShader = compile_shader;
+    assert(create_program != NULL);
+    ogrCreateProgram = create_program;
+    assert(attach_shader != NULL);
+    ogrAttachShader = attach_shader;
+    assert(link_program != NULL);
+    ogrLinkProgram = link_program;
+    assert(get_programiv != NULL);
+    ogrGetProgramiv = get_programiv;
+    assert(use_program != NULL);
+    ogrUseProgram = use_program;
+    assert(get_uniform_location != NULL);
+    ogrGetUniformLocation = get_uniform_location;
+    assert(uniform1i != NULL);
+    ogrUniform1i = uniform1i;
+    assert(uniform4f != NULL);
+    ogrUniform4f = uniform4f;
+    assert(delete_shader != NULL);
+    ogrDeleteShader = delete_shader;
+    assert(delete_program != NULL);
+    ogrDeleteProgram = delete_program;
+}   // ogrRegShaderFunctions
+
+// ----------------------------------------------------------------------------
+void ogrRegDrawFunctions(ogrFucGenTextures gen_textures,
+                         ogrFucBindTexture bind_texture,
+                         ogrFucTexImage2D tex_image_2d,
+                         ogrFucTexParameteri tex_parameteri,
+                         ogrFucCopyTexSubImage2D copy_tex_sub_image_2d,
+                         ogrFucDeleteTextures delete_textures,
+                         ogrFucGenVertexArrays gen_vertex_arrays,
+                         ogrFucBindVertexArray bind_vertex_array,
+                         ogrFucDeleteVertexArrays delete_vertex_arrays,
+                         ogrFucViewport viewport,
+                         ogrFucDrawArrays draw_arrays,
+                         ogrFucGetIntegerv get_integerv,
+                         ogrFucIsEnabled is_enabled,
+                         ogrFucEnable enable,
+                         ogrFucDisable disable)
+{
+    assert(gen_textures != NULL);
+    ogrGenTextures = gen_textures;
+    assert(bind_texture != NULL);
+    ogrBindTexture = bind_texture;
+    assert(tex_image_2d != NULL);
+    ogrTexImage2D = tex_image_2d;
+    assert(tex_parameteri != NULL);
+    ogrTexParameteri = tex_parameteri;
+    assert(copy_tex_sub_image_2d != NULL);
+    ogrCopyTexSubImage2D = copy_tex_sub_image_2d;
+    assert(delete_textures != NULL);
+    ogrDeleteTextures = delete_textures;
+    assert(gen_vertex_arrays != NULL);
+    ogrGenVertexArrays = gen_vertex_arrays;
+    assert(bind_vertex_array != NULL);
+    ogrBindVertexArray = bind_vertex_array;
+    assert(delete_vertex_arrays != NULL);
+    ogrDeleteVertexArrays = delete_vertex_arrays;
+    assert(viewport != NULL);
+    ogrViewport = viewport;
+    assert(draw_arrays != NULL);
+    ogrDrawArrays = draw_arrays;
+    assert(get_integerv != NULL);
+    ogrGetIntegerv = get_integerv;
+    assert(is_enabled != NULL);
+    ogrIsEnabled = is_enabled;
+    assert(enable != NULL);
+    ogrEnable = enable;
+    assert(disable != NULL);
+    ogrDisable = disable;
+}   // ogrRegDrawFunctions
+
+// ----------------------------------------------------------------------------
+int ogrSetThreadConfig(ThreadStage stage, const ThreadConfig* tc)
+{
+    if (stage >= OGR_TS_COUNT || tc == NULL || tc->m_policy >= OGR_TP_COUNT ||
+        tc->m_nice < -20 || tc->m_nice > 19)
+        return 0;
+    std::lock_guard<std::mutex> lock(g_thread_configs_mutex);
+    g_thread_configs[stage] = *tc;
+    return 1;
+}   // ogrSetThreadConfig
+
+// ----------------------------------------------------------------------------
+int ogrGetStats(RecorderStats* rs)
+{
+    if (g_capture_library.get() == nullptr || rs == NULL)
+        return 0;
+    g_capture_library.get()->getStats()->getStats(rs);
+    return 1;
+}   // ogrGetStats
+
+// ----------------------------------------------------------------------------
+int ogrSetTraceFile(const char* name)
+{
+#ifdef ENABLE_TRACING
+    TraceRecorder::setTraceFile(name == NULL ? "" : name);
+    return 1;
+#else
+    return 0;
+#endif
+}   // ogrSetTraceFile
+
+// ----------------------------------------------------------------------------
+/** Return the settings of a stage if it doesn't use the default scheduling,
+ *  which is left untouched.
+ */
+static bool getThreadConfig(ThreadStage stage, ThreadConfig* tc)
+{
+    std::lock_guard<std::mutex> lock(g_thread_configs_mutex);
+    *tc = g_thread_configs[stage];
+    return tc->m_affinity_mask != 0 || tc->m_nice != 0 ||
+        tc->m_policy != OGR_TP_NORMAL;
+}   // getThreadConfig
+
 // ----------------------------------------------------------------------------
 /** This function sets the name of this thread in the debugger.
   *  \param name Name of the thread.
@@ -337,7 +709,7 @@ void ogrRegPBOFunctionsRange(ogrFucGenBuffers gen_buffers,
         __except(EXCEPTION_EXECUTE_HANDLER)
         {
         }
-
+        TraceRecorder::setThreadName(name);
     }   // setThreadName
 #elif defined(__linux__) && defined(__GLIBC__) && defined(__GLIBC_MINOR__)
     void setThreadName(const char* name)
@@ -345,37 +717,213 @@ void ogrRegPBOFunctionsRange(ogrFucGenBuffers gen_buffers,
 #if __GLIBC__ > 2 || __GLIBC_MINOR__ > 11
         pthread_setname_np(pthread_self(), name);
 #endif
+        TraceRecorder::setThreadName(name);
     }   // setThreadName
 #else
     void setThreadName(const char* name)
     {
+        TraceRecorder::setThreadName(name);
     }   // setThreadName
 #endif
+
+// ----------------------------------------------------------------------------
+/** These functions apply the \ref ThreadConfig of a stage to this thread, and
+ *  reset it to the saved scheduling before the thread runs another stage.
+ */
+#if defined(WIN32)
+#  define WIN32_LEAN_AND_MEAN
+#  include <windows.h>
+
+    thread_local bool g_scheduling_saved = false;
+    thread_local int g_saved_priority;
+    thread_local DWORD_PTR g_saved_affinity;
+
+    void applyThreadConfig(ThreadStage stage)
+    {
+        ThreadConfig tc;
+        if (!getThreadConfig(stage, &tc))
+            return;
+        HANDLE thread = GetCurrentThread();
+        g_saved_priority = GetThreadPriority(thread);
+        g_saved_affinity = 0;
+        g_scheduling_saved = true;
+        if (tc.m_affinity_mask != 0)
+        {
+            g_saved_affinity = SetThreadAffinityMask(thread,
+                (DWORD_PTR)tc.m_affinity_mask);
+            if (g_saved_affinity == 0)
+            {
+                runCallback(OGR_CBT_ERROR_RECORDING, "Failed to set cpu"
+                    " affinity of thread.\n");
+            }
+        }
+        int priority = THREAD_PRIORITY_NORMAL;
+        switch (tc.m_policy)
+        {
+        case OGR_TP_BATCH:
+            priority = THREAD_PRIORITY_BELOW_NORMAL;
+            break;
+        case OGR_TP_IDLE:
+            priority = THREAD_PRIORITY_IDLE;
+            break;
+        case OGR_TP_REALTIME:
+            priority = THREAD_PRIORITY_TIME_CRITICAL;
+            break;
+        default:
+            if (tc.m_nice <= -10)
+                priority = THREAD_PRIORITY_HIGHEST;
+            else if (tc.m_nice < 0)
+                priority = THREAD_PRIORITY_ABOVE_NORMAL;
+            else if (tc.m_nice >= 10)
+                priority = THREAD_PRIORITY_LOWEST;
+            else if (tc.m_nice > 0)
+                priority = THREAD_PRIORITY_BELOW_NORMAL;
+            break;
+        }
+        if (SetThreadPriority(thread, priority) == 0)
+        {
+            runCallback(OGR_CBT_ERROR_RECORDING, "Failed to set priority of"
+                " thread.\n");
+        }
+    }   // applyThreadConfig
+
+    bool resetThreadConfig()
+    {
+        if (!g_scheduling_saved)
+            return true;
+        g_scheduling_saved = false;
+        HANDLE thread = GetCurrentThread();
+        bool reset = SetThreadPriority(thread, g_saved_priority) != 0;
+        if (g_saved_affinity != 0 &&
+            SetThreadAffinityMask(thread, g_saved_affinity) == 0)
+            reset = false;
+        return reset;
+    }   // resetThreadConfig
+#elif defined(__linux__)
+#  include <pthread.h>
+#  include <sched.h>
+#  include <sys/resource.h>
+#  include <sys/syscall.h>
+#  include <unistd.h>
+
+    struct SavedScheduling
+    {
+        cpu_set_t m_cpus;
+        int m_policy;
+        sched_param m_param;
+        int m_nice;
+    };
+    thread_local bool g_scheduling_saved = false;
+    thread_local SavedScheduling g_saved_scheduling;
+
+    void applyThreadConfig(ThreadStage stage)
+    {
+        ThreadConfig tc;
+        if (!getThreadConfig(stage, &tc))
+            return;
+        // Nice level is per thread in linux
+        const id_t tid = (id_t)syscall(SYS_gettid);
+        SavedScheduling& saved = g_saved_scheduling;
+        pthread_getaffinity_np(pthread_self(), sizeof(cpu_set_t),
+            &saved.m_cpus);
+        pthread_getschedparam(pthread_self(), &saved.m_policy,
+            &saved.m_param);
+        saved.m_nice = getpriority(PRIO_PROCESS, tid);
+        g_scheduling_saved = true;
+        if (tc.m_affinity_mask != 0)
+        {
+            cpu_set_t cpus;
+            CPU_ZERO(&cpus);
+            for (unsigned i = 0; i < 64; i++)
+            {
+                if ((tc.m_affinity_mask >> i) & 1)
+                    CPU_SET(i, &cpus);
+            }
+            if (pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t),
+                &cpus) != 0)
+            {
+                runCallback(OGR_CBT_ERROR_RECORDING, "Failed to set cpu"
+                    " affinity of thread.\n");
+            }
+        }
+        int policy = SCHED_OTHER;
+        sched_param param;
+        memset(&param, 0, sizeof(sched_param));
+        switch (tc.m_policy)
+        {
+        case OGR_TP_BATCH:
+            policy = SCHED_BATCH;
+            break;
+        case OGR_TP_IDLE:
+            policy = SCHED_IDLE;
+            break;
+        case OGR_TP_REALTIME:
+            policy = SCHED_RR;
+            param.sched_priority = sched_get_priority_min(SCHED_RR);
+            break;
+        default:
+            break;
+        }
+        if (policy != saved.m_policy &&
+            pthread_setschedparam(pthread_self(), policy, &param) != 0)
+        {
+            runCallback(OGR_CBT_ERROR_RECORDING, "Failed to set scheduling"
+                " policy of thread.\n");
+        }
+        if ((policy == SCHED_OTHER || policy == SCHED_BATCH) &&
+            tc.m_nice != saved.m_nice &&
+            setpriority(PRIO_PROCESS, tid, tc.m_nice) != 0)
+        {
+            runCallback(OGR_CBT_ERROR_RECORDING, "Failed to set nice level"
+                " of thread.\n");
+        }
+    }   // applyThreadConfig
+
+    bool resetThreadConfig()
+    {
+        if (!g_scheduling_saved)
+            return true;
+        g_scheduling_saved = false;
+        // Raising the priority back may need privileges
+        const SavedScheduling& saved = g_saved_scheduling;
+        bool reset = pthread_setschedparam(pthread_self(), saved.m_policy,
+            &saved.m_param) == 0;
+        if (setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid),
+            saved.m_nice) != 0)
+            reset = false;
+        if (pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t),
+            &saved.m_cpus) != 0)
+            reset = false;
+        return reset;
+    }   // resetThreadConfig
+#else
+    void applyThreadConfig(ThreadStage stage)
+    {
+        ThreadConfig tc;
+        if (getThreadConfig(stage, &tc))
+        {
+            runCallback(OGR_CBT_ERROR_RECORDING, "Thread scheduling is not"
+                " supported on this platform.\n");
+        }
+    }   // applyThreadConfig
+
+    bool resetThreadConfig()
+    {
+        return true;
+    }   // resetThreadConfig
+#endif
 // ----------------------------------------------------------------------------
 int ogrCheckAudioEncoder(AudioFormat af)
 {
-    switch (af)
-    {
-    case OGR_AF_VORBIS:
-        return Recorder::vorbisEncoder(NULL);
-    default:
-        return 0;
-    }
+    const AudioEncoderInfo* info = Recorder::getAudioEncoderInfo(af);
+    return info != NULL ? info->m_encoder(NULL) : 0;
 }   // ogrCheckAudioEncoder
 
 // ----------------------------------------------------------------------------
 int ogrCheckVideoEncoder(VideoFormat vf)
 {
-    switch (vf)
-    {
-    case OGR_VF_VP8:
-    case OGR_VF_VP9:
-        return Recorder::vpxEncoder(NULL);
-    case OGR_VF_MJPEG:
-        return Recorder::mjpegWriter(NULL);
-    case OGR_VF_H264:
-        return Recorder::openh264Encoder(NULL);
-    default:
+    const VideoEncoderInfo* info = Recorder::getVideoEncoderInfo(vf);
+    if (info == NULL)
         return 0;
-    }
+    return info->m_load == NULL || info->m_load() ? 1 : 0;
 }   // ogrCheckVideoEncoder
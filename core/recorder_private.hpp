@@ -11,6 +11,7 @@
 #include "openglrecorder.h"
 
 #include <string>
+#include <vector>
 
 extern ogrFucReadPixels ogrReadPixels;
 extern ogrFucGenBuffers ogrGenBuffers;
@@ -20,10 +21,56 @@ extern ogrFucDeleteBuffers ogrDeleteBuffers;
 extern ogrFucMapBuffer ogrMapBuffer;
 extern ogrFucMapBufferRange ogrMapBufferRange;
 extern ogrFucUnmapBuffer ogrUnmapBuffer;
+extern ogrFucGenFramebuffers ogrGenFramebuffers;
+extern ogrFucBindFramebuffer ogrBindFramebuffer;
+extern ogrFucDeleteFramebuffers ogrDeleteFramebuffers;
+extern ogrFucGenRenderbuffers ogrGenRenderbuffers;
+extern ogrFucBindRenderbuffer ogrBindRenderbuffer;
+extern ogrFucRenderbufferStorage ogrRenderbufferStorage;
+extern ogrFucFramebufferRenderbuffer ogrFramebufferRenderbuffer;
+extern ogrFucDeleteRenderbuffers ogrDeleteRenderbuffers;
+extern ogrFucBlitFramebuffer ogrBlitFramebuffer;
+extern ogrFucCreateShader ogrCreateShader;
+extern ogrFucShaderSource ogrShaderSource;
+extern ogrFucCompileShader ogrCompileShader;
+extern ogrFucCreateProgram ogrCreateProgram;
+extern ogrFucAttachShader ogrAttachShader;
+extern ogrFucLinkProgram ogrLinkProgram;
+extern ogrFucGetProgramiv ogrGetProgramiv;
+extern ogrFucUseProgram ogrUseProgram;
+extern ogrFucGetUniformLocation ogrGetUniformLocation;
+extern ogrFucUniform1i ogrUniform1i;
+extern ogrFucUniform4f ogrUniform4f;
+extern ogrFucDeleteShader ogrDeleteShader;
+extern ogrFucDeleteProgram ogrDeleteProgram;
+extern ogrFucGenTextures ogrGenTextures;
+extern ogrFucBindTexture ogrBindTexture;
+extern ogrFucTexImage2D ogrTexImage2D;
+extern ogrFucTexParameteri ogrTexParameteri;
+extern ogrFucCopyTexSubImage2D ogrCopyTexSubImage2D;
+extern ogrFucDeleteTextures ogrDeleteTextures;
+extern ogrFucGenVertexArrays ogrGenVertexArrays;
+extern ogrFucBindVertexArray ogrBindVertexArray;
+extern ogrFucDeleteVertexArrays ogrDeleteVertexArrays;
+extern ogrFucViewport ogrViewport;
+extern ogrFucDrawArrays ogrDrawArrays;
+extern ogrFucGetIntegerv ogrGetIntegerv;
+extern ogrFucIsEnabled ogrIsEnabled;
+extern ogrFucEnable ogrEnable;
+extern ogrFucDisable ogrDisable;
+
+struct OutputProfileEntry
+{
+    OutputProfile m_profile;
+    std::string m_name_suffix;
+};
 
 RecorderConfig* getConfig();
+const std::vector<OutputProfileEntry>& getOutputProfiles();
 const std::string& getSavedName();
 void setThreadName(const char* name);
+void applyThreadConfig(ThreadStage stage);
+bool resetThreadConfig();
 void runCallback(CallBackType cbt, const void* arg);
 
 #endif
@@ -0,0 +1,222 @@
+/* Copyright (c) 2017, libopenglrecorder contributors
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+
+#include "core/trace_recorder.hpp"
+
+#ifdef ENABLE_TRACING
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace TraceRecorder
+{
+    struct TraceEvent
+    {
+        const char* m_name;
+        uint64_t m_frame;
+        int64_t m_time;
+        char m_phase;
+    };
+
+    /* Events of a thread are appended to a list of chunks, other threads
+     * only read the events before m_count. */
+    struct TraceChunk
+    {
+        static const unsigned CAPACITY = 4096;
+        TraceEvent m_events[CAPACITY];
+        std::atomic<unsigned> m_count;
+        std::atomic<TraceChunk*> m_next;
+        TraceChunk() : m_count(0), m_next(NULL) {}
+    };
+
+    struct ThreadTrace
+    {
+        unsigned m_id;
+        /* Recording of the events, chunks of an older one are reused. */
+        std::atomic<unsigned> m_generation;
+        std::atomic<const char*> m_name;
+        TraceChunk* m_first;
+        TraceChunk* m_current;
+        ~ThreadTrace()
+        {
+            TraceChunk* chunk = m_first;
+            while (chunk != NULL)
+            {
+                TraceChunk* next = chunk->m_next.load();
+                delete chunk;
+                chunk = next;
+            }
+        }
+    };
+
+    std::atomic<bool> g_enabled(false);
+    std::atomic<unsigned> g_generation(0);
+    /* Start of tracing in nanoseconds of steady_clock, atomic as spans may
+     * end after the next recording started. */
+    std::atomic<int64_t> g_start(0);
+    std::mutex g_threads_mutex;
+    std::vector<std::unique_ptr<ThreadTrace> > g_threads;
+    std::mutex g_file_mutex;
+    std::string g_trace_file, g_current_file;
+    thread_local ThreadTrace* g_thread_trace = NULL;
+    thread_local const char* g_thread_name = NULL;
+
+    // ------------------------------------------------------------------------
+    /** Return the trace of this thread, cleared if it's from an older
+     *  recording. */
+    ThreadTrace* getThreadTrace()
+    {
+        const unsigned generation = g_generation.load();
+        ThreadTrace* tt = g_thread_trace;
+        if (tt == NULL)
+        {
+            tt = new ThreadTrace();
+            tt->m_generation.store(generation);
+            tt->m_name.store(NULL);
+            tt->m_first = tt->m_current = new TraceChunk();
+            std::lock_guard<std::mutex> lock(g_threads_mutex);
+            tt->m_id = (unsigned)g_threads.size() + 1;
+            g_threads.emplace_back(tt);
+            g_thread_trace = tt;
+        }
+        else if (tt->m_generation.load(std::memory_order_relaxed) !=
+            generation)
+        {
+            for (TraceChunk* chunk = tt->m_first; chunk != NULL;
+                chunk = chunk->m_next.load(std::memory_order_relaxed))
+                chunk->m_count.store(0, std::memory_order_relaxed);
+            tt->m_current = tt->m_first;
+            tt->m_name.store(NULL, std::memory_order_relaxed);
+            tt->m_generation.store(generation, std::memory_order_release);
+        }
+        return tt;
+    }   // getThreadTrace
+
+    // ------------------------------------------------------------------------
+    bool isEnabled()
+    {
+        return g_enabled.load(std::memory_order_acquire);
+    }   // isEnabled
+
+    // ------------------------------------------------------------------------
+    void addEvent(const char* name, uint64_t frame, char phase)
+    {
+        const int64_t time = std::chrono::duration_cast
+            <std::chrono::nanoseconds>(std::chrono::steady_clock::now()
+            .time_since_epoch()).count() -
+            g_start.load(std::memory_order_relaxed);
+        ThreadTrace* tt = getThreadTrace();
+        // Name it after the stage of its first event, the worker pool renames
+        // the thread when the stage is done
+        if (tt->m_name.load(std::memory_order_relaxed) == NULL)
+            tt->m_name.store(g_thread_name, std::memory_order_relaxed);
+        TraceChunk* chunk = tt->m_current;
+        unsigned count = chunk->m_count.load(std::memory_order_relaxed);
+        if (count == TraceChunk::CAPACITY)
+        {
+            TraceChunk* next = chunk->m_next.load(std::memory_order_relaxed);
+            if (next == NULL)
+            {
+                next = new TraceChunk();
+                chunk->m_next.store(next, std::memory_order_release);
+            }
+            tt->m_current = chunk = next;
+            count = 0;
+        }
+        TraceEvent& e = chunk->m_events[count];
+        e.m_name = name;
+        e.m_frame = frame;
+        e.m_time = time;
+        e.m_phase = phase;
+        chunk->m_count.store(count + 1, std::memory_order_release);
+    }   // addEvent
+
+    // ------------------------------------------------------------------------
+    void setThreadName(const char* name)
+    {
+        g_thread_name = name;
+    }   // setThreadName
+
+    // ------------------------------------------------------------------------
+    void setTraceFile(const std::string& file)
+    {
+        std::lock_guard<std::mutex> lock(g_file_mutex);
+        g_trace_file = file;
+    }   // setTraceFile
+
+    // ------------------------------------------------------------------------
+    void start()
+    {
+        std::lock_guard<std::mutex> lock(g_file_mutex);
+        g_current_file = g_trace_file;
+        if (g_current_file.empty())
+            return;
+        g_generation.fetch_add(1);
+        g_start.store(std::chrono::duration_cast<std::chrono::nanoseconds>
+            (std::chrono::steady_clock::now().time_since_epoch()).count());
+        g_enabled.store(true, std::memory_order_release);
+    }   // start
+
+    // ------------------------------------------------------------------------
+    bool stop()
+    {
+        if (!g_enabled.load())
+            return true;
+        g_enabled.store(false);
+        std::unique_lock<std::mutex> ul(g_file_mutex);
+        FILE* trace = fopen(g_current_file.c_str(), "wb");
+        ul.unlock();
+        if (trace == NULL)
+            return false;
+        const unsigned generation = g_generation.load();
+        fprintf(trace, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+        fprintf(trace, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,"
+            "\"tid\":0,\"args\":{\"name\":\"libopenglrecorder\"}}");
+        std::lock_guard<std::mutex> lock(g_threads_mutex);
+        for (std::unique_ptr<ThreadTrace>& tt : g_threads)
+        {
+            if (tt->m_generation.load(std::memory_order_acquire) !=
+                generation)
+                continue;
+            // Only the thread calling ogrCapture is not named
+            const char* name = tt->m_name.load(std::memory_order_relaxed);
+            fprintf(trace, ",\n{\"name\":\"thread_name\",\"ph\":\"M\","
+                "\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}", tt->m_id,
+                name == NULL ? "ogrCapture" : name);
+            TraceChunk* chunk = tt->m_first;
+            while (chunk != NULL)
+            {
+                const unsigned count =
+                    chunk->m_count.load(std::memory_order_acquire);
+                for (unsigned i = 0; i < count; i++)
+                {
+                    const TraceEvent& e = chunk->m_events[i];
+                    fprintf(trace, ",\n{\"name\":\"%s\",\"ph\":\"%c\","
+                        "\"pid\":1,\"tid\":%u,\"ts\":%.3f", e.m_name,
+                        e.m_phase, tt->m_id, (double)e.m_time / 1000.0);
+                    if (e.m_frame != NO_FRAME)
+                    {
+                        fprintf(trace, ",\"args\":{\"frame\":%llu}",
+                            (unsigned long long)e.m_frame);
+                    }
+                    fprintf(trace, "}");
+                }
+                if (count < TraceChunk::CAPACITY)
+                    break;
+                chunk = chunk->m_next.load(std::memory_order_acquire);
+            }
+        }
+        fprintf(trace, "\n]}\n");
+        return fclose(trace) == 0;
+    }   // stop
+};
+
+#endif
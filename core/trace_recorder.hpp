@@ -0,0 +1,86 @@
+/* Copyright (c) 2017, libopenglrecorder contributors
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+
+#ifndef HEADER_TRACE_RECORDER_HPP
+#define HEADER_TRACE_RECORDER_HPP
+
+#include <stdint.h>
+#include <string>
+
+/** Begin and end events of the spans of each stage, written by each thread
+ *  into its own buffer without locking and saved as a Chrome trace event
+ *  JSON file (for chrome://tracing or Perfetto) when a recording stops.
+ *  Without ENABLE_TRACING, \ref OGR_TRACE compiles to nothing.
+ */
+namespace TraceRecorder
+{
+    const uint64_t NO_FRAME = (uint64_t)-1;
+#ifdef ENABLE_TRACING
+    // ------------------------------------------------------------------------
+    bool isEnabled();
+    // ------------------------------------------------------------------------
+    void addEvent(const char* name, uint64_t frame, char phase);
+    // ------------------------------------------------------------------------
+    /** Remember the name of this thread for its events, which must be a
+     *  string literal. */
+    void setThreadName(const char* name);
+    // ------------------------------------------------------------------------
+    /** Called by \ref ogrSetTraceFile, empty file name disables tracing. */
+    void setTraceFile(const std::string& file);
+    // ------------------------------------------------------------------------
+    /** Clear all events and start tracing if there is a trace file. */
+    void start();
+    // ------------------------------------------------------------------------
+    /** Stop tracing and save the events, return false if failed. */
+    bool stop();
+#else
+    // ------------------------------------------------------------------------
+    inline void setThreadName(const char* name) {}
+    // ------------------------------------------------------------------------
+    inline void setTraceFile(const std::string& file) {}
+    // ------------------------------------------------------------------------
+    inline void start() {}
+    // ------------------------------------------------------------------------
+    inline bool stop() { return true; }
+#endif
+};
+
+#ifdef ENABLE_TRACING
+/** A span from its construction to its destruction. */
+class TraceScope
+{
+private:
+    const char* m_name;
+
+    uint64_t m_frame;
+
+    bool m_active;
+
+public:
+    // ------------------------------------------------------------------------
+    TraceScope(const char* name, uint64_t frame)
+    {
+        m_name = name;
+        m_frame = frame;
+        m_active = TraceRecorder::isEnabled();
+        if (m_active)
+            TraceRecorder::addEvent(m_name, m_frame, 'B');
+    }
+    // ------------------------------------------------------------------------
+    ~TraceScope()
+    {
+        if (m_active)
+            TraceRecorder::addEvent(m_name, m_frame, 'E');
+    }
+
+};
+#define OGR_TRACE(name, frame) TraceScope ogr_trace_scope(name, frame)
+#else
+#define OGR_TRACE(name, frame)
+#endif
+
+#endif
@@ -0,0 +1,220 @@
+/* Copyright (c) 2017, libopenglrecorder contributors
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+
+#include "core/video_encoder.hpp"
+#include "core/buffer_arena.hpp"
+#include "core/capture_library.hpp"
+#include "core/cpu_governor.hpp"
+#include "core/encoder_controller.hpp"
+#include "core/encoder_registry.hpp"
+#include "core/gop_encoder.hpp"
+#include "core/pipeline_stats.hpp"
+#include "core/recorder_private.hpp"
+#include "core/trace_recorder.hpp"
+
+#include <memory>
+
+namespace Recorder
+{
+    // ------------------------------------------------------------------------
+    void writeVideoPacket(const void* data, uint32_t size,
+                          int64_t frame_index, bool key_frame, FILE* out)
+    {
+        fwrite(&size, 1, sizeof(uint32_t), out);
+        fwrite(&frame_index, 1, sizeof(int64_t), out);
+        fwrite(&key_frame, 1, sizeof(bool), out);
+        fwrite(data, 1, size, out);
+    }   // writeVideoPacket
+    // ------------------------------------------------------------------------
+    /** Encode a group of pictures of the backlog with a new encoder, see
+     *  encodeParallelGOPs. */
+    static bool encodeGOP(CaptureLibrary* cl, VideoOutput* vo,
+                          const VideoEncoderInfo* info,
+                          const GOPFrame* frames, unsigned count,
+                          tjhandle handle, YUVScaler* scaler, uint8_t* yuv,
+                          FILE* out)
+    {
+        std::unique_ptr<VideoEncoder> encoder(info->m_create());
+        if (!encoder->init(vo->getRecorderConfig(), true))
+            return false;
+        const unsigned yuv_size = vo->getRecorderConfig().m_output_width *
+            vo->getRecorderConfig().m_output_height * 3 / 2;
+        bool ok = true;
+        for (unsigned i = 0; i < count && ok; i++)
+        {
+            if (vo->yuvConversion(frames[i].m_jpg, frames[i].m_jpg_size, yuv,
+                frames[i].m_frame_index, handle, scaler) < 0)
+                continue;
+            ScopedLatency encode_latency(&cl->getStats()->m_encode);
+            OGR_TRACE(info->m_thread_name, frames[i].m_frame_index);
+            ok = encoder->encodeFrame(yuv, yuv_size,
+                frames[i].m_frame_index, out) >= 0;
+        }
+        if (ok)
+            encoder->flush(out);
+        return ok;
+    }   // encodeGOP
+    // ------------------------------------------------------------------------
+    /** Encoder thread of a VideoOutput, it takes the frames of its queue,
+     *  decodes them to I420 if the codec needs it and writes the packets of
+     *  the codec registered for the format to the .video file. */
+    int videoEncoder(CaptureLibrary* cl, VideoOutput* vo)
+    {
+        const VideoEncoderInfo* info =
+            getVideoEncoderInfo(vo->getEncoderFormat());
+        if (info == NULL || (info->m_load != NULL && !info->m_load()))
+            return 1;
+        setThreadName(info->m_thread_name);
+        applyThreadConfig(OGR_TS_VIDEO_ENCODER);
+        FILE* video_data = fopen((vo->getName() + ".video").c_str(), "wb");
+        if (video_data == NULL)
+        {
+            runCallback(OGR_CBT_ERROR_RECORDING, "Failed to open file for"
+                " writing video.\n");
+            return 1;
+        }
+        // Created by ogrWarmup or after the previous recording if possible
+        std::string codec_private;
+        std::unique_ptr<VideoEncoder> encoder(vo->takeEncoder(&codec_private));
+        bool initialized = encoder.get() != NULL;
+        if (!initialized)
+        {
+            encoder.reset(info->m_create());
+            initialized = encoder->init(vo->getRecorderConfig(), false) &&
+                encoder->getCodecPrivate(&codec_private);
+        }
+        if (!initialized)
+        {
+            runCallback(OGR_CBT_ERROR_RECORDING, "Failed to initialize video"
+                " encoder.\n");
+            fclose(video_data);
+            return 1;
+        }
+        const uint32_t private_header_size = (uint32_t)codec_private.size();
+        fwrite(&private_header_size, 1, sizeof(uint32_t), video_data);
+        fwrite(codec_private.data(), 1, codec_private.size(), video_data);
+
+        const bool yuv_input = encoder->takesYUV();
+        const unsigned yuv_size = vo->getRecorderConfig().m_output_width *
+            vo->getRecorderConfig().m_output_height * 3 / 2;
+        // Pre-faulted by CaptureLibrary::reset and kept for next recording
+        uint8_t* yuv = yuv_input ?
+            vo->getBufferArena()->get(BufferArena::BT_ENCODER_YUV,
+            yuv_size) : NULL;
+        int64_t frames_encoded = 0;
+        float last_size = -1.0f;
+        int cur_finished_count = 0;
+        EncoderController controller(vo->getRecorderConfig(),
+            cl->getStats(), cl->getCPUGovernor());
+        bool draining = false;
+        bool parallel = false;
+        while (true)
+        {
+            cl->getCPUGovernor()->throttle();
+            std::unique_lock<std::mutex> ul(*vo->getJPGListMutex());
+            vo->getJPGListCV()->wait(ul, [&vo]
+                { return !vo->getJPGList()->empty(); });
+            auto& p = vo->getJPGList()->front();
+            uint8_t* jpg = std::get<0>(p);
+            uint32_t jpg_size = std::get<1>(p);
+            int frame_count = std::get<2>(p);
+            if (jpg == NULL && frame_count > 0)
+            {
+                // Unchanged frame, extend the duration of the last one
+                vo->getJPGList()->pop_front();
+                ul.unlock();
+                frames_encoded += frame_count;
+                continue;
+            }
+            else if (jpg == NULL)
+            {
+                vo->getJPGList()->clear();
+                ul.unlock();
+                if (yuv_input && vo->displayingProgress())
+                {
+                    int rate = 99;
+                    runCallback(OGR_CBT_PROGRESS_RECORDING, &rate);
+                }
+                break;
+            }
+            vo->getJPGList()->pop_front();
+            const unsigned queue_depth = (unsigned)vo->getJPGList()->size();
+            ul.unlock();
+            if (cl->isCancelled())
+            {
+                cl->releaseJPG(jpg);
+                continue;
+            }
+            if (!yuv_input)
+            {
+                ScopedLatency encode_latency(&cl->getStats()->m_encode);
+                OGR_TRACE(info->m_thread_name, frames_encoded);
+                ScopedCPUTime cpu_time(cl->getCPUGovernor());
+                if (encoder->encodeFrame(jpg, jpg_size, frames_encoded,
+                    video_data) > 0)
+                    frames_encoded += frame_count;
+                cl->releaseJPG(jpg);
+                continue;
+            }
+            const auto frame_start = std::chrono::steady_clock::now();
+            ScopedCPUTime cpu_time(cl->getCPUGovernor());
+            if (!draining && cl->isDraining())
+            {
+                draining = true;
+                controller.stop();
+                encoder->startDrain();
+                parallel = useParallelGOPs(cl, vo, queue_depth);
+            }
+            if (vo->displayingProgress())
+            {
+                if (last_size == -1.0f)
+                    last_size = (float)(vo->getJPGList()->size());
+                cur_finished_count += frame_count;
+                int rate = (int)(cur_finished_count / last_size * 100.0f);
+                rate = rate > 99 ? 99 : rate;
+                runCallback(OGR_CBT_PROGRESS_RECORDING, &rate);
+            }
+            int ret = vo->yuvConversion(jpg, jpg_size, yuv, frames_encoded);
+            cl->releaseJPG(jpg);
+            if (ret < 0)
+                continue;
+            ScopedLatency encode_latency(&cl->getStats()->m_encode);
+            OGR_TRACE(info->m_thread_name, frames_encoded);
+            if (encoder->encodeFrame(yuv, yuv_size, frames_encoded,
+                video_data) > 0)
+                frames_encoded += frame_count;
+            if (controller.update(queue_depth, std::chrono::duration_cast
+                <std::chrono::nanoseconds>(std::chrono::steady_clock::now() -
+                frame_start).count()))
+            {
+                encoder->adjust(controller);
+            }
+            if (parallel)
+            {
+                // The rest goes to new encoders, so finish this one first
+                encoder->flush(video_data);
+                frames_encoded = encodeParallelGOPs(cl, vo, frames_encoded,
+                    video_data, [cl, vo, info](const GOPFrame* frames,
+                    unsigned count, tjhandle handle, YUVScaler* scaler,
+                    uint8_t* gop_yuv, FILE* out)
+                    {
+                        return encodeGOP(cl, vo, info, frames, count, handle,
+                            scaler, gop_yuv, out);
+                    });
+                break;
+            }
+        }
+
+        // The file is discarded on cancel, so don't wait for the lagged
+        // frames
+        if (!cl->isCancelled())
+            encoder->flush(video_data);
+        encoder.reset();
+        fclose(video_data);
+        return 1;
+    }   // videoEncoder
+};
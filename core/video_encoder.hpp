@@ -0,0 +1,74 @@
+/* Copyright (c) 2017, libopenglrecorder contributors
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+
+#ifndef HEADER_VIDEO_ENCODER_HPP
+#define HEADER_VIDEO_ENCODER_HPP
+
+#include "openglrecorder.h"
+
+#include <cstdio>
+#include <stdint.h>
+#include <string>
+
+class CaptureLibrary;
+class EncoderController;
+class VideoOutput;
+
+/** A codec of the encoder thread of a VideoOutput, which owns the queue,
+ *  the .video file, the EncoderController and the parallel groups of
+ *  pictures, so a codec only turns frames into packets. Each is created by
+ *  the VideoEncoderInfo of its format in the encoder registry.
+ */
+class VideoEncoder
+{
+public:
+    // ------------------------------------------------------------------------
+    virtual ~VideoEncoder() {}
+    // ------------------------------------------------------------------------
+    /** Initialize for the size, frame rate and bitrate of config. A gop
+     *  encoder encodes one group of pictures of the backlog on a single
+     *  core at its fastest speed, see encodeParallelGOPs. */
+    virtual bool init(const RecorderConfig& config, bool gop) = 0;
+    // ------------------------------------------------------------------------
+    /** Codec private data of the video track, after \ref init. */
+    virtual bool getCodecPrivate(std::string* data)
+    {
+        data->clear();
+        return true;
+    }
+    // ------------------------------------------------------------------------
+    /** Encode I420 frames of the output size, otherwise the compressed
+     *  frames of the queue are given as they are. */
+    virtual bool takesYUV() const                              { return true; }
+    // ------------------------------------------------------------------------
+    /** Encode a frame and write the packets it gives like the .video file.
+     *  Return -1 on failure, 0 if the codec skipped the frame, so its frame
+     *  index is used by the next one, or 1. */
+    virtual int encodeFrame(const uint8_t* frame, unsigned size,
+                            int64_t frame_index, FILE* out) = 0;
+    // ------------------------------------------------------------------------
+    /** Write the packets of frames still held back by the codec. */
+    virtual void flush(FILE* out)                                           {}
+    // ------------------------------------------------------------------------
+    /** Apply the level of EncoderController. */
+    virtual void adjust(const EncoderController& controller)               {}
+    // ------------------------------------------------------------------------
+    /** Capture stopped, finish the queued frames as fast as possible. */
+    virtual void startDrain()                                               {}
+
+};
+
+namespace Recorder
+{
+    /** Write a packet like the .video file, see writeMKV. */
+    void writeVideoPacket(const void* data, uint32_t size,
+                          int64_t frame_index, bool key_frame, FILE* out);
+    // ------------------------------------------------------------------------
+    int videoEncoder(CaptureLibrary* cl, VideoOutput* vo);
+};
+
+#endif
@@ -0,0 +1,185 @@
+/* Copyright (c) 2017, libopenglrecorder contributors
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+
+#include "core/video_output.hpp"
+#include "core/buffer_arena.hpp"
+#include "core/capture_library.hpp"
+#include "core/encoder_registry.hpp"
+#include "core/frame_scaler.hpp"
+#include "core/jpg_buffer_pool.hpp"
+#include "core/recorder_private.hpp"
+#include "core/video_encoder.hpp"
+#include "core/worker_pool.hpp"
+
+#include <functional>
+
+// ----------------------------------------------------------------------------
+VideoOutput::VideoOutput(CaptureLibrary* cl, const RecorderConfig& config,
+                         const std::string& name_suffix, bool primary)
+{
+    m_capture_library = cl;
+    m_config = config;
+    m_name_suffix = name_suffix;
+    m_primary = primary;
+    m_decompress_handle = tjInitDecompress();
+    m_arena.reset(new BufferArena(m_config.m_huge_pages > 0,
+        m_config.m_lock_memory > 0));
+    // Frames are converted at the size of the RecorderConfig, smaller
+    // outputs scale them after decoding
+    const RecorderConfig& rc = cl->getRecorderConfig();
+    if (m_config.m_output_width != rc.m_output_width ||
+        m_config.m_output_height != rc.m_output_height)
+    {
+        m_scaler.reset(createScaler());
+    }
+}   // VideoOutput
+
+// ----------------------------------------------------------------------------
+VideoOutput::~VideoOutput()
+{
+    for (auto& p : m_jpg_list)
+        JPGBufferPool::release(std::get<0>(p));
+    m_scaler.reset();
+    m_arena.reset();
+    tjDestroy(m_decompress_handle);
+}   // ~VideoOutput
+
+// ----------------------------------------------------------------------------
+void VideoOutput::start()
+{
+    allocateBuffers();
+    m_video_enc_task = m_capture_library->getWorkerPool()->submit(
+        std::bind(Recorder::videoEncoder, m_capture_library, this));
+}   // start
+
+// ----------------------------------------------------------------------------
+void VideoOutput::allocateBuffers()
+{
+    // Allocate and fault in the buffer of the encoder here, so it doesn't
+    // stall on page faults when the recording starts
+    if ((m_config.m_video_format != OGR_VF_MJPEG && !isLossless()) ||
+        m_config.m_deferred_encoding > 0)
+    {
+        m_arena->get(BufferArena::BT_ENCODER_YUV,
+            m_config.m_output_width * m_config.m_output_height * 3 / 2);
+    }
+}   // allocateBuffers
+
+// ----------------------------------------------------------------------------
+void VideoOutput::prepareEncoder()
+{
+    if (m_next_encoder)
+        return;
+    const VideoEncoderInfo* info =
+        Recorder::getVideoEncoderInfo(getEncoderFormat());
+    if (info == NULL || (info->m_load != NULL && !info->m_load()))
+        return;
+    std::unique_ptr<VideoEncoder> encoder(info->m_create());
+    std::string codec_private;
+    // Failures are reported by the encoder thread when it retries
+    if (!encoder->init(m_config, false) ||
+        !encoder->getCodecPrivate(&codec_private))
+        return;
+    m_next_encoder = std::move(encoder);
+    m_next_codec_private = codec_private;
+}   // prepareEncoder
+
+// ----------------------------------------------------------------------------
+VideoEncoder* VideoOutput::takeEncoder(std::string* codec_private)
+{
+    if (!m_next_encoder)
+        return NULL;
+    *codec_private = m_next_codec_private;
+    return m_next_encoder.release();
+}   // takeEncoder
+
+// ----------------------------------------------------------------------------
+VideoFormat VideoOutput::getEncoderFormat() const
+{
+    // Deferred encoding saves MJPEG now and transcodes in transcodeRecording
+    return m_config.m_deferred_encoding > 0 ? OGR_VF_MJPEG :
+        m_config.m_video_format;
+}   // getEncoderFormat
+
+// ----------------------------------------------------------------------------
+void VideoOutput::wait()
+{
+    if (m_video_enc_task.valid())
+        m_video_enc_task.wait();
+}   // wait
+
+// ----------------------------------------------------------------------------
+unsigned VideoOutput::queueFrame(uint8_t* jpg, unsigned jpg_size,
+                                 int frame_count)
+{
+    std::lock_guard<std::mutex> lg(m_jpg_list_mutex);
+    m_jpg_list.emplace_back(jpg, jpg_size, frame_count);
+    m_jpg_list_ready.notify_one();
+    return (unsigned)m_jpg_list.size();
+}   // queueFrame
+
+// ----------------------------------------------------------------------------
+void VideoOutput::finish(bool discard)
+{
+    std::lock_guard<std::mutex> lg(m_jpg_list_mutex);
+    if (discard)
+    {
+        // Throw away the backlog, the encoder only needs the end marker
+        for (auto& p : m_jpg_list)
+            JPGBufferPool::release(std::get<0>(p));
+        m_jpg_list.clear();
+    }
+    m_jpg_list.emplace_back((uint8_t*)NULL, 0, 0);
+    m_jpg_list_ready.notify_one();
+}   // finish
+
+// ----------------------------------------------------------------------------
+int VideoOutput::yuvConversion(uint8_t* jpeg_buffer, unsigned jpeg_size,
+                               uint8_t* yuv_buffer, uint64_t frame,
+                               tjhandle handle, YUVScaler* scaler)
+{
+    if (handle == NULL)
+    {
+        handle = m_decompress_handle;
+        scaler = m_scaler.get();
+    }
+    assert(!m_scaler || scaler != NULL);
+    if (scaler == NULL)
+    {
+        return m_capture_library->yuvConversion(jpeg_buffer, jpeg_size,
+            yuv_buffer, frame, handle);
+    }
+    int ret = m_capture_library->yuvConversion(jpeg_buffer, jpeg_size,
+        scaler->getInput(), frame, handle);
+    if (ret == 0)
+        scaler->scale(yuv_buffer);
+    return ret;
+}   // yuvConversion
+
+// ----------------------------------------------------------------------------
+YUVScaler* VideoOutput::createScaler() const
+{
+    const RecorderConfig& rc = m_capture_library->getRecorderConfig();
+    if (m_config.m_output_width == rc.m_output_width &&
+        m_config.m_output_height == rc.m_output_height)
+        return NULL;
+    return new YUVScaler(rc.m_output_width, rc.m_output_height,
+        m_config.m_output_width, m_config.m_output_height,
+        m_config.m_scale_filter);
+}   // createScaler
+
+// ----------------------------------------------------------------------------
+std::string VideoOutput::getName() const
+{
+    return getSavedName() + m_name_suffix;
+}   // getName
+
+// ----------------------------------------------------------------------------
+bool VideoOutput::displayingProgress() const
+{
+    return m_primary && m_capture_library->displayingProgress();
+}   // displayingProgress
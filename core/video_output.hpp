@@ -0,0 +1,142 @@
+/* Copyright (c) 2017, libopenglrecorder contributors
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+
+#ifndef HEADER_VIDEO_OUTPUT_HPP
+#define HEADER_VIDEO_OUTPUT_HPP
+
+#include "openglrecorder.h"
+
+#include <condition_variable>
+#include <future>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <tuple>
+
+#include <turbojpeg.h>
+
+class BufferArena;
+class CaptureLibrary;
+class VideoEncoder;
+class YUVScaler;
+
+// JPEG data, its size and the number of frames it lasts, a NULL JPEG with a
+// positive frame count extends the duration of the previous one, and a NULL
+// JPEG with zero frame count marks the end of recording.
+typedef std::list<std::tuple<uint8_t*, unsigned, int> > JPGList;
+
+/** A video file saved from the frames of a recording, one for the
+ *  RecorderConfig and one for each output profile. Each has its own queue of
+ *  compressed frames and encoder thread, the frames themselves are shared
+ *  between the outputs with reference counting.
+ */
+class VideoOutput
+{
+private:
+    CaptureLibrary* m_capture_library;
+
+    /* Copy of the recorder config with the video format, size and bitrate
+     * of this output. */
+    RecorderConfig m_config;
+
+    std::string m_name_suffix;
+
+    bool m_primary;
+
+    JPGList m_jpg_list;
+    std::mutex m_jpg_list_mutex;
+    std::condition_variable m_jpg_list_ready;
+
+    tjhandle m_decompress_handle;
+
+    /* Only if this output is smaller than the frames of the recording. */
+    std::unique_ptr<YUVScaler> m_scaler;
+
+    /* For the buffers of the encoder thread. */
+    std::unique_ptr<BufferArena> m_arena;
+
+    std::future<void> m_video_enc_task;
+
+    /* Initialized encoder for the next recording, created by
+     * \ref prepareEncoder when warming up and after each recording. Only
+     * touched by the warm up task or by the encoder thread, which
+     * CaptureLibrary never runs at the same time. */
+    std::unique_ptr<VideoEncoder> m_next_encoder;
+
+    std::string m_next_codec_private;
+
+public:
+    // ------------------------------------------------------------------------
+    VideoOutput(CaptureLibrary* cl, const RecorderConfig& config,
+                const std::string& name_suffix, bool primary);
+    // ------------------------------------------------------------------------
+    ~VideoOutput();
+    // ------------------------------------------------------------------------
+    /** Fault in the buffers of the encoder and start its thread. */
+    void start();
+    // ------------------------------------------------------------------------
+    /** Allocate and fault in the buffers of the encoder. */
+    void allocateBuffers();
+    // ------------------------------------------------------------------------
+    /** Create and initialize the encoder of the next recording, so its
+     *  first frames don't wait for it. */
+    void prepareEncoder();
+    // ------------------------------------------------------------------------
+    /** The encoder from \ref prepareEncoder with its codec private data,
+     *  NULL if there is none. The caller owns it. */
+    VideoEncoder* takeEncoder(std::string* codec_private);
+    // ------------------------------------------------------------------------
+    /** Format of the encoder thread, MJPEG if the encoding is deferred. */
+    VideoFormat getEncoderFormat() const;
+    // ------------------------------------------------------------------------
+    /** Wait for the encoder thread after \ref finish. */
+    void wait();
+    // ------------------------------------------------------------------------
+    /** Queue a compressed frame, the caller gives its reference of jpg to
+     *  this output. Returns the number of queued frames. */
+    unsigned queueFrame(uint8_t* jpg, unsigned jpg_size, int frame_count);
+    // ------------------------------------------------------------------------
+    /** Queue the end of recording, with discard the queued frames are
+     *  released instead of being encoded. */
+    void finish(bool discard);
+    // ------------------------------------------------------------------------
+    /** Decode a JPEG to I420 of the size of this output, with the
+     *  decompressor and scaler of the encoder thread unless the ones of the
+     *  calling thread are given. frame is the encoded frame traced. */
+    int yuvConversion(uint8_t* jpeg_buffer, unsigned jpeg_size,
+                      uint8_t* yuv_buffer, uint64_t frame,
+                      tjhandle handle = NULL, YUVScaler* scaler = NULL);
+    // ------------------------------------------------------------------------
+    /** New scaler for another thread calling \ref yuvConversion, NULL if
+     *  this output is not scaled. */
+    YUVScaler* createScaler() const;
+    // ------------------------------------------------------------------------
+    /** Saved name of this output, without extension. */
+    std::string getName() const;
+    // ------------------------------------------------------------------------
+    /** Takes frames of OGR_VF_LOSSLESS instead of JPEG. */
+    bool isLossless() const
+                       { return m_config.m_video_format == OGR_VF_LOSSLESS; }
+    // ------------------------------------------------------------------------
+    /** Only the output of the RecorderConfig reports progress. */
+    bool displayingProgress() const;
+    // ------------------------------------------------------------------------
+    const RecorderConfig& getRecorderConfig() const       { return m_config; }
+    // ------------------------------------------------------------------------
+    JPGList* getJPGList()                               { return &m_jpg_list; }
+    // ------------------------------------------------------------------------
+    std::mutex* getJPGListMutex()                 { return &m_jpg_list_mutex; }
+    // ------------------------------------------------------------------------
+    std::condition_variable* getJPGListCV()       { return &m_jpg_list_ready; }
+    // ------------------------------------------------------------------------
+    BufferArena* getBufferArena() const                { return m_arena.get(); }
+
+};
+
+#endif
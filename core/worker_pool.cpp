@@ -0,0 +1,166 @@
+/* Copyright (c) 2017, libopenglrecorder contributors
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+
+#include "core/worker_pool.hpp"
+#include "core/cpu_governor.hpp"
+#include "core/recorder_private.hpp"
+
+#include <algorithm>
+#include <memory>
+
+/* Parts of a parallelFor job, shared with the helper tasks which may only
+ * start after the job has been finished by others. */
+struct ParallelJob
+{
+    std::mutex m_mutex;
+    std::condition_variable m_done;
+    const std::function<void(unsigned)>* m_job;
+    unsigned m_count, m_next, m_finished;
+};
+
+// ----------------------------------------------------------------------------
+/** Run parts of the job until none is left. */
+static void runParallelJob(ParallelJob* pj)
+{
+    std::unique_lock<std::mutex> ul(pj->m_mutex);
+    while (pj->m_next < pj->m_count)
+    {
+        const unsigned i = pj->m_next++;
+        ul.unlock();
+        (*pj->m_job)(i);
+        ul.lock();
+        if (++pj->m_finished == pj->m_count)
+            pj->m_done.notify_one();
+    }
+}   // runParallelJob
+
+// ----------------------------------------------------------------------------
+WorkerPool::WorkerPool(unsigned thread_count)
+{
+    m_idle_threads = 0;
+    m_exit = false;
+    m_cpu_governor = NULL;
+    std::lock_guard<std::mutex> lock(m_task_mutex);
+    for (unsigned i = 0; i < thread_count; i++)
+        startThread();
+}   // WorkerPool
+
+// ----------------------------------------------------------------------------
+WorkerPool::~WorkerPool()
+{
+    std::unique_lock<std::mutex> ul(m_task_mutex);
+    m_exit = true;
+    m_task_ready.notify_all();
+    ul.unlock();
+    for (std::thread& t : m_threads)
+        t.join();
+}   // ~WorkerPool
+
+// ----------------------------------------------------------------------------
+/** Called with m_task_mutex locked. */
+void WorkerPool::startThread()
+{
+    for (std::thread::id id : m_retired)
+    {
+        for (auto it = m_threads.begin(); it != m_threads.end(); it++)
+        {
+            if (it->get_id() == id)
+            {
+                it->join();
+                m_threads.erase(it);
+                break;
+            }
+        }
+    }
+    m_retired.clear();
+    m_idle_threads++;
+    m_threads.emplace_back(WorkerPool::workerLoop, this);
+}   // startThread
+
+// ----------------------------------------------------------------------------
+void WorkerPool::workerLoop(WorkerPool* wp)
+{
+    setThreadName("ogrWorker");
+    std::unique_lock<std::mutex> ul(wp->m_task_mutex);
+    while (true)
+    {
+        wp->m_task_ready.wait(ul, [&wp]
+            { return wp->m_exit || !wp->m_tasks.empty(); });
+        if (wp->m_tasks.empty())
+            return;
+        std::function<void()> task = std::move(wp->m_tasks.front());
+        wp->m_tasks.pop_front();
+        wp->m_idle_threads--;
+        ul.unlock();
+        task();
+        // Stages name their thread and may change its scheduling, don't keep
+        // them for the next task, a thread whose lowered priority can't be
+        // raised back without privileges is not reused
+        setThreadName("ogrWorker");
+        const bool reusable = resetThreadConfig();
+        ul.lock();
+        if (!reusable)
+        {
+            wp->m_retired.push_back(std::this_thread::get_id());
+            return;
+        }
+        wp->m_idle_threads++;
+    }
+}   // workerLoop
+
+// ----------------------------------------------------------------------------
+std::future<void> WorkerPool::submit(const std::function<void()>& task)
+{
+    // std::function needs a copyable callable
+    std::shared_ptr<std::packaged_task<void()> > pt =
+        std::make_shared<std::packaged_task<void()> >(task);
+    std::future<void> result = pt->get_future();
+    std::lock_guard<std::mutex> lock(m_task_mutex);
+    m_tasks.emplace_back([pt]() { (*pt)(); });
+    if (m_tasks.size() > m_idle_threads)
+        startThread();
+    m_task_ready.notify_one();
+    return result;
+}   // submit
+
+// ----------------------------------------------------------------------------
+void WorkerPool::parallelFor(unsigned count,
+                             const std::function<void(unsigned)>& job)
+{
+    if (count == 0)
+        return;
+    if (count == 1)
+    {
+        job(0);
+        return;
+    }
+    std::shared_ptr<ParallelJob> pj = std::make_shared<ParallelJob>();
+    pj->m_job = &job;
+    pj->m_count = count;
+    pj->m_next = 0;
+    pj->m_finished = 0;
+    std::unique_lock<std::mutex> ul(m_task_mutex);
+    // Queued tasks will take some of the idle threads first
+    const unsigned queued = (unsigned)m_tasks.size();
+    const unsigned helpers = m_idle_threads > queued ?
+        std::min(count - 1, m_idle_threads - queued) : 0;
+    // The caller counts its own part as the CPU time of its stage
+    CPUGovernor* cg = m_cpu_governor;
+    for (unsigned i = 0; i < helpers; i++)
+    {
+        m_tasks.emplace_back([pj, cg]()
+            {
+                ScopedCPUTime cpu_time(cg);
+                runParallelJob(pj.get());
+            });
+    }
+    m_task_ready.notify_all();
+    ul.unlock();
+    runParallelJob(pj.get());
+    std::unique_lock<std::mutex> ulj(pj->m_mutex);
+    pj->m_done.wait(ulj, [&pj] { return pj->m_finished == pj->m_count; });
+}   // parallelFor
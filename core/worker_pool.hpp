@@ -0,0 +1,72 @@
+/* Copyright (c) 2017, libopenglrecorder contributors
+ *
+ * Use of this source code is governed by a BSD-style license
+ * that can be found in the LICENSE file in the root of the source
+ * tree.
+ */
+
+#ifndef HEADER_WORKER_POOL_HPP
+#define HEADER_WORKER_POOL_HPP
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class CPUGovernor;
+
+/** The threads of libopenglrecorder, kept for its whole lifetime. Each stage
+ *  of a recording (capture conversion, video and audio encoding, muxing) is
+ *  submitted as a task, and a job of many parts can be split between the
+ *  idle threads, the calling thread works on the parts too.
+ */
+class WorkerPool
+{
+private:
+    std::vector<std::thread> m_threads;
+
+    std::mutex m_task_mutex;
+
+    std::condition_variable m_task_ready;
+
+    std::deque<std::function<void()> > m_tasks;
+
+    /* Threads not running a task. */
+    unsigned m_idle_threads;
+
+    /* Threads which have exited because they could not reset the scheduling
+     * of a stage, joined when a new one is started. */
+    std::vector<std::thread::id> m_retired;
+
+    bool m_exit;
+
+    /* The CPU time of threads helping with parallelFor is added to it. */
+    CPUGovernor* m_cpu_governor;
+
+    // ------------------------------------------------------------------------
+    static void workerLoop(WorkerPool* wp);
+    // ------------------------------------------------------------------------
+    void startThread();
+
+public:
+    // ------------------------------------------------------------------------
+    WorkerPool(unsigned thread_count);
+    // ------------------------------------------------------------------------
+    ~WorkerPool();
+    // ------------------------------------------------------------------------
+    /** Run task on a thread of the pool. Stages wait for each other, so a
+     *  thread is added if none is idle instead of queuing the task. */
+    std::future<void> submit(const std::function<void()>& task);
+    // ------------------------------------------------------------------------
+    /** Call job with every index in [0, count), returns when all are done.
+     *  Only idle threads help, it never waits for a busy one. */
+    void parallelFor(unsigned count, const std::function<void(unsigned)>& job);
+    // ------------------------------------------------------------------------
+    void setCPUGovernor(CPUGovernor* cg)                { m_cpu_governor = cg; }
+
+};
+
+#endif
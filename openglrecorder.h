@@ -65,12 +65,161 @@ typedef enum
      * H264 encoder by openh264.
      */
     OGR_VF_H264,
+    /**
+     * Lossless intra-only encoder, always present. Each frame is compressed
+     * on its own in stripes by the conversion threads, which is much faster
+     * than other encoders but gives large files. Saved in mkv with codec ID
+     * V_OGR/LOSSLESS, see core/lossless_codec.hpp for the frame format.
+     */
+    OGR_VF_LOSSLESS,
     /**
      * Total numbers of video encoder.
      */
     OGR_VF_COUNT
 } VideoFormat;
 
+/**
+ * List of filters for scaling down the frame buffer on the CPU, see
+ * \ref RecorderConfig::m_output_width.
+ */
+typedef enum
+{
+    /**
+     * Bilinear filter, fastest but it skips source pixels when scaling down
+     * more than half.
+     */
+    OGR_SF_BILINEAR = 0,
+    /**
+     * Area averaging filter, every source pixel is used so the result is
+     * sharper without aliasing, slower for large scaling ratios.
+     */
+    OGR_SF_AREA,
+    /**
+     * Total numbers of scaling filter.
+     */
+    OGR_SF_COUNT
+} ScaleFilter;
+
+/**
+ * List of pixel formats for reading back the frame buffer, use the one
+ * native to the frame buffer of your driver so that it doesn't need to
+ * convert during glReadPixels, see \ref RecorderConfig::m_readback_format.
+ */
+typedef enum
+{
+    /**
+     * GL_RGBA with GL_UNSIGNED_BYTE, supported everywhere.
+     */
+    OGR_RF_RGBA = 0,
+    /**
+     * GL_BGRA with GL_UNSIGNED_BYTE, not in OpenGL ES without extension.
+     */
+    OGR_RF_BGRA,
+    /**
+     * GL_BGRA with GL_UNSIGNED_INT_8_8_8_8_REV, which is the native format
+     * of many desktop drivers, not in OpenGL ES.
+     */
+    OGR_RF_BGRA_REV,
+    /**
+     * GL_RGB with GL_UNSIGNED_BYTE, 3 bytes per pixel.
+     */
+    OGR_RF_RGB,
+    /**
+     * GL_BGR with GL_UNSIGNED_BYTE, 3 bytes per pixel, not in OpenGL ES.
+     */
+    OGR_RF_BGR,
+    /**
+     * Total numbers of read back format.
+     */
+    OGR_RF_COUNT
+} ReadbackFormat;
+
+/**
+ * List of stages of a recording, each runs on its own thread, see
+ * \ref ogrSetThreadConfig.
+ */
+typedef enum
+{
+    /**
+     * Color conversion, scaling and JPEG compression of captured frames.
+     */
+    OGR_TS_CONVERSION = 0,
+    /**
+     * Video encoder in \ref VideoFormat.
+     */
+    OGR_TS_VIDEO_ENCODER,
+    /**
+     * Audio capture by wasapi or pulseaudio.
+     */
+    OGR_TS_AUDIO_RECORDER,
+    /**
+     * Audio encoder in \ref AudioFormat.
+     */
+    OGR_TS_AUDIO_ENCODER,
+    /**
+     * Muxing of the mkv after \ref ogrStopCapture.
+     */
+    OGR_TS_MUXER,
+    /**
+     * Total numbers of thread stage.
+     */
+    OGR_TS_COUNT
+} ThreadStage;
+
+/**
+ * List of scheduling policies for the thread of a \ref ThreadStage.
+ */
+typedef enum
+{
+    /**
+     * Default scheduling of the system.
+     */
+    OGR_TP_NORMAL = 0,
+    /**
+     * SCHED_BATCH in linux, for cpu bound work which is not latency
+     * sensitive like encoders. Below normal priority in windows.
+     */
+    OGR_TP_BATCH,
+    /**
+     * SCHED_IDLE in linux, only run when a cpu has nothing else to do. Idle
+     * priority in windows.
+     */
+    OGR_TP_IDLE,
+    /**
+     * SCHED_RR in linux, which needs CAP_SYS_NICE or a RLIMIT_RTPRIO
+     * limit, useful for audio capture. Time critical priority in windows.
+     */
+    OGR_TP_REALTIME,
+    /**
+     * Total numbers of thread policy.
+     */
+    OGR_TP_COUNT
+} ThreadPolicy;
+
+/**
+ * Scheduling of the thread of a \ref ThreadStage, see
+ * \ref ogrSetThreadConfig.
+ */
+typedef struct
+{
+    /**
+     * Bit n set allows the thread to run on cpu n (the first 64 cpus only),
+     * 0 allows all cpus.
+     */
+    unsigned long long m_affinity_mask;
+    /**
+     * Nice level from -20 (highest priority) to 19 (lowest priority), used
+     * with \ref OGR_TP_NORMAL and \ref OGR_TP_BATCH. Negative values need
+     * CAP_SYS_NICE or a RLIMIT_NICE limit in linux, in windows it's mapped to
+     * the closest thread priority.
+     */
+    int m_nice;
+    /**
+     * Scheduling policy, see \ref ThreadPolicy.
+     */
+    ThreadPolicy m_policy;
+} ThreadConfig;
+
 /**
  * Callback which takes a string pointer to work with.
  */
@@ -118,7 +267,9 @@ typedef enum
 } CallBackType;
 
 /**
- * Settings for libopenglrecorder
+ * Settings for libopenglrecorder, zero it before setting the fields you use
+ * (for example `RecorderConfig cfg = {};` in C++), 0 is the default of every
+ * field added after the first release.
  */
 typedef struct
 {
@@ -167,8 +318,296 @@ typedef struct
      * Jpeg quality for the captured image, from 0 to 100.
      */
     unsigned int m_record_jpg_quality;
+    /**
+     * Width of the recorded video, 0 to use \ref m_width. It cannot be larger
+     * than \ref m_width, and it will be floored down to the closest integer
+     * divisble by 8 if needed. If it's smaller, the frame buffer is scaled
+     * down on the GPU before read back if \ref ogrRegFBOFunctions is used,
+     * otherwise on the CPU after read back with \ref m_scale_filter.
+     */
+    unsigned int m_output_width;
+    /**
+     * Height of the recorded video, 0 to use \ref m_height. It cannot be
+     * larger than \ref m_height, and it will be floored down to the closest
+     * integer divisble by 2 if needed.
+     */
+    unsigned int m_output_height;
+    /**
+     * Filter used when scaling down on the CPU, see \ref ScaleFilter.
+     */
+    ScaleFilter m_scale_filter;
+    /**
+     * 1 to convert the frame buffer to YUV 4:2:0 on the GPU with a shader
+     * before read back, which reads back 1.5 bytes per pixel instead of 4 and
+     * skips the color conversion on the CPU. It requires
+     * \ref ogrRegFBOFunctions, \ref ogrRegShaderFunctions and
+     * \ref ogrRegDrawFunctions, and \ref m_output_height divisble by 4,
+     * otherwise the usual RGBA read back is used. Ignored by
+     * \ref OGR_VF_LOSSLESS. 0 otherwise.
+     */
+    unsigned int m_gpu_yuv;
+    /**
+     * Pixel format used when reading back the frame buffer, see
+     * \ref ReadbackFormat. The default GL_PACK_ALIGNMENT of 4 is assumed.
+     * Not used by \ref m_gpu_yuv.
+     */
+    ReadbackFormat m_readback_format;
+    /**
+     * Number of threads used to convert each captured frame, including the
+     * capture conversion thread, 0 to choose from the numbers of CPU cores.
+     * With more than 1, the frame is split into stripes of rows which are
+     * color converted and scaled in parallel before JPEG compression, or
+     * compressed in parallel with \ref OGR_VF_LOSSLESS.
+     */
+    unsigned int m_conversion_threads;
+    /**
+     * 1 to back the large frame buffers of libopenglrecorder with huge pages
+     * (reserved ones if available, transparent huge pages otherwise) to
+     * reduce TLB misses, ignored on systems without them. 0 otherwise.
+     */
+    unsigned int m_huge_pages;
+    /**
+     * 1 to lock the large frame buffers of libopenglrecorder in memory so
+     * they are never swapped out, it may fail if the limit of locked memory
+     * is too low. 0 otherwise.
+     */
+    unsigned int m_lock_memory;
+    /**
+     * Number of threads kept by libopenglrecorder for all recordings, which
+     * run the capture conversion, video and audio encoding and muxing, 0 to
+     * choose from \ref m_record_audio and \ref m_conversion_threads. More
+     * are started if a recording needs them at the same time.
+     */
+    unsigned int m_worker_threads;
+    /**
+     * 1 to let the VP8, VP9 and H264 encoders trade quality for speed while
+     * frames queue up in front of them, by using faster encoder settings and
+     * lowering the bitrate up to 40%, and going back once they catch up. The
+     * changes are reported in \ref RecorderStats. 0 otherwise.
+     */
+    unsigned int m_adaptive_encoder;
+    /**
+     * Most CPU time the capture conversion and video encoding threads may
+     * use together, in percent of one core (150 for 1.5 cores), 0 for no
+     * limit. When they use more, they wait between frames (so more frames
+     * are dropped) and the VP8, VP9 and H264 encoders switch to faster
+     * settings like \ref m_adaptive_encoder, reported in
+     * \ref RecorderStats. It protects the frame rate of your app at the cost
+     * of recording quality. The limit is lifted by \ref ogrStopCapture, so
+     * the queued frames are saved as fast as possible.
+     */
+    unsigned int m_cpu_budget;
+    /**
+     * 1 to only save MJPEG frames while capturing, which is the cheapest for
+     * your app, and transcode them after \ref ogrStopCapture in background
+     * to VP9 with two-pass rate control on all cores, for the best quality
+     * at \ref m_video_bitrate. \ref OGR_CBT_PROGRESS_RECORDING reports the
+     * transcoding, the VP9 file replaces the MJPEG one once it is done.
+     * \ref ogrCapturing returns 0 before the transcoding starts, so the next
+     * recording can run meanwhile, it should have another saved name. Only
+     * \ref ogrDestroy stops the transcoding, then the MJPEG video is saved.
+     * Needs \ref m_video_format set to \ref OGR_VF_VP9, 0 otherwise.
+     */
+    unsigned int m_deferred_encoding;
+    /**
+     * Number of frames in each group of pictures when the frames still
+     * queued after \ref ogrStopCapture are encoded in parallel, each group
+     * starts with a key frame and is encoded by its own VP8, VP9 or H264
+     * encoder on its own core, which saves a large backlog faster at a small
+     * cost in size. Only used if at least two groups are queued, 0 to always
+     * finish the queued frames with the single encoder. At most 3600.
+     */
+    unsigned int m_parallel_gop;
 } RecorderConfig;
 
+/**
+ * A rectangle of the frame buffer in opengl window coordinates (origin at the
+ * bottom left corner), see \ref ogrCaptureRegions.
+ */
+typedef struct
+{
+    /**
+     * Left edge of the rectangle.
+     */
+    unsigned int m_x;
+    /**
+     * Bottom edge of the rectangle.
+     */
+    unsigned int m_y;
+    /**
+     * Width of the rectangle.
+     */
+    unsigned int m_width;
+    /**
+     * Height of the rectangle.
+     */
+    unsigned int m_height;
+} CaptureRegion;
+
+/**
+ * Another video saved from the same recording, see \ref ogrAddOutputProfile.
+ */
+typedef struct
+{
+    /**
+     * Encoder for the video of this output, see \ref VideoFormat.
+     */
+    VideoFormat m_video_format;
+    /**
+     * Width of the video, 0 to use \ref RecorderConfig::m_output_width. It
+     * cannot be larger than that, and it will be floored down to the closest
+     * integer divisble by 8 if needed. Only \ref OGR_VF_VP8,
+     * \ref OGR_VF_VP9 and \ref OGR_VF_H264 can be smaller, their frames are
+     * scaled down with \ref RecorderConfig::m_scale_filter after decoding.
+     */
+    unsigned int m_width;
+    /**
+     * Height of the video, 0 to use \ref RecorderConfig::m_output_height,
+     * see \ref m_width. It will be floored down to the closest even integer.
+     */
+    unsigned int m_height;
+    /**
+     * Bitrate for video encoding, 0 to use
+     * \ref RecorderConfig::m_video_bitrate.
+     */
+    unsigned int m_video_bitrate;
+} OutputProfile;
+
+/**
+ * Summary of the time taken by a stage in microseconds, see
+ * \ref RecorderStats. Percentiles are estimated from a histogram within
+ * 12.5%.
+ */
+typedef struct
+{
+    /**
+     * Number of times measured.
+     */
+    unsigned long long m_count;
+    /**
+     * Average time.
+     */
+    double m_mean;
+    /**
+     * Median time.
+     */
+    double m_p50;
+    /**
+     * 99th percentile time.
+     */
+    double m_p99;
+    /**
+     * Longest time.
+     */
+    double m_max;
+} LatencyStats;
+
+/**
+ * Performance counters of the current or last recording, see
+ * \ref ogrGetStats.
+ */
+typedef struct
+{
+    /**
+     * \ref ogrCapture (or \ref ogrCaptureRegions) on the rendering thread.
+     */
+    LatencyStats m_capture;
+    /**
+     * Mapping a pixel buffer object and copying it out, or glReadPixels
+     * without triple buffering, part of \ref m_capture.
+     */
+    LatencyStats m_readback;
+    /**
+     * Scaling, color conversion and JPEG compression of a frame.
+     */
+    LatencyStats m_conversion;
+    /**
+     * Decoding a JPEG frame to YUV for the video encoder, not used by
+     * \ref OGR_VF_MJPEG and \ref OGR_VF_LOSSLESS.
+     */
+    LatencyStats m_decode;
+    /**
+     * Encoding a frame and writing it to the temporary video file.
+     */
+    LatencyStats m_encode;
+    /**
+     * Muxing the mkv after \ref ogrStopCapture.
+     */
+    LatencyStats m_mux;
+    /**
+     * Frame buffer images read back and queued for conversion.
+     */
+    unsigned long long m_frames_captured;
+    /**
+     * Video frames which repeat the previous image, because of
+     * \ref ogrCaptureUnchanged or the rendering being slower than
+     * \ref RecorderConfig::m_record_fps.
+     */
+    unsigned long long m_frames_duplicated;
+    /**
+     * Captured images replaced by a newer one before conversion because
+     * conversion was too slow, or which failed to convert.
+     */
+    unsigned long long m_frames_dropped;
+    /**
+     * \ref ogrCapture calls not recorded because the rendering is faster
+     * than \ref RecorderConfig::m_record_fps.
+     */
+    unsigned long long m_frames_skipped;
+    /**
+     * Number of frames waiting for the video encoder when the last one was
+     * converted.
+     */
+    unsigned int m_queue_depth;
+    /**
+     * Highest \ref m_queue_depth of the recording.
+     */
+    unsigned int m_queue_high_water;
+    /**
+     * Size of the temporary video and audio files and the mkv, added after
+     * muxing.
+     */
+    unsigned long long m_bytes_written;
+    /**
+     * Current speed level of the video encoder from
+     * \ref RecorderConfig::m_adaptive_encoder, 0 is the configured settings
+     * and 4 the fastest.
+     */
+    unsigned int m_encoder_level;
+    /**
+     * Current target bitrate of the video encoder, 0 for
+     * \ref OGR_VF_MJPEG and \ref OGR_VF_LOSSLESS.
+     */
+    unsigned int m_encoder_bitrate;
+    /**
+     * Number of times the video encoder settings were changed by
+     * \ref RecorderConfig::m_adaptive_encoder.
+     */
+    unsigned long long m_encoder_adjustments;
+    /**
+     * CPU time used by the conversion and video encoding threads in the last
+     * second, in percent of one core. Only measured with
+     * \ref RecorderConfig::m_cpu_budget.
+     */
+    unsigned int m_cpu_usage;
+    /**
+     * Total time in microseconds the threads waited to stay within
+     * \ref RecorderConfig::m_cpu_budget.
+     */
+    unsigned long long m_throttled_time;
+    /**
+     * Number of times the video encoder switched to faster settings because
+     * of \ref RecorderConfig::m_cpu_budget, part of
+     * \ref m_encoder_adjustments.
+     */
+    unsigned long long m_budget_adjustments;
+    /**
+     * Scaling a frame on the CPU to the output size, part of
+     * \ref m_conversion, not used if the frame buffer is scaled on the GPU.
+     */
+    LatencyStats m_scale;
+} RecorderStats;
+
 /* List of opengl function used by libopenglrecorder: */
 typedef void(*ogrFucReadPixels)(int, int, int, int, unsigned int, unsigned int,
     void*);
@@ -181,6 +620,48 @@ typedef void*(*ogrFucMapBuffer)(unsigned int, unsigned int);
 typedef void*(*ogrFucMapBufferRange)(unsigned int, ptrdiff_t, ptrdiff_t,
     unsigned int);
 typedef unsigned char(*ogrFucUnmapBuffer)(unsigned int);
+typedef void(*ogrFucGenFramebuffers)(int, unsigned int*);
+typedef void(*ogrFucBindFramebuffer)(unsigned int, unsigned int);
+typedef void(*ogrFucDeleteFramebuffers)(int, const unsigned int*);
+typedef void(*ogrFucGenRenderbuffers)(int, unsigned int*);
+typedef void(*ogrFucBindRenderbuffer)(unsigned int, unsigned int);
+typedef void(*ogrFucRenderbufferStorage)(unsigned int, unsigned int, int, int);
+typedef void(*ogrFucFramebufferRenderbuffer)(unsigned int, unsigned int,
+    unsigned int, unsigned int);
+typedef void(*ogrFucDeleteRenderbuffers)(int, const unsigned int*);
+typedef void(*ogrFucBlitFramebuffer)(int, int, int, int, int, int, int, int,
+    unsigned int, unsigned int);
+typedef unsigned int(*ogrFucCreateShader)(unsigned int);
+typedef void(*ogrFucShaderSource)(unsigned int, int, const char* const*,
+    const int*);
+typedef void(*ogrFucCompileShader)(unsigned int);
+typedef unsigned int(*ogrFucCreateProgram)(void);
+typedef void(*ogrFucAttachShader)(unsigned int, unsigned int);
+typedef void(*ogrFucLinkProgram)(unsigned int);
+typedef void(*ogrFucGetProgramiv)(unsigned int, unsigned int, int*);
+typedef void(*ogrFucUseProgram)(unsigned int);
+typedef int(*ogrFucGetUniformLocation)(unsigned int, const char*);
+typedef void(*ogrFucUniform1i)(int, int);
+typedef void(*ogrFucUniform4f)(int, float, float, float, float);
+typedef void(*ogrFucDeleteShader)(unsigned int);
+typedef void(*ogrFucDeleteProgram)(unsigned int);
+typedef void(*ogrFucGenTextures)(int, unsigned int*);
+typedef void(*ogrFucBindTexture)(unsigned int, unsigned int);
+typedef void(*ogrFucTexImage2D)(unsigned int, int, int, int, int, int,
+    unsigned int, unsigned int, const void*);
+typedef void(*ogrFucTexParameteri)(unsigned int, unsigned int, int);
+typedef void(*ogrFucCopyTexSubImage2D)(unsigned int, int, int, int, int, int,
+    int, int);
+typedef void(*ogrFucDeleteTextures)(int, const unsigned int*);
+typedef void(*ogrFucGenVertexArrays)(int, unsigned int*);
+typedef void(*ogrFucBindVertexArray)(unsigned int);
+typedef void(*ogrFucDeleteVertexArrays)(int, const unsigned int*);
+typedef void(*ogrFucViewport)(int, int, int, int);
+typedef void(*ogrFucDrawArrays)(unsigned int, int, int);
+typedef void(*ogrFucGetIntegerv)(unsigned int, int*);
+typedef unsigned char(*ogrFucIsEnabled)(unsigned int);
+typedef void(*ogrFucEnable)(unsigned int);
+typedef void(*ogrFucDisable)(unsigned int);
 
 #ifdef  __cplusplus
 extern "C"
@@ -189,7 +670,8 @@ extern "C"
 /**
  * Initialize the configuration, call this first before using the library.
  *  \return 1 if succesfully configured, 0 otherwise and a default
- * configuration will be used.
+ * configuration will be used, \ref OGR_CBT_ERROR_RECORDING is called if it
+ * is registered.
  */
 int ogrInitConfig(RecorderConfig*);
 /**
@@ -197,6 +679,35 @@ int ogrInitConfig(RecorderConfig*);
  * extension, libopenglrecorder will automatically add .webm or .mkv as needed.
  */
 void ogrSetSavedName(const char*);
+/**
+ * Save another video of each recording, for example a small preview next to
+ * the archive of \ref RecorderConfig. All outputs share the read back and
+ * the conversion of every frame, and each one has its own video encoder and
+ * mkv file, named with the saved name followed by the given suffix, so it
+ * cannot be empty. \ref OGR_CBT_SAVED_RECORDING is called for each file, the
+ * progress is the one of the output of \ref RecorderConfig. Call it after
+ * \ref ogrInitConfig (which removes all profiles) and before the first
+ * \ref ogrPrepareCapture or \ref ogrWarmup, or after \ref ogrDestroy. Up to
+ * 8 profiles can be added.
+ *  \return 1 if the profile is added, 0 if it is invalid or unsupported.
+ */
+int ogrAddOutputProfile(const OutputProfile*, const char*);
+/**
+ * Remove all profiles of \ref ogrAddOutputProfile, with the same
+ * restrictions.
+ */
+void ogrClearOutputProfiles(void);
+/**
+ * Optionally create the recorder ahead of the first \ref ogrPrepareCapture,
+ * for example at the loading screen of your app, so the first frames of a
+ * recording are not lost while it starts. The OpenGL buffers are created
+ * right away, the audio recorder is connected and the video encoders are
+ * created in background, \ref ogrPrepareCapture only waits for them if it
+ * is called before they are done. After each recording, the encoders of the
+ * next one are created in background too. Call it with the same restrictions
+ * as \ref ogrPrepareCapture, it does nothing while recording.
+ */
+void ogrWarmup(void);
 /**
  * Reset libopenglrecorder, call this before first \ref ogrCapture.
  */
@@ -207,9 +718,40 @@ void ogrPrepareCapture(void);
  */
 void ogrCapture(void);
 /**
- * Stop the recorder of libopenglrecorder.
+ * Tell libopenglrecorder that the frame buffer has not changed since the last
+ * \ref ogrCapture, call this instead of \ref ogrCapture for such frame. No
+ * opengl function will be called and no pixels are copied, the duration of
+ * the last captured frame is extended instead. With
+ * \ref RecorderConfig::m_triple_buffering, if \ref ogrStopCapture follows
+ * directly, it reads back the last frames still in the pixel buffer objects,
+ * so an opengl context must be current for it.
+ */
+void ogrCaptureUnchanged(void);
+/**
+ * Capture the current frame buffer image as frame like \ref ogrCapture, but
+ * only the given changed regions since the last capture are read back, the
+ * rest of the frame is kept from previous captures. A count of 0 is the same
+ * as \ref ogrCaptureUnchanged. Once used, every later capture in the same
+ * recording will be read back even if it is discarded for the frame rate, so
+ * only use this when the changed area is small.
+ */
+void ogrCaptureRegions(const CaptureRegion*, unsigned int);
+/**
+ * Stop the recorder of libopenglrecorder. The frames still queued are then
+ * encoded with the fastest settings of the video encoder, to save the
+ * recording as soon as possible.
  */
 void ogrStopCapture(void);
+/**
+ * Stop the recorder of libopenglrecorder and throw the recording away, the
+ * frames and audio still queued are discarded without being encoded and no
+ * mkv is saved, so no \ref OGR_CBT_SAVED_RECORDING is called. The encoder
+ * threads finish their current frame in the background, \ref ogrCapturing
+ * returns 0 when they are done. Does nothing if no recording is running, so
+ * a stopped recording transcoded for \ref RecorderConfig::m_deferred_encoding
+ * is still saved.
+ */
+void ogrCancelCapture(void);
 /**
  * Destroy the recorder of libopenglrecorder.
  */
@@ -253,6 +795,70 @@ void ogrRegPBOFunctions(ogrFucGenBuffers, ogrFucBindBuffer, ogrFucBufferData,
 void ogrRegPBOFunctionsRange(ogrFucGenBuffers, ogrFucBindBuffer, ogrFucBufferData,
                              ogrFucDeleteBuffers, ogrFucMapBufferRange,
                              ogrFucUnmapBuffer);
+/**
+ * (Optional) Set opengl functions for using frame buffer objects, which allow
+ * scaling down the frame buffer on the GPU before read back when
+ * \ref RecorderConfig::m_output_width or m_output_height is smaller than the
+ * capture size, instead of scaling on the CPU. Requires OpenGL 3.0 or
+ * OpenGL ES 3.0, the default frame buffer is bound again after each capture
+ * unless \ref ogrRegDrawFunctions is used, which restores the previous one.
+ */
+void ogrRegFBOFunctions(ogrFucGenFramebuffers, ogrFucBindFramebuffer,
+                        ogrFucDeleteFramebuffers, ogrFucGenRenderbuffers,
+                        ogrFucBindRenderbuffer, ogrFucRenderbufferStorage,
+                        ogrFucFramebufferRenderbuffer,
+                        ogrFucDeleteRenderbuffers, ogrFucBlitFramebuffer);
+/**
+ * (Optional) Set opengl functions for compiling the shader used by
+ * \ref RecorderConfig::m_gpu_yuv. Requires OpenGL 3.0 or OpenGL ES 3.0.
+ */
+void ogrRegShaderFunctions(ogrFucCreateShader, ogrFucShaderSource,
+                           ogrFucCompileShader, ogrFucCreateProgram,
+                           ogrFucAttachShader, ogrFucLinkProgram,
+                           ogrFucGetProgramiv, ogrFucUseProgram,
+                           ogrFucGetUniformLocation, ogrFucUniform1i,
+                           ogrFucUniform4f, ogrFucDeleteShader,
+                           ogrFucDeleteProgram);
+/**
+ * (Optional) Set opengl functions for drawing with the shader used by
+ * \ref RecorderConfig::m_gpu_yuv. The opengl states touched by the drawing
+ * (bound frame buffers, texture, program, vertex array, viewport, blending,
+ * depth, stencil, scissor test and face culling) are restored after each
+ * capture, the color write mask has to be left enabled.
+ */
+void ogrRegDrawFunctions(ogrFucGenTextures, ogrFucBindTexture,
+                         ogrFucTexImage2D, ogrFucTexParameteri,
+                         ogrFucCopyTexSubImage2D, ogrFucDeleteTextures,
+                         ogrFucGenVertexArrays, ogrFucBindVertexArray,
+                         ogrFucDeleteVertexArrays, ogrFucViewport,
+                         ogrFucDrawArrays, ogrFucGetIntegerv,
+                         ogrFucIsEnabled, ogrFucEnable, ogrFucDisable);
+/**
+ * (Optional) Set the cpu affinity and scheduling of the thread running a
+ * stage of recording, so it doesn't compete with the rendering of your app.
+ * It's applied when the stage starts on its thread, failures are reported
+ * with \ref OGR_CBT_ERROR_RECORDING. The default is \ref OGR_TP_NORMAL
+ * with nice level 0 on all cpus for every stage, settings made during
+ * recording are used by the next recording.
+ * Return 1 if the settings are valid, 0 otherwise.
+ */
+int ogrSetThreadConfig(ThreadStage, const ThreadConfig*);
+/**
+ * Get the performance counters of the current recording, or the last one if
+ * not recording. They are reset by \ref ogrPrepareCapture, and cheap enough
+ * to be always updated.
+ * Return 1 if filled, 0 if libopenglrecorder is not initialized.
+ */
+int ogrGetStats(RecorderStats*);
+/**
+ * (Optional) Save the begin and end of each stage of every frame as a
+ * Chrome trace event JSON file when a recording stops, which can be opened
+ * in chrome://tracing or Perfetto. It's used by the next
+ * \ref ogrPrepareCapture, NULL or empty name disables it (the default).
+ * Return 1 if libopenglrecorder is built with BUILD_WITH_TRACING, 0
+ * otherwise.
+ */
+int ogrSetTraceFile(const char*);
 /**
  * Check if an audio encoder in \ref AudioFormat is supported.
  * Return 1 if supported.
@@ -5,54 +5,45 @@
  * tree.
  */
 
-#include "core/capture_library.hpp"
-#include "core/recorder_private.hpp"
+#include "video/mjpeg_writer.hpp"
+#include "core/encoder_registry.hpp"
+#include "core/video_encoder.hpp"
 
 namespace Recorder
 {
-    // ------------------------------------------------------------------------
-    int mjpegWriter(CaptureLibrary* cl)
+    /** Writes the compressed frames of the queue as they are, for MJPEG and
+     *  OGR_VF_LOSSLESS, whose frames are encoded by the conversion threads
+     *  already. */
+    class MJPEGWriter : public VideoEncoder
     {
-        // Runtime encoder checking
-        if (cl == NULL)
-            return 1;
-        setThreadName("mjpegWriter");
-        FILE* mjpeg_writer = fopen((getSavedName() + ".video").c_str(), "wb");
-        if (mjpeg_writer == NULL)
+    public:
+        // --------------------------------------------------------------------
+        virtual bool init(const RecorderConfig& config, bool gop)
+                                                              { return true; }
+        // --------------------------------------------------------------------
+        virtual bool takesYUV() const                        { return false; }
+        // --------------------------------------------------------------------
+        virtual int encodeFrame(const uint8_t* frame, unsigned size,
+                                int64_t frame_index, FILE* out)
         {
-            runCallback(OGR_CBT_ERROR_RECORDING, "Failed to open file for"
-                " writing mjpeg.\n");
+            // Every frame is compressed on its own, so each is a key frame
+            writeVideoPacket(frame, size, frame_index, true, out);
             return 1;
         }
-        int64_t frames_encoded = 0;
-        const uint32_t private_header_size = 0;
-        fwrite(&private_header_size, 1, sizeof(uint32_t), mjpeg_writer);
-        while (true)
-        {
-            std::unique_lock<std::mutex> ul(*cl->getJPGListMutex());
-            cl->getJPGListCV()->wait(ul, [&cl]
-                { return !cl->getJPGList()->empty(); });
-            auto& p = cl->getJPGList()->front();
-            uint8_t* jpg = std::get<0>(p);
-            uint32_t jpg_size = std::get<1>(p);
-            int frame_count = std::get<2>(p);
-            if (jpg == NULL)
-            {
-                cl->getJPGList()->clear();
-                ul.unlock();
-                break;
-            }
-            cl->getJPGList()->pop_front();
-            ul.unlock();
-            fwrite(&jpg_size, 1, sizeof(uint32_t), mjpeg_writer);
-            fwrite(&frames_encoded, 1, sizeof(int64_t), mjpeg_writer);
-            const bool key_frame = true;
-            fwrite(&key_frame, 1, sizeof(bool), mjpeg_writer);
-            fwrite(jpg, 1, jpg_size, mjpeg_writer);
-            frames_encoded += frame_count;
-            tjFree(jpg);
-        }
-        fclose(mjpeg_writer);
-        return 1;
-    }   // mjpegWriter
+    };
+    // ------------------------------------------------------------------------
+    static VideoEncoder* createMJPEGWriter()
+    {
+        return new MJPEGWriter();
+    }   // createMJPEGWriter
+    // ------------------------------------------------------------------------
+    void registerMJPEGWriter()
+    {
+        VideoEncoderInfo mjpeg = { OGR_VF_MJPEG, "V_MJPEG", false,
+            "mjpegWriter", NULL, createMJPEGWriter };
+        registerVideoEncoder(mjpeg);
+        VideoEncoderInfo lossless = { OGR_VF_LOSSLESS, "V_OGR/LOSSLESS",
+            false, "mjpegWriter", NULL, createMJPEGWriter };
+        registerVideoEncoder(lossless);
+    }   // registerMJPEGWriter
 };
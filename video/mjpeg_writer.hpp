@@ -8,11 +8,9 @@
 #ifndef HEADER_MJPEG_WRITER_HPP
 #define HEADER_MJPEG_WRITER_HPP
 
-class CaptureLibrary;
-
 namespace Recorder
 {
-    int mjpegWriter(CaptureLibrary* cl);
+    void registerMJPEGWriter();
 };
 
 #endif
@@ -7,223 +7,316 @@
 
 #ifdef ENABLE_H264
 
-#include "core/capture_library.hpp"
+#include "video/openh264_encoder.hpp"
+#include "core/encoder_controller.hpp"
+#include "core/encoder_registry.hpp"
 #include "core/recorder_private.hpp"
+#include "core/video_encoder.hpp"
 
 #include <wels/codec_api.h>
 #include <wels/codec_ver.h>
 
+#include <cstring>
+
+#ifndef ENABLE_H264_WO_DL
+#include <dlfcn.h>
+#include <mutex>
+#endif
+
 namespace Recorder
 {
+#ifndef ENABLE_H264_WO_DL
+    // Loaded by openh264LoadLibrary, named like the functions of OpenH264
+    // so the encoder is the same with or without libdl
+    typedef int (*WelsCreateSVCEncoder_t)(ISVCEncoder**);
+    WelsCreateSVCEncoder_t WelsCreateSVCEncoder = NULL;
+
+    typedef void (*WelsDestroySVCEncoder_t)(ISVCEncoder*);
+    WelsDestroySVCEncoder_t WelsDestroySVCEncoder = NULL;
+
+    std::mutex g_openh264_mutex;
+    bool g_openh264_tried = false;
+    bool g_openh264_loaded = false;
     // ------------------------------------------------------------------------
-    int openh264Encoder(CaptureLibrary* cl)
+    /** Open OpenH264 on first use, so H264 is only unavailable if it is not
+     *  installed. Only tried once, which also reports the error once. */
+    bool openh264LoadLibrary()
     {
-        // Runtime encoder checking
-        if (cl == NULL)
-            return 1;
-        setThreadName("openH264Encoder");
-        FILE* h264_data = fopen((getSavedName() + ".video").c_str(), "wb");
-        if (h264_data == NULL)
+        std::lock_guard<std::mutex> lg(g_openh264_mutex);
+        if (g_openh264_tried)
+            return g_openh264_loaded;
+        g_openh264_tried = true;
+        // libopenh264.so is only there with the development files
+        const char* names[] = { "libopenh264.so", "libopenh264.so.7",
+            "libopenh264.so.6", "libopenh264.so.5", "libopenh264.so.4" };
+        void* dl_handle = NULL;
+        for (const char* name : names)
         {
-            runCallback(OGR_CBT_ERROR_RECORDING, "Failed to open file for"
-                " writing h264.\n");
-            return 1;
+            dl_handle = dlopen(name, RTLD_LAZY);
+            if (dl_handle != NULL)
+                break;
         }
-
-        ISVCEncoder* o264_encoder = NULL;
-        int ret = WelsCreateSVCEncoder(&o264_encoder);
-        if (ret != 0 || o264_encoder == NULL)
+        if (dl_handle == NULL)
         {
-            runCallback(OGR_CBT_ERROR_RECORDING, "Failed to create openh264"
+            runCallback(OGR_CBT_ERROR_RECORDING, "Failed to open OpenH264"
+                " library\n");
+            return false;
+        }
+        WelsCreateSVCEncoder = (WelsCreateSVCEncoder_t)dlsym(dl_handle,
+            "WelsCreateSVCEncoder");
+        if (WelsCreateSVCEncoder == NULL)
+        {
+            runCallback(OGR_CBT_ERROR_RECORDING, "Cannot load function"
+                " 'WelsCreateSVCEncoder'\n");
+            dlclose(dl_handle);
+            return false;
+        }
+        WelsDestroySVCEncoder = (WelsDestroySVCEncoder_t)dlsym(dl_handle,
+            "WelsDestroySVCEncoder");
+        if (WelsDestroySVCEncoder == NULL)
+        {
+            runCallback(OGR_CBT_ERROR_RECORDING, "Cannot load function"
+                " 'WelsDestroySVCEncoder'\n");
+            dlclose(dl_handle);
+            return false;
+        }
+        // Kept open for the lifetime of the process
+        g_openh264_loaded = true;
+        return true;
+    }   // openh264LoadLibrary
+#endif
+    // ------------------------------------------------------------------------
+    /** Apply the level of EncoderController to the encoder, any level above
+     *  0 uses the lowest complexity. */
+    void openh264AdjustEncoder(ISVCEncoder* encoder,
+                               const EncoderController& controller,
+                               ECOMPLEXITY_MODE configured)
+    {
+        SBitrateInfo bitrate;
+        bitrate.iLayer = SPATIAL_LAYER_ALL;
+        bitrate.iBitrate = controller.getBitrate();
+        ECOMPLEXITY_MODE complexity = controller.getLevel() == 0 ?
+            configured : LOW_COMPLEXITY;
+        if (encoder->SetOption(ENCODER_OPTION_BITRATE, &bitrate) !=
+            cmResultSuccess ||
+            encoder->SetOption(ENCODER_OPTION_COMPLEXITY, &complexity) !=
+            cmResultSuccess)
+        {
+            runCallback(OGR_CBT_ERROR_RECORDING, "Failed to adjust openh264"
                 " encoder.\n");
-            return 1;
         }
-
-        const unsigned width = cl->getRecorderConfig().m_width;
-        const unsigned height = cl->getRecorderConfig().m_height;
-
-        SEncParamExt param;
-        o264_encoder->GetDefaultParams(&param);
-        param.iUsageType = CAMERA_VIDEO_REAL_TIME;
-        param.fMaxFrameRate = cl->getRecorderConfig().m_record_fps;
-        param.iPicWidth = width;
-        param.iPicHeight = height;
-        param.iTargetBitrate = cl->getRecorderConfig().m_video_bitrate;
-        param.iMaxBitrate = cl->getRecorderConfig().m_video_bitrate;
-        param.iRCMode = RC_BUFFERBASED_MODE;
-        param.iTemporalLayerNum = 1;
-        param.iSpatialLayerNum = 1;
-        param.bEnableDenoise = 0;
-        param.bEnableBackgroundDetection = 1;
-        param.bEnableAdaptiveQuant = 1;
-        param.bEnableFrameSkip = false;
-        param.bEnableLongTermReference = 0;
-        param.iLtrMarkPeriod = 30;
+    }   // openh264AdjustEncoder
+    // ------------------------------------------------------------------------
+    /** Fill param from the recorder config and initialize the encoder. */
+    bool openh264InitEncoder(const RecorderConfig& config,
+                             ISVCEncoder* encoder, SEncParamExt* param)
+    {
+        const unsigned width = config.m_output_width;
+        const unsigned height = config.m_output_height;
+        encoder->GetDefaultParams(param);
+        param->iUsageType = CAMERA_VIDEO_REAL_TIME;
+        param->fMaxFrameRate = config.m_record_fps;
+        param->iPicWidth = width;
+        param->iPicHeight = height;
+        param->iTargetBitrate = config.m_video_bitrate;
+        param->iMaxBitrate = config.m_video_bitrate;
+        param->iRCMode = RC_BUFFERBASED_MODE;
+        param->iTemporalLayerNum = 1;
+        param->iSpatialLayerNum = 1;
+        param->bEnableDenoise = 0;
+        param->bEnableBackgroundDetection = 1;
+        param->bEnableAdaptiveQuant = 1;
+        param->bEnableFrameSkip = false;
+        param->bEnableLongTermReference = 0;
+        param->iLtrMarkPeriod = 30;
 #if OPENH264_MAJOR > 1 || (OPENH264_MAJOR == 1 && OPENH264_MINOR >= 4)
-        param.eSpsPpsIdStrategy = CONSTANT_ID;
+        param->eSpsPpsIdStrategy = CONSTANT_ID;
 #else
-        param.bEnableSpsPpsIdAddition = 0;
+        param->bEnableSpsPpsIdAddition = 0;
 #endif
-        param.bPrefixNalAddingCtrl = 0;
-        param.iLoopFilterDisableIdc = 0;
-        param.sSpatialLayers[0].iVideoWidth = param.iPicWidth;
-        param.sSpatialLayers[0].iVideoHeight = param.iPicHeight;
-        param.sSpatialLayers[0].fFrameRate = param.fMaxFrameRate;
-        param.sSpatialLayers[0].iSpatialBitrate = param.iTargetBitrate;
-        param.sSpatialLayers[0].iMaxSpatialBitrate = param.iMaxBitrate;
-        param.sSpatialLayers[0].uiProfileIdc = PRO_HIGH;
-        o264_encoder->InitializeExt(&param);
-
+        param->bPrefixNalAddingCtrl = 0;
+        param->iLoopFilterDisableIdc = 0;
+        param->sSpatialLayers[0].iVideoWidth = param->iPicWidth;
+        param->sSpatialLayers[0].iVideoHeight = param->iPicHeight;
+        param->sSpatialLayers[0].fFrameRate = param->fMaxFrameRate;
+        param->sSpatialLayers[0].iSpatialBitrate = param->iTargetBitrate;
+        param->sSpatialLayers[0].iMaxSpatialBitrate = param->iMaxBitrate;
+        param->sSpatialLayers[0].uiProfileIdc = PRO_HIGH;
+        return encoder->InitializeExt(param) == cmResultSuccess;
+    }   // openh264InitEncoder
+    // ------------------------------------------------------------------------
+    /** Encode an I420 frame and write it to out like the .video file, false
+     *  if it failed or the encoder skipped it. */
+    bool openh264EncodeFrame(ISVCEncoder* encoder, const uint8_t* yuv,
+                             unsigned width, unsigned height,
+                             int64_t frame_index, FILE* out)
+    {
         SFrameBSInfo fbi;
         memset(&fbi, 0, sizeof(SFrameBSInfo));
-        ret = o264_encoder->EncodeParameterSets(&fbi);
-        if (ret != cmResultSuccess)
+        SSourcePicture sp;
+        memset(&sp, 0, sizeof(SSourcePicture));
+        sp.iPicWidth = width;
+        sp.iPicHeight = height;
+        sp.iColorFormat = videoFormatI420;
+        sp.iStride[0] = sp.iPicWidth;
+        sp.iStride[1] = sp.iStride[2] = sp.iPicWidth >> 1;
+        sp.pData[0] = (unsigned char*)yuv;
+        sp.pData[1] = sp.pData[0] + width * height;
+        sp.pData[2] = sp.pData[1] + (width * height >> 2);
+        const int ret = encoder->EncodeFrame(&sp, &fbi);
+        if (ret != cmResultSuccess || fbi.eFrameType == videoFrameTypeSkip)
+            return false;
+        uint32_t layers[MAX_LAYER_NUM_OF_FRAME] = {0};
+        uint32_t frame_size = 0;
+        for (int i = fbi.iLayerNum - 1; i < fbi.iLayerNum; i++)
         {
-            runCallback(OGR_CBT_ERROR_RECORDING, "Failed to create openh264"
-                " header.\n");
-            fclose(h264_data);
-            o264_encoder->Uninitialize();
-            WelsDestroySVCEncoder(o264_encoder);
-            return 1;
-        }
-
-        const uint8_t one = 1;
-        uint8_t* sps_data = fbi.sLayerInfo[0].pBsBuf + 4;
-        uint16_t sps_length = fbi.sLayerInfo[0].pNalLengthInByte[0] - 4;
-        uint8_t* pps_data = fbi.sLayerInfo[0].pBsBuf + sps_length + 8;
-        uint16_t pps_length = fbi.sLayerInfo[0].pNalLengthInByte[1] - 4;
-        const uint32_t header_size = 5 + 3 + sps_length + 3 + pps_length;
-        fwrite(&header_size, 1, sizeof(uint32_t), h264_data);
-
-        // Version
-        fwrite(&one, 1, sizeof(uint8_t), h264_data);
-        // Profile
-        fwrite(&sps_data[1], 1, sizeof(uint8_t), h264_data);
-        // Profile constraints
-        fwrite(&sps_data[2], 1, sizeof(uint8_t), h264_data);
-        // Level
-        fwrite(&sps_data[3], 1, sizeof(uint8_t), h264_data);
-
-        // 6 bits reserved (111111) + 2 bits nal size length - 1 (11)
-        uint8_t tmp = 0xff;
-        fwrite(&tmp, 1, sizeof(uint8_t), h264_data);
-
-        // 3 bits reserved (111) + 5 bits number of sps (00001)
-        tmp = 0xe1;
-        fwrite(&tmp, 1, sizeof(uint8_t), h264_data);
-        tmp = (sps_length >> 8) & 0xff;
-        fwrite(&tmp, 1, sizeof(uint8_t), h264_data);
-        tmp = sps_length & 0xff;
-        fwrite(&tmp, 1, sizeof(uint8_t), h264_data);
-        fwrite(sps_data, 1, sps_length, h264_data);
-
-        // PPS size, length and data
-        fwrite(&one, 1, sizeof(uint8_t), h264_data);
-        tmp = (pps_length >> 8) & 0xff;
-        fwrite(&tmp, 1, sizeof(uint8_t), h264_data);
-        tmp = pps_length & 0xff;
-        fwrite(&tmp, 1, sizeof(uint8_t), h264_data);
-        fwrite(pps_data, 1, pps_length, h264_data);
-
-        int64_t frames_encoded = 0;
-        uint8_t* yuv = new uint8_t[width * height * 3 / 2]();
-        float last_size = -1.0f;
-        int cur_finished_count = 0;
-        while (true)
-        {
-            std::unique_lock<std::mutex> ul(*cl->getJPGListMutex());
-            cl->getJPGListCV()->wait(ul, [&cl]
-                { return !cl->getJPGList()->empty(); });
-            auto& p = cl->getJPGList()->front();
-            uint8_t* jpg = std::get<0>(p);
-            uint32_t jpg_size = std::get<1>(p);
-            int frame_count = std::get<2>(p);
-            if (jpg == NULL)
+            for (int j = 0; j < fbi.sLayerInfo[i].iNalCount; j++)
             {
-                cl->getJPGList()->clear();
-                ul.unlock();
-                if (cl->displayingProgress())
-                {
-                    int rate = 99;
-                    runCallback(OGR_CBT_PROGRESS_RECORDING, &rate);
-                }
-                break;
+                layers[i] += fbi.sLayerInfo[i].pNalLengthInByte[j];
             }
-            cl->getJPGList()->pop_front();
-            ul.unlock();
-            if (cl->displayingProgress())
+            frame_size += layers[i];
+        }
+        fwrite(&frame_size, 1, sizeof(uint32_t), out);
+        fwrite(&frame_index, 1, sizeof(int64_t), out);
+        bool key_frame = (fbi.eFrameType == videoFrameTypeIDR);
+        fwrite(&key_frame, 1, sizeof(bool), out);
+        uint8_t tmp;
+        for (int i = fbi.iLayerNum - 1; i < fbi.iLayerNum; i++)
+        {
+            uint32_t total_len = 4;
+            for (int j = 0; j < fbi.sLayerInfo[i].iNalCount; j++)
             {
-                if (last_size == -1.0f)
-                    last_size = (float)(cl->getJPGList()->size());
-                cur_finished_count += frame_count;
-                int rate = (int)(cur_finished_count / last_size * 100.0f);
-                rate = rate > 99 ? 99 : rate;
-                runCallback(OGR_CBT_PROGRESS_RECORDING, &rate);
+                const uint32_t len = layers[i] - 4;
+                tmp = (len >> 24) & 0xff;
+                fwrite(&tmp, 1, sizeof(uint8_t), out);
+                tmp = (len >> 16) & 0xff;
+                fwrite(&tmp, 1, sizeof(uint8_t), out);
+                tmp = (len >> 8) & 0xff;
+                fwrite(&tmp, 1, sizeof(uint8_t), out);
+                tmp = len & 0xff;
+                fwrite(&tmp, 1, sizeof(uint8_t), out);
+                fwrite(fbi.sLayerInfo[i].pBsBuf + total_len, 1, len, out);
+                total_len += layers[i];
             }
-            int ret = cl->yuvConversion(jpg, jpg_size, yuv);
-            if (ret < 0)
+        }
+        return true;
+    }   // openh264EncodeFrame
+    // ------------------------------------------------------------------------
+    class OpenH264Encoder : public VideoEncoder
+    {
+    private:
+        ISVCEncoder* m_encoder;
+
+        SEncParamExt m_param;
+
+    public:
+        // --------------------------------------------------------------------
+        OpenH264Encoder()
+        {
+            m_encoder = NULL;
+        }   // OpenH264Encoder
+        // --------------------------------------------------------------------
+        ~OpenH264Encoder()
+        {
+            if (m_encoder == NULL)
+                return;
+            m_encoder->Uninitialize();
+            WelsDestroySVCEncoder(m_encoder);
+        }   // ~OpenH264Encoder
+        // --------------------------------------------------------------------
+        virtual bool init(const RecorderConfig& config, bool gop)
+        {
+            if (WelsCreateSVCEncoder(&m_encoder) != 0 || m_encoder == NULL)
             {
-                tjFree(jpg);
-                continue;
+                m_encoder = NULL;
+                return false;
             }
-            tjFree(jpg);
+            if (!openh264InitEncoder(config, m_encoder, &m_param))
+                return false;
+            // The parameter sets of a group of pictures are the same as the
+            // ones of the main encoder, so only the complexity differs
+            ECOMPLEXITY_MODE complexity = LOW_COMPLEXITY;
+            return !gop || m_encoder->SetOption(ENCODER_OPTION_COMPLEXITY,
+                &complexity) == cmResultSuccess;
+        }   // init
+        // --------------------------------------------------------------------
+        /** The SPS and PPS in an AVCDecoderConfigurationRecord. */
+        virtual bool getCodecPrivate(std::string* data)
+        {
+            SFrameBSInfo fbi;
             memset(&fbi, 0, sizeof(SFrameBSInfo));
-            SSourcePicture sp;
-            memset(&sp, 0, sizeof(SSourcePicture));
-            sp.iPicWidth = width;
-            sp.iPicHeight = height;
-            sp.iColorFormat = videoFormatI420;
-            sp.iStride[0] = sp.iPicWidth;
-            sp.iStride[1] = sp.iStride[2] = sp.iPicWidth >> 1;
-            sp.pData[0] = yuv;
-            sp.pData[1] = sp.pData[0] + width * height;
-            sp.pData[2] = sp.pData[1] + (width * height >> 2);
-            ret = o264_encoder->EncodeFrame(&sp, &fbi);
-            uint32_t layers[MAX_LAYER_NUM_OF_FRAME] = {0};
-            if (ret == cmResultSuccess &&
-                fbi.eFrameType != videoFrameTypeSkip)
+            if (m_encoder->EncodeParameterSets(&fbi) != cmResultSuccess)
+                return false;
+            const uint8_t* sps_data = fbi.sLayerInfo[0].pBsBuf + 4;
+            const uint16_t sps_length =
+                fbi.sLayerInfo[0].pNalLengthInByte[0] - 4;
+            const uint8_t* pps_data = fbi.sLayerInfo[0].pBsBuf + sps_length +
+                8;
+            const uint16_t pps_length =
+                fbi.sLayerInfo[0].pNalLengthInByte[1] - 4;
+            data->clear();
+            // Version
+            data->push_back(1);
+            // Profile, profile constraints and level
+            data->append((const char*)sps_data + 1, 3);
+            // 6 bits reserved (111111) + 2 bits nal size length - 1 (11)
+            data->push_back((char)0xff);
+            // 3 bits reserved (111) + 5 bits number of sps (00001)
+            data->push_back((char)0xe1);
+            data->push_back((char)((sps_length >> 8) & 0xff));
+            data->push_back((char)(sps_length & 0xff));
+            data->append((const char*)sps_data, sps_length);
+            // PPS size, length and data
+            data->push_back(1);
+            data->push_back((char)((pps_length >> 8) & 0xff));
+            data->push_back((char)(pps_length & 0xff));
+            data->append((const char*)pps_data, pps_length);
+            return true;
+        }   // getCodecPrivate
+        // --------------------------------------------------------------------
+        virtual int encodeFrame(const uint8_t* frame, unsigned size,
+                                int64_t frame_index, FILE* out)
+        {
+            return openh264EncodeFrame(m_encoder, frame, m_param.iPicWidth,
+                m_param.iPicHeight, frame_index, out) ? 1 : 0;
+        }   // encodeFrame
+        // --------------------------------------------------------------------
+        virtual void adjust(const EncoderController& controller)
+        {
+            openh264AdjustEncoder(m_encoder, controller,
+                m_param.iComplexityMode);
+        }   // adjust
+        // --------------------------------------------------------------------
+        virtual void startDrain()
+        {
+            // Threads are fixed after initialization, so only the
+            // complexity can be lowered for the queued frames
+            ECOMPLEXITY_MODE complexity = LOW_COMPLEXITY;
+            if (m_encoder->SetOption(ENCODER_OPTION_COMPLEXITY,
+                &complexity) != cmResultSuccess)
             {
-                uint32_t frame_size = 0;
-                for (int i = fbi.iLayerNum - 1; i < fbi.iLayerNum; i++)
-                {
-                    for (int j = 0; j < fbi.sLayerInfo[i].iNalCount; j++)
-                    {
-                        layers[i] += fbi.sLayerInfo[i].pNalLengthInByte[j];
-                    }
-                    frame_size += layers[i];
-                }
-                fwrite(&frame_size, 1, sizeof(uint32_t), h264_data);
-                fwrite(&frames_encoded, 1, sizeof(int64_t), h264_data);
-                bool key_frame = (fbi.eFrameType == videoFrameTypeIDR);
-                fwrite(&key_frame, 1, sizeof(bool), h264_data);
-                for (int i = fbi.iLayerNum - 1; i < fbi.iLayerNum; i++)
-                {
-                    uint32_t total_len = 4;
-                    for (int j = 0; j < fbi.sLayerInfo[i].iNalCount; j++)
-                    {
-                        const uint32_t len = layers[i] - 4;
-                        tmp = (len >> 24) & 0xff;
-                        fwrite(&tmp, 1, sizeof(uint8_t), h264_data);
-                        tmp = (len >> 16) & 0xff;
-                        fwrite(&tmp, 1, sizeof(uint8_t), h264_data);
-                        tmp = (len >> 8) & 0xff;
-                        fwrite(&tmp, 1, sizeof(uint8_t), h264_data);
-                        tmp = len & 0xff;
-                        fwrite(&tmp, 1, sizeof(uint8_t), h264_data);
-                        fwrite(fbi.sLayerInfo[i].pBsBuf + total_len, 1, len,
-                            h264_data);
-                        total_len += layers[i];
-                    }
-                }
-                frames_encoded += frame_count;
+                runCallback(OGR_CBT_ERROR_RECORDING, "Failed to speed up"
+                    " openh264 encoder.\n");
             }
-        }
-        delete[] yuv;
-        o264_encoder->Uninitialize();
-        WelsDestroySVCEncoder(o264_encoder);
-        fclose(h264_data);
-        return 1;
-    }   // openh264Encoder
+        }   // startDrain
+    };
+    // ------------------------------------------------------------------------
+    static VideoEncoder* createOpenH264Encoder()
+    {
+        return new OpenH264Encoder();
+    }   // createOpenH264Encoder
+    // ------------------------------------------------------------------------
+    void registerOpenH264Encoder()
+    {
+#ifdef ENABLE_H264_WO_DL
+        bool (*load)() = NULL;
+#else
+        bool (*load)() = openh264LoadLibrary;
+#endif
+        VideoEncoderInfo h264 = { OGR_VF_H264, "V_MPEG4/ISO/AVC", false,
+            "openH264Encoder", load, createOpenH264Encoder };
+        registerVideoEncoder(h264);
+    }   // registerOpenH264Encoder
 }
 
 #endif
@@ -8,14 +8,12 @@
 #ifndef HEADER_OPENH264_ENCODER_HPP
 #define HEADER_OPENH264_ENCODER_HPP
 
-class CaptureLibrary;
-
 namespace Recorder
 {
 #ifdef ENABLE_H264
-    int openh264Encoder(CaptureLibrary* cl);
+    void registerOpenH264Encoder();
 #else
-    inline int openh264Encoder(CaptureLibrary* cl) { return 0; }
+    inline void registerOpenH264Encoder()                                   {}
 #endif
 };
 #endif
@@ -7,14 +7,208 @@
 
 #ifdef ENABLE_VPX
 
+#include "video/vpx_encoder.hpp"
+#include "core/buffer_arena.hpp"
 #include "core/capture_library.hpp"
+#include "core/encoder_controller.hpp"
+#include "core/encoder_registry.hpp"
 #include "core/recorder_private.hpp"
+#include "core/video_encoder.hpp"
 
 #include <vpx/vpx_encoder.h>
 #include <vpx/vp8cx.h>
 
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef ENABLE_VPX_WO_DL
+#include <dlfcn.h>
+#include <mutex>
+#endif
+
 namespace Recorder
 {
+#ifndef ENABLE_VPX_WO_DL
+    // Loaded by vpxLoadLibrary, named like the functions of libvpx so the
+    // encoder is the same with or without libdl. vpx_codec_control_ is
+    // called directly as the vpx_codec_control macro uses the linked one.
+    typedef vpx_codec_iface_t* (*vpx_codec_vp8_cx_t)(void);
+    vpx_codec_vp8_cx_t vpx_codec_vp8_cx = NULL;
+
+    typedef vpx_codec_iface_t* (*vpx_codec_vp9_cx_t)(void);
+    vpx_codec_vp9_cx_t vpx_codec_vp9_cx = NULL;
+
+    typedef vpx_codec_err_t (*vpx_codec_enc_config_default_t)
+        (vpx_codec_iface_t*, vpx_codec_enc_cfg_t*, unsigned int);
+    vpx_codec_enc_config_default_t vpx_codec_enc_config_default = NULL;
+
+    typedef vpx_codec_err_t (*vpx_codec_enc_init_ver_t)(vpx_codec_ctx_t*,
+        vpx_codec_iface_t*, const vpx_codec_enc_cfg_t*, vpx_codec_flags_t,
+        int);
+    vpx_codec_enc_init_ver_t vpx_codec_enc_init_ver = NULL;
+
+    typedef vpx_codec_err_t (*vpx_codec_enc_config_set_t)(vpx_codec_ctx_t*,
+        const vpx_codec_enc_cfg_t*);
+    vpx_codec_enc_config_set_t vpx_codec_enc_config_set = NULL;
+
+    typedef vpx_codec_err_t (*vpx_codec_control__t)(vpx_codec_ctx_t*, int,
+        ...);
+    vpx_codec_control__t vpx_codec_control_ = NULL;
+
+    typedef vpx_codec_err_t (*vpx_codec_encode_t)(vpx_codec_ctx_t*,
+        const vpx_image_t*, vpx_codec_pts_t, unsigned long,
+        vpx_enc_frame_flags_t, unsigned long);
+    vpx_codec_encode_t vpx_codec_encode = NULL;
+
+    typedef const vpx_codec_cx_pkt_t* (*vpx_codec_get_cx_data_t)
+        (vpx_codec_ctx_t*, vpx_codec_iter_t*);
+    vpx_codec_get_cx_data_t vpx_codec_get_cx_data = NULL;
+
+    typedef vpx_codec_err_t (*vpx_codec_destroy_t)(vpx_codec_ctx_t*);
+    vpx_codec_destroy_t vpx_codec_destroy = NULL;
+
+    typedef vpx_image_t* (*vpx_img_wrap_t)(vpx_image_t*, vpx_img_fmt_t,
+        unsigned int, unsigned int, unsigned int, unsigned char*);
+    vpx_img_wrap_t vpx_img_wrap = NULL;
+
+    std::mutex g_vpx_mutex;
+    bool g_vpx_tried = false;
+    bool g_vpx_loaded = false;
+    // ------------------------------------------------------------------------
+    static void* loadVPXFunction(void* dl_handle, const char* name)
+    {
+        void* function = dlsym(dl_handle, name);
+        if (function == NULL)
+        {
+            std::string msg = "Cannot load function '";
+            msg += name;
+            msg += "'\n";
+            runCallback(OGR_CBT_ERROR_RECORDING, msg.c_str());
+        }
+        return function;
+    }   // loadVPXFunction
+    // ------------------------------------------------------------------------
+    /** Open libvpx on first use, so VP8 and VP9 are only unavailable if it
+     *  is not installed. Only tried once, which also reports the error
+     *  once. */
+    bool vpxLoadLibrary()
+    {
+        std::lock_guard<std::mutex> lg(g_vpx_mutex);
+        if (g_vpx_tried)
+            return g_vpx_loaded;
+        g_vpx_tried = true;
+        // libvpx.so is only there with the development files
+        const char* names[] = { "libvpx.so", "libvpx.so.9", "libvpx.so.8",
+            "libvpx.so.7", "libvpx.so.6" };
+        void* dl_handle = NULL;
+        for (const char* name : names)
+        {
+            dl_handle = dlopen(name, RTLD_LAZY);
+            if (dl_handle != NULL)
+                break;
+        }
+        if (dl_handle == NULL)
+        {
+            runCallback(OGR_CBT_ERROR_RECORDING, "Failed to open LibVPX"
+                " library\n");
+            return false;
+        }
+        vpx_codec_vp8_cx = (vpx_codec_vp8_cx_t)loadVPXFunction(dl_handle,
+            "vpx_codec_vp8_cx");
+        vpx_codec_vp9_cx = (vpx_codec_vp9_cx_t)loadVPXFunction(dl_handle,
+            "vpx_codec_vp9_cx");
+        vpx_codec_enc_config_default = (vpx_codec_enc_config_default_t)
+            loadVPXFunction(dl_handle, "vpx_codec_enc_config_default");
+        vpx_codec_enc_init_ver = (vpx_codec_enc_init_ver_t)loadVPXFunction
+            (dl_handle, "vpx_codec_enc_init_ver");
+        vpx_codec_enc_config_set = (vpx_codec_enc_config_set_t)
+            loadVPXFunction(dl_handle, "vpx_codec_enc_config_set");
+        vpx_codec_control_ = (vpx_codec_control__t)loadVPXFunction
+            (dl_handle, "vpx_codec_control_");
+        vpx_codec_encode = (vpx_codec_encode_t)loadVPXFunction(dl_handle,
+            "vpx_codec_encode");
+        vpx_codec_get_cx_data = (vpx_codec_get_cx_data_t)loadVPXFunction
+            (dl_handle, "vpx_codec_get_cx_data");
+        vpx_codec_destroy = (vpx_codec_destroy_t)loadVPXFunction(dl_handle,
+            "vpx_codec_destroy");
+        vpx_img_wrap = (vpx_img_wrap_t)loadVPXFunction(dl_handle,
+            "vpx_img_wrap");
+        g_vpx_loaded = vpx_codec_vp8_cx != NULL && vpx_codec_vp9_cx != NULL &&
+            vpx_codec_enc_config_default != NULL &&
+            vpx_codec_enc_init_ver != NULL &&
+            vpx_codec_enc_config_set != NULL && vpx_codec_control_ != NULL &&
+            vpx_codec_encode != NULL && vpx_codec_get_cx_data != NULL &&
+            vpx_codec_destroy != NULL && vpx_img_wrap != NULL;
+        // Kept open for the lifetime of the process
+        if (!g_vpx_loaded)
+            dlclose(dl_handle);
+        return g_vpx_loaded;
+    }   // vpxLoadLibrary
+#endif
+    // cpu-used of each EncoderController level, VP9 only goes up to 8
+    const int g_vp8_cpu_used[EncoderController::MAX_LEVEL + 1] =
+        { 0, 4, 8, 12, 16 };
+    const int g_vp9_cpu_used[EncoderController::MAX_LEVEL + 1] =
+        { 0, 2, 4, 6, 8 };
+    // The first pass of the deferred transcoding only collects statistics,
+    // so it is run fast, the second one is slow but not the slowest
+    const int g_transcode_cpu_used[2] = { 4, 1 };
+    // ------------------------------------------------------------------------
+    /** Apply the level of EncoderController to the encoder. */
+    void vpxAdjustEncoder(vpx_codec_ctx_t* codec, vpx_codec_enc_cfg_t* cfg,
+                          const EncoderController& controller, bool vp9)
+    {
+        cfg->rc_target_bitrate = controller.getBitrate();
+        const int cpu_used = vp9 ? g_vp9_cpu_used[controller.getLevel()] :
+            g_vp8_cpu_used[controller.getLevel()];
+        if (vpx_codec_enc_config_set(codec, cfg) != VPX_CODEC_OK ||
+            vpx_codec_control_(codec, VP8E_SET_CPUUSED, cpu_used) !=
+            VPX_CODEC_OK)
+        {
+            runCallback(OGR_CBT_ERROR_RECORDING, "Failed to adjust vpx"
+                " encoder.\n");
+        }
+    }   // vpxAdjustEncoder
+    // ------------------------------------------------------------------------
+    /** Once capture stops, finish the queued frames at the fastest speed,
+     *  VP9 also with all cores as it can add threads while encoding. */
+    void vpxStartDrain(vpx_codec_ctx_t* codec, vpx_codec_enc_cfg_t* cfg,
+                       bool vp9)
+    {
+        bool ok = true;
+        if (vp9)
+        {
+            cfg->g_threads = std::max(std::thread::hardware_concurrency(),
+                1u);
+            ok = vpx_codec_enc_config_set(codec, cfg) == VPX_CODEC_OK &&
+                vpx_codec_control_(codec, VP9E_SET_TILE_COLUMNS, 6) ==
+                VPX_CODEC_OK;
+#ifdef VPX_CTRL_VP9E_SET_ROW_MT
+            ok = ok && vpx_codec_control_(codec, VP9E_SET_ROW_MT, 1) ==
+                VPX_CODEC_OK;
+#endif
+        }
+        const int cpu_used = vp9 ?
+            g_vp9_cpu_used[EncoderController::MAX_LEVEL] :
+            g_vp8_cpu_used[EncoderController::MAX_LEVEL];
+        if (!ok || vpx_codec_control_(codec, VP8E_SET_CPUUSED, cpu_used) !=
+            VPX_CODEC_OK)
+        {
+            runCallback(OGR_CBT_ERROR_RECORDING, "Failed to speed up vpx"
+                " encoder.\n");
+        }
+    }   // vpxStartDrain
+    // ------------------------------------------------------------------------
+    void vpxWriteFrame(const vpx_codec_cx_pkt_t *pkt, FILE *out)
+    {
+        const bool key_frame =
+            (pkt->data.frame.flags & VPX_FRAME_IS_KEY) != 0;
+        writeVideoPacket(pkt->data.frame.buf, (uint32_t)pkt->data.frame.sz,
+            pkt->data.frame.pts, key_frame, out);
+    }   // vpxWriteFrame
     // ------------------------------------------------------------------------
     int vpxEncodeFrame(vpx_codec_ctx_t *codec, vpx_image_t *img,
                        int64_t frame_index, FILE *out)
@@ -34,131 +228,311 @@ namespace Recorder
         {
             got_pkts = 1;
             if (pkt->kind == VPX_CODEC_CX_FRAME_PKT)
+                vpxWriteFrame(pkt, out);
+        }
+        return got_pkts;
+    }   // vpxEncodeFrame
+    // ------------------------------------------------------------------------
+    /** Encode a frame of the deferred transcoding, the first pass collects
+     *  the rate control statistics and the last pass writes the frames. */
+    int vpxTranscodeFrame(vpx_codec_ctx_t *codec, vpx_image_t *img,
+                          int64_t frame_index, std::string* stats, FILE *out)
+    {
+        int got_pkts = 0;
+        vpx_codec_iter_t iter = NULL;
+        const vpx_codec_cx_pkt_t *pkt = NULL;
+        const vpx_codec_err_t res = vpx_codec_encode(codec, img, frame_index,
+            1, 0, VPX_DL_GOOD_QUALITY);
+        if (res != VPX_CODEC_OK)
+        {
+            runCallback(OGR_CBT_ERROR_RECORDING, "Failed to transcode frame"
+                " for vpx.\n");
+            return -1;
+        }
+        while ((pkt = vpx_codec_get_cx_data(codec, &iter)) != NULL)
+        {
+            got_pkts = 1;
+            if (pkt->kind == VPX_CODEC_STATS_PKT)
             {
-                fwrite(&pkt->data.frame.sz, 1, sizeof(uint32_t), out);
-                fwrite(&pkt->data.frame.pts, 1, sizeof(int64_t), out);
-                bool key_frame =
-                    (pkt->data.frame.flags & VPX_FRAME_IS_KEY) != 0;
-                fwrite(&key_frame, 1, sizeof(bool), out);
-                fwrite(pkt->data.frame.buf, 1, pkt->data.frame.sz, out);
+                stats->append((const char*)pkt->data.twopass_stats.buf,
+                    pkt->data.twopass_stats.sz);
             }
+            else if (pkt->kind == VPX_CODEC_CX_FRAME_PKT && out != NULL)
+                vpxWriteFrame(pkt, out);
         }
         return got_pkts;
-    }   // vpxEncodeFrame
+    }   // vpxTranscodeFrame
     // ------------------------------------------------------------------------
-    int vpxEncoder(CaptureLibrary* cl)
+    class VPXEncoder : public VideoEncoder
     {
-        // Runtime encoder checking
-        if (cl == NULL)
-            return 1;
-        setThreadName("vpxEncoder");
-        FILE* vpx_data = fopen((getSavedName() + ".video").c_str(), "wb");
-        if (vpx_data == NULL)
+    private:
+        vpx_codec_ctx_t m_codec;
+
+        vpx_codec_enc_cfg_t m_cfg;
+
+        bool m_vp9;
+
+        bool m_initialized;
+
+    public:
+        // --------------------------------------------------------------------
+        VPXEncoder(bool vp9)
+        {
+            m_vp9 = vp9;
+            m_initialized = false;
+        }   // VPXEncoder
+        // --------------------------------------------------------------------
+        ~VPXEncoder()
+        {
+            if (m_initialized && vpx_codec_destroy(&m_codec))
+            {
+                runCallback(OGR_CBT_ERROR_RECORDING, "Failed to destroy vpx"
+                    " codec.\n");
+            }
+        }   // ~VPXEncoder
+        // --------------------------------------------------------------------
+        virtual bool init(const RecorderConfig& config, bool gop)
+        {
+            vpx_codec_iface_t* codec_if = m_vp9 ? vpx_codec_vp9_cx() :
+                vpx_codec_vp8_cx();
+            if (vpx_codec_enc_config_default(codec_if, &m_cfg, 0) > 0)
+                return false;
+            m_cfg.g_w = config.m_output_width;
+            m_cfg.g_h = config.m_output_height;
+            m_cfg.g_timebase.num = 1;
+            m_cfg.g_timebase.den = config.m_record_fps;
+            m_cfg.rc_end_usage = VPX_VBR;
+            m_cfg.rc_target_bitrate = config.m_video_bitrate;
+            // The other groups are encoded on the other cores
+            if (gop)
+                m_cfg.g_threads = 1;
+            if (vpx_codec_enc_init(&m_codec, codec_if, &m_cfg, 0) > 0)
+                return false;
+            m_initialized = true;
+            if (gop)
+            {
+                const int cpu_used = m_vp9 ?
+                    g_vp9_cpu_used[EncoderController::MAX_LEVEL] :
+                    g_vp8_cpu_used[EncoderController::MAX_LEVEL];
+                vpx_codec_control_(&m_codec, VP8E_SET_CPUUSED, cpu_used);
+            }
+            return true;
+        }   // init
+        // --------------------------------------------------------------------
+        virtual int encodeFrame(const uint8_t* frame, unsigned size,
+                                int64_t frame_index, FILE* out)
+        {
+            vpx_image_t each_frame;
+            vpx_img_wrap(&each_frame, VPX_IMG_FMT_I420, m_cfg.g_w, m_cfg.g_h,
+                1, (unsigned char*)frame);
+            return vpxEncodeFrame(&m_codec, &each_frame, frame_index, out) <
+                0 ? -1 : 1;
+        }   // encodeFrame
+        // --------------------------------------------------------------------
+        virtual void flush(FILE* out)
+        {
+            while (vpxEncodeFrame(&m_codec, NULL, -1, out) > 0);
+        }   // flush
+        // --------------------------------------------------------------------
+        virtual void adjust(const EncoderController& controller)
+        {
+            vpxAdjustEncoder(&m_codec, &m_cfg, controller, m_vp9);
+        }   // adjust
+        // --------------------------------------------------------------------
+        virtual void startDrain()
         {
-            runCallback(OGR_CBT_ERROR_RECORDING, "Failed to open file for"
-                " writing vpx.\n");
-            return 1;
+            vpxStartDrain(&m_codec, &m_cfg, m_vp9);
+        }   // startDrain
+    };
+    // ------------------------------------------------------------------------
+    static VideoEncoder* createVP8Encoder()
+    {
+        return new VPXEncoder(false);
+    }   // createVP8Encoder
+    // ------------------------------------------------------------------------
+    static VideoEncoder* createVP9Encoder()
+    {
+        return new VPXEncoder(true);
+    }   // createVP9Encoder
+    // ------------------------------------------------------------------------
+    void registerVPXEncoders()
+    {
+#ifdef ENABLE_VPX_WO_DL
+        bool (*load)() = NULL;
+#else
+        bool (*load)() = vpxLoadLibrary;
+#endif
+        VideoEncoderInfo vp8 = { OGR_VF_VP8, "V_VP8", true, "vpxEncoder",
+            load, createVP8Encoder };
+        registerVideoEncoder(vp8);
+        VideoEncoderInfo vp9 = { OGR_VF_VP9, "V_VP9", true, "vpxEncoder",
+            load, createVP9Encoder };
+        registerVideoEncoder(vp9);
+    }   // registerVPXEncoders
+    // ------------------------------------------------------------------------
+    bool vpxTranscode(CaptureLibrary* cl, const RecorderConfig& rc,
+                      BufferArena* arena, bool display_progress,
+                      const std::string& mjpeg, const std::string& output)
+    {
+        FILE* input = fopen(mjpeg.c_str(), "rb");
+        if (input == NULL)
+        {
+            runCallback(OGR_CBT_ERROR_RECORDING, "Failed to open MJPEG file"
+                " for transcoding.\n");
+            return false;
+        }
+        // Count the frames for progress, they are read again in each pass
+        uint32_t private_size = 0;
+        if (fread(&private_size, 1, sizeof(uint32_t), input) !=
+            sizeof(uint32_t))
+        {
+            fclose(input);
+            return false;
+        }
+        const long first_frame = (long)(sizeof(uint32_t) + private_size);
+        fseek(input, first_frame, SEEK_SET);
+        uint8_t header[13];
+        unsigned total_frames = 0;
+        while (fread(header, 1, 13, input) == 13)
+        {
+            uint32_t jpg_size;
+            memcpy(&jpg_size, header, sizeof(uint32_t));
+            if (fseek(input, jpg_size, SEEK_CUR) != 0)
+                break;
+            total_frames++;
+        }
+        if (total_frames == 0)
+        {
+            fclose(input);
+            return false;
         }
 
-        vpx_codec_ctx_t codec;
+#ifndef ENABLE_VPX_WO_DL
+        if (!vpxLoadLibrary())
+        {
+            fclose(input);
+            return false;
+        }
+#endif
+        vpx_codec_iface_t* codec_if = vpx_codec_vp9_cx();
         vpx_codec_enc_cfg_t cfg;
-        vpx_codec_iface_t* codec_if = NULL;
-        switch (cl->getRecorderConfig().m_video_format)
-        {
-        case OGR_VF_VP8:
-            codec_if = vpx_codec_vp8_cx();
-            break;
-        case OGR_VF_VP9:
-            codec_if = vpx_codec_vp9_cx();
-            break;
-        default:
-            assert(false);
-            break;
-        }
-        vpx_codec_err_t res = vpx_codec_enc_config_default(codec_if, &cfg, 0);
-        if (res > 0)
+        if (vpx_codec_enc_config_default(codec_if, &cfg, 0) > 0)
         {
             runCallback(OGR_CBT_ERROR_RECORDING, "Failed to get default vpx"
                 " codec config.\n");
-            return 1;
+            fclose(input);
+            return false;
         }
-
-        const unsigned width = cl->getRecorderConfig().m_width;
-        const unsigned height = cl->getRecorderConfig().m_height;
-        int64_t frames_encoded = 0;
+        const unsigned width = rc.m_output_width;
+        const unsigned height = rc.m_output_height;
         cfg.g_w = width;
         cfg.g_h = height;
         cfg.g_timebase.num = 1;
-        cfg.g_timebase.den = cl->getRecorderConfig().m_record_fps;
+        cfg.g_timebase.den = rc.m_record_fps;
         cfg.rc_end_usage = VPX_VBR;
-        cfg.rc_target_bitrate = cl->getRecorderConfig().m_video_bitrate;
-
-        if (vpx_codec_enc_init(&codec, codec_if, &cfg, 0) > 0)
+        cfg.rc_target_bitrate = rc.m_video_bitrate;
+        // Nothing competes with the app anymore, so use all cores
+        cfg.g_threads = std::max(std::thread::hardware_concurrency(), 1u);
+        uint8_t* yuv = arena->get(BufferArena::BT_ENCODER_YUV,
+            width * height * 3 / 2);
+        // Not the decompressor of the output, the next recording may use it
+        tjhandle handle = tjInitDecompress();
+        std::vector<uint8_t> jpg;
+        std::string stats;
+        FILE* out = NULL;
+        bool ok = true;
+        for (int pass = 0; pass < 2 && ok; pass++)
         {
-            runCallback(OGR_CBT_ERROR_RECORDING, "Failed to initialize vpx"
-                " encoder.\n");
-            fclose(vpx_data);
-            return 1;
-        }
-        float last_size = -1.0f;
-        int cur_finished_count = 0;
-        uint8_t* yuv = new uint8_t[width * height * 3 / 2];
-        const uint32_t private_header_size = 0;
-        fwrite(&private_header_size, 1, sizeof(uint32_t), vpx_data);
-        while (true)
-        {
-            std::unique_lock<std::mutex> ul(*cl->getJPGListMutex());
-            cl->getJPGListCV()->wait(ul, [&cl]
-                { return !cl->getJPGList()->empty(); });
-            auto& p = cl->getJPGList()->front();
-            uint8_t* jpg = std::get<0>(p);
-            uint32_t jpg_size = std::get<1>(p);
-            int frame_count = std::get<2>(p);
-            if (jpg == NULL)
+            if (pass == 0)
+                cfg.g_pass = VPX_RC_FIRST_PASS;
+            else
             {
-                cl->getJPGList()->clear();
-                ul.unlock();
-                if (cl->displayingProgress())
+                cfg.g_pass = VPX_RC_LAST_PASS;
+                cfg.rc_twopass_stats_in.buf = &stats[0];
+                cfg.rc_twopass_stats_in.sz = stats.size();
+                out = fopen(output.c_str(), "wb");
+                if (out == NULL)
                 {
-                    int rate = 99;
-                    runCallback(OGR_CBT_PROGRESS_RECORDING, &rate);
+                    runCallback(OGR_CBT_ERROR_RECORDING, "Failed to open file"
+                        " for writing vpx.\n");
+                    ok = false;
+                    break;
                 }
+                const uint32_t private_header_size = 0;
+                fwrite(&private_header_size, 1, sizeof(uint32_t), out);
+            }
+            vpx_codec_ctx_t codec;
+            if (vpx_codec_enc_init(&codec, codec_if, &cfg, 0) > 0)
+            {
+                runCallback(OGR_CBT_ERROR_RECORDING, "Failed to initialize"
+                    " vpx encoder.\n");
+                ok = false;
                 break;
             }
-            cl->getJPGList()->pop_front();
-            ul.unlock();
-            if (cl->displayingProgress())
+            vpx_codec_control_(&codec, VP8E_SET_CPUUSED,
+                g_transcode_cpu_used[pass]);
+            vpx_codec_control_(&codec, VP9E_SET_TILE_COLUMNS, 6);
+#ifdef VPX_CTRL_VP9E_SET_ROW_MT
+            vpx_codec_control_(&codec, VP9E_SET_ROW_MT, 1);
+#endif
+            fseek(input, first_frame, SEEK_SET);
+            for (unsigned i = 0; i < total_frames; i++)
             {
-                if (last_size == -1.0f)
-                    last_size = (float)(cl->getJPGList()->size());
-                cur_finished_count += frame_count;
-                int rate = (int)(cur_finished_count / last_size * 100.0f);
-                rate = rate > 99 ? 99 : rate;
-                runCallback(OGR_CBT_PROGRESS_RECORDING, &rate);
+                if (cl->isDestroying() || fread(header, 1, 13, input) != 13)
+                {
+                    ok = false;
+                    break;
+                }
+                uint32_t jpg_size;
+                int64_t frame_index;
+                memcpy(&jpg_size, header, sizeof(uint32_t));
+                memcpy(&frame_index, header + sizeof(uint32_t),
+                    sizeof(int64_t));
+                jpg.resize(jpg_size);
+                if (fread(jpg.data(), 1, jpg_size, input) != jpg_size)
+                {
+                    ok = false;
+                    break;
+                }
+                if (tjDecompressToYUV(handle, jpg.data(), jpg_size, yuv,
+                    0) != 0)
+                {
+                    std::string msg = "Turbojpeg YUV conversion error: ";
+                    msg = msg + tjGetErrorStr() + "\n";
+                    runCallback(OGR_CBT_ERROR_RECORDING, msg.c_str());
+                    continue;
+                }
+                vpx_image_t each_frame;
+                vpx_img_wrap(&each_frame, VPX_IMG_FMT_I420, width, height, 1,
+                    yuv);
+                if (vpxTranscodeFrame(&codec, &each_frame, frame_index,
+                    &stats, out) < 0)
+                {
+                    ok = false;
+                    break;
+                }
+                if (display_progress)
+                {
+                    int rate = (int)(((uint64_t)pass * total_frames + i + 1) *
+                        99 / (2 * total_frames));
+                    runCallback(OGR_CBT_PROGRESS_RECORDING, &rate);
+                }
             }
-            int ret = cl->yuvConversion(jpg, jpg_size, yuv);
-            if (ret < 0)
+            while (ok && vpxTranscodeFrame(&codec, NULL, -1, &stats, out) > 0);
+            if (vpx_codec_destroy(&codec))
             {
-                tjFree(jpg);
-                continue;
+                runCallback(OGR_CBT_ERROR_RECORDING, "Failed to destroy vpx"
+                    " codec.\n");
+                ok = false;
             }
-            tjFree(jpg);
-            vpx_image_t each_frame;
-            vpx_img_wrap(&each_frame, VPX_IMG_FMT_I420, width, height, 1, yuv);
-            vpxEncodeFrame(&codec, &each_frame, frames_encoded, vpx_data);
-            frames_encoded += frame_count;
-        }
-
-        while (vpxEncodeFrame(&codec, NULL, -1, vpx_data));
-        if (vpx_codec_destroy(&codec))
-        {
-            runCallback(OGR_CBT_ERROR_RECORDING, "Failed to destroy vpx"
-                " codec.\n");
-            return 1;
         }
-        delete[] yuv;
-        fclose(vpx_data);
-        return 1;
-    }   // vpxEncoder
+        tjDestroy(handle);
+        fclose(input);
+        if (out != NULL)
+            fclose(out);
+        if (!ok)
+            remove(output.c_str());
+        return ok;
+    }   // vpxTranscode
 }
 #endif
@@ -8,14 +8,26 @@
 #ifndef HEADER_VPX_ENCODER_HPP
 #define HEADER_VPX_ENCODER_HPP
 
+#include "openglrecorder.h"
+
+#include <string>
+
+class BufferArena;
 class CaptureLibrary;
 
 namespace Recorder
 {
 #ifdef ENABLE_VPX
-    int vpxEncoder(CaptureLibrary* cl);
+    void registerVPXEncoders();
+    bool vpxTranscode(CaptureLibrary* cl, const RecorderConfig& rc,
+                      BufferArena* arena, bool display_progress,
+                      const std::string& mjpeg, const std::string& output);
 #else
-    inline int vpxEncoder(CaptureLibrary* cl) { return 0; }
+    inline void registerVPXEncoders()                                       {}
+    inline bool vpxTranscode(CaptureLibrary* cl, const RecorderConfig& rc,
+                             BufferArena* arena, bool display_progress,
+                             const std::string& mjpeg,
+                             const std::string& output)     { return false; }
 #endif
 };
 #endif